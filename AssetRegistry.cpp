@@ -0,0 +1,278 @@
+#include "AssetRegistry.hpp"
+#include "GLState.hpp"
+
+/* One file loaded with one set of flags, shared by everyone who asked for it */
+struct AssetRegistry::Asset {
+	std::string key;        // Kind, flags and canonical path
+	std::string path;       // Canonical path of the file
+	int flags;
+	int references;
+	int queued;             // GL_TRUE while it waits in loads for update()
+	int loaded;             // GL_TRUE when loadAsset() is done with it
+	Texture *texture;       // The texture, or NULL for a mesh
+	TriangleSoup *mesh;     // The mesh, or NULL for a texture
+};
+
+
+/* Constructor */
+AssetRegistry::AssetRegistry(TextureStreamer *streamer) {
+	this->streamer = streamer;
+	this->owner = std::this_thread::get_id();
+}
+
+/* Destructor */
+AssetRegistry::~AssetRegistry() {
+	std::map<std::string, Asset*>::iterator i;
+	for(i = this->assets.begin(); i != this->assets.end(); i++) {
+		this->deletes.push_back(i->second);
+	}
+	for(size_t j = 0; j < this->deletes.size(); j++) {
+		Asset *asset = this->deletes[j];
+		if(asset->texture && this->streamer) this->streamer->forget(asset->texture);
+		delete asset->texture; // The GL objects go with the context
+		delete asset->mesh;
+		delete asset;
+	}
+}
+
+/*
+ * acquire(const char *filename, int flags, int ismesh)
+ * Find the asset for a file, or make a new, empty one, and add a reference
+ * to it. New assets are loaded at once on the OpenGL thread, and queued
+ * for update() on other threads. An asset that another thread is loading
+ * is waited for. One that is queued is loaded now on the OpenGL thread,
+ * and returned as it is on other threads, for isReady() and wait().
+ */
+AssetRegistry::Asset *AssetRegistry::acquire(const char *filename, int flags, int ismesh) {
+
+	char path[4096];
+	char prefix[32];
+	Utilities::canonicalPath(filename, path, sizeof(path)); // If it fails, the loader prints the error
+	snprintf(prefix, sizeof(prefix), "%s %d ", ismesh ? "mesh" : "texture", flags);
+	std::string key = std::string(prefix) + path;
+
+	Asset *asset;
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		std::map<std::string, Asset*>::iterator i = this->assets.find(key);
+		if(i != this->assets.end()) { // Already loaded or loading, so share it
+			asset = i->second;
+			asset->references++;
+			if(asset->queued && std::this_thread::get_id() != this->owner) return asset;
+			lock.unlock();
+			this->wait(ismesh ? (const void*)asset->mesh : (const void*)asset->texture);
+			return asset;
+		}
+		asset = new Asset;
+		asset->key = key;
+		asset->path = path;
+		asset->flags = flags;
+		asset->references = 1;
+		asset->queued = GL_FALSE;
+		asset->loaded = GL_FALSE;
+		asset->texture = ismesh ? NULL : new Texture;
+		asset->mesh = ismesh ? new TriangleSoup : NULL;
+		this->assets[key] = asset;
+		this->objects[ismesh ? (const void*)asset->mesh : (const void*)asset->texture] = asset;
+		if(std::this_thread::get_id() != this->owner) {
+			asset->queued = GL_TRUE;
+			this->loads.push_back(asset);
+			return asset;
+		}
+	}
+	// Others who ask for it meanwhile wait in acquire() until it is loaded
+	this->loadAsset(asset);
+	return asset;
+}
+
+Texture *AssetRegistry::acquireTexture(const char *filename, int flags) {
+	return this->acquire(filename, flags, GL_FALSE)->texture;
+}
+
+TriangleSoup *AssetRegistry::acquireMesh(const char *filename) {
+	return this->acquire(filename, 0, GL_TRUE)->mesh;
+}
+
+/*
+ * release(const void *object)
+ * Drop a reference to the asset with a Texture or TriangleSoup. When the
+ * last one is gone, the asset is removed from the lookup at once, so it
+ * is loaded anew if it is asked for again, and deleted on the OpenGL thread.
+ */
+void AssetRegistry::release(const void *object) {
+
+	Asset *asset;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<const void*, Asset*>::iterator i = this->objects.find(object);
+		if(i == this->objects.end()) {
+			Utilities::printError("Asset error", "Release of an asset that is not in the registry");
+			return;
+		}
+		asset = i->second;
+		if(--asset->references > 0) return;
+		asset->queued = GL_FALSE;
+		this->objects.erase(i);
+		this->assets.erase(asset->key);
+		for(size_t j = 0; j < this->loads.size(); j++) {
+			if(this->loads[j] == asset) this->loads.erase(this->loads.begin() + j);
+		}
+		if(std::this_thread::get_id() != this->owner) {
+			this->deletes.push_back(asset);
+			return;
+		}
+	}
+	this->deleteAsset(asset);
+}
+
+void AssetRegistry::release(Texture *texture) {
+	this->release((const void*)texture);
+}
+
+void AssetRegistry::release(TriangleSoup *mesh) {
+	this->release((const void*)mesh);
+}
+
+/*
+ * isReady(const void *object), wait(const void *object)
+ * Whether the asset with a Texture or TriangleSoup is loaded, and wait
+ * until it is. A queued asset would wait for update() on the OpenGL
+ * thread, which is the calling thread, so it is taken from the queue
+ * and loaded right away instead.
+ */
+int AssetRegistry::isReady(const void *object) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Asset *asset = this->find(object);
+	return asset ? asset->loaded : GL_FALSE;
+}
+
+int AssetRegistry::isReady(Texture *texture) {
+	return this->isReady((const void*)texture);
+}
+
+int AssetRegistry::isReady(TriangleSoup *mesh) {
+	return this->isReady((const void*)mesh);
+}
+
+void AssetRegistry::wait(const void *object) {
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	Asset *asset = this->find(object);
+	if(!asset) return;
+	if(asset->queued && std::this_thread::get_id() == this->owner) {
+		asset->queued = GL_FALSE;
+		for(size_t j = 0; j < this->loads.size(); j++) {
+			if(this->loads[j] == asset) this->loads.erase(this->loads.begin() + j);
+		}
+		lock.unlock();
+		this->loadAsset(asset);
+		return;
+	}
+	while(!asset->loaded) {
+		this->loaded.wait(lock);
+	}
+}
+
+void AssetRegistry::wait(Texture *texture) {
+	this->wait((const void*)texture);
+}
+
+void AssetRegistry::wait(TriangleSoup *mesh) {
+	this->wait((const void*)mesh);
+}
+
+/*
+ * private
+ * find(const void *object)
+ * The asset with a Texture or TriangleSoup, with the mutex locked.
+ */
+AssetRegistry::Asset *AssetRegistry::find(const void *object) {
+	std::map<const void*, Asset*>::iterator i = this->objects.find(object);
+	if(i == this->objects.end()) {
+		Utilities::printError("Asset error", "Wait for an asset that is not in the registry");
+		return NULL;
+	}
+	return i->second;
+}
+
+/*
+ * loadAsset(Asset *asset)
+ * Load the file of an asset into its empty Texture or TriangleSoup, and
+ * wake those waiting for it.
+ */
+void AssetRegistry::loadAsset(Asset *asset) {
+
+	const char *path = asset->path.c_str();
+	if(asset->mesh) {
+		asset->mesh->readOBJ(path);
+	}
+	else if(this->streamer == NULL) {
+		asset->texture->createTexture(path, asset->flags & ~ASSET_PROGRESSIVE);
+	}
+	else if(asset->flags & ASSET_PROGRESSIVE) {
+		this->streamer->loadProgressive(asset->texture, path, asset->flags & ~ASSET_PROGRESSIVE);
+	}
+	else {
+		this->streamer->load(asset->texture, path, asset->flags);
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	asset->loaded = GL_TRUE;
+	this->loaded.notify_all();
+}
+
+/*
+ * deleteAsset(Asset *asset)
+ * Delete an asset from the GPU and from memory.
+ */
+void AssetRegistry::deleteAsset(Asset *asset) {
+
+	if(asset->texture) {
+		if(this->streamer) this->streamer->forget(asset->texture);
+		if(asset->texture->textureID != 0) {
+			GLState::deleteTextures(1, &(asset->texture->textureID));
+		}
+		delete asset->texture;
+	}
+	delete asset->mesh; // Its destructor deletes its buffers
+	delete asset;
+}
+
+/*
+ * update()
+ * Load and delete the assets that were acquired and released from
+ * other threads since the last call.
+ */
+void AssetRegistry::update() {
+
+	std::deque<Asset*> loads, deletes;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		loads.swap(this->loads);
+		deletes.swap(this->deletes);
+		for(size_t i = 0; i < loads.size(); i++) {
+			loads[i]->queued = GL_FALSE;
+		}
+	}
+	for(size_t i = 0; i < loads.size(); i++) {
+		this->loadAsset(loads[i]);
+	}
+	for(size_t i = 0; i < deletes.size(); i++) {
+		this->deleteAsset(deletes[i]);
+	}
+}
+
+int AssetRegistry::numAssets() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return (int)this->assets.size();
+}
+
+int AssetRegistry::numReferences() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	int count = 0;
+	std::map<std::string, Asset*>::iterator i;
+	for(i = this->assets.begin(); i != this->assets.end(); i++) {
+		count += i->second->references;
+	}
+	return count;
+}
@@ -0,0 +1,106 @@
+/* AssetRegistry.hpp */
+/* Class to share textures and meshes loaded from files, so each file is
+ * loaded and uploaded only once, however many objects use it. */
+/* Usage: call acquireTexture() or acquireMesh() instead of creating a
+ * Texture or TriangleSoup from a file, and release() when done with it.
+ * Assets are looked up by the canonical path of the file plus the load
+ * flags, so "textures/a.tga" and "./textures/a.tga" are the same asset,
+ * but a texture loaded with other flags is a separate one. Each acquire
+ * adds one to a reference count, each release takes one away, and the
+ * asset is deleted (also from the GPU) when the count drops to zero.
+ * Textures are loaded in the background through a TextureStreamer if one
+ * is given to the constructor, otherwise right away. Everyone who asks
+ * for a texture while it is still loading gets the same Texture object,
+ * which is filled in by the one load (see TextureStreamer.hpp).
+ * The lookup is thread safe, so any thread may acquire and release
+ * assets, but OpenGL calls can only be made on the thread that created
+ * the registry. Assets asked for from other threads are therefore
+ * created empty, and loaded by the next update() on the OpenGL thread.
+ * Call update() once per frame if you use other threads. isReady() tells
+ * if such an asset is loaded, and wait() waits for it (on the OpenGL
+ * thread, wait() loads it right away instead).
+ * Each file is loaded once, however many ask for it. An acquire that
+ * finds the asset being loaded on another thread waits for that load to
+ * finish, so nobody gets a half-built object.
+ * Like Texture, this class leaves its OpenGL objects to be deleted with
+ * the context, so it can be destroyed after the window is closed. */
+
+#ifndef ASSETREGISTRY_HPP
+#define ASSETREGISTRY_HPP
+
+#include <map>
+#include <deque>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "Texture.hpp"
+#include "TextureStreamer.hpp"
+#include "TriangleSoup.hpp"
+
+// Extra flag for acquireTexture(), combined with the Texture flags:
+// stream only the mip levels that are needed (see TextureStreamer::loadProgressive())
+#define ASSET_PROGRESSIVE (1 << 16)
+
+class AssetRegistry {
+
+public:
+
+/* Constructor. Textures are loaded through the streamer, if there is one. */
+AssetRegistry(TextureStreamer *streamer = NULL);
+
+/* Destructor. Stops the streaming of any textures still loading. */
+~AssetRegistry();
+
+// Get a shared texture, loading it if nobody has it yet.
+// flags are the same as for Texture::createTexture(), plus ASSET_PROGRESSIVE.
+Texture *acquireTexture(const char *filename, int flags = 0);
+
+// Get a shared mesh from an OBJ file, loading it if nobody has it yet
+TriangleSoup *acquireMesh(const char *filename);
+
+// Give back an asset. It is deleted when nobody holds it any more.
+void release(Texture *texture);
+void release(TriangleSoup *mesh);
+
+// GL_TRUE if an asset is loaded, GL_FALSE if it is still waiting for update()
+int isReady(Texture *texture);
+int isReady(TriangleSoup *mesh);
+
+// Wait until an asset is loaded. On the OpenGL thread, load it now if it is waiting.
+void wait(Texture *texture);
+void wait(TriangleSoup *mesh);
+
+// Load the assets asked for from other threads. Call on the OpenGL thread.
+void update();
+
+// Number of different assets held, and the total number of references to them
+int numAssets();
+int numReferences();
+
+private:
+
+struct Asset;
+
+// Internal "private" funtions
+Asset *acquire(const char *filename, int flags, int ismesh); // Find or add an asset
+void release(const void *object);           // Drop a reference to an asset
+int isReady(const void *object);            // Whether the asset with an object is loaded
+void wait(const void *object);              // Wait for the asset with an object to be loaded
+Asset *find(const void *object);            // The asset with an object, or NULL (lock the mutex first)
+void loadAsset(Asset *asset);               // Load an asset (on the OpenGL thread)
+void deleteAsset(Asset *asset);             // Delete an asset (on the OpenGL thread)
+
+std::map<std::string, Asset*> assets;       // All assets, by path and flags
+std::map<const void*, Asset*> objects;      // All assets, by Texture or TriangleSoup
+std::deque<Asset*> loads;                   // Assets waiting for update() to load them
+std::deque<Asset*> deletes;                 // Assets waiting for update() to delete them
+TextureStreamer *streamer;
+std::thread::id owner;                      // The thread with the OpenGL context
+std::mutex mutex;                           // Guards the maps, queues, counts and states
+std::condition_variable loaded;             // Signaled by loadAsset() when an asset is loaded
+
+};
+
+#endif // ASSETREGISTRY_HPP
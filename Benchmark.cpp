@@ -0,0 +1,192 @@
+#include "Benchmark.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Some <cmath> headers define M_PI, some don't. Make sure we have it.
+#ifndef M_PI
+#define M_PI (3.14159265359)
+#endif // M_PI
+
+/* Constructor */
+Benchmark::Benchmark() {
+    this->enabled = GL_FALSE;
+    this->headless = GL_FALSE;
+    this->frames = 500;
+    this->warmup = 50;
+    this->width = 1024;
+    this->height = 1024;
+    this->step = 1.0 / 60.0;
+    this->reportFile = NULL;
+    this->loadStart = 0.0;
+    this->frameStart = 0.0;
+    this->frameCount = 0;
+    this->drawCalls = 0.0;
+    this->triangles = 0.0;
+}
+
+/* Destructor */
+Benchmark::~Benchmark() {
+}
+
+
+/*
+ * parseArguments(int argc, char *argv[])
+ * Read the switches. Each one but --benchmark and --headless takes a value.
+ */
+int Benchmark::parseArguments(int argc, char *argv[]) {
+
+    for(int i = 1; i < argc; i++) {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = GL_TRUE;
+        if(strcmp(argv[i], "--benchmark") == 0) {
+            this->enabled = GL_TRUE;
+            continue;
+        }
+        else if(strcmp(argv[i], "--headless") == 0) {
+            this->enabled = GL_TRUE;
+            this->headless = GL_TRUE;
+            continue;
+        }
+        else if(value == NULL) {
+            ok = GL_FALSE;
+        }
+        else if(strcmp(argv[i], "--frames") == 0) {
+            this->frames = atoi(value);
+            ok = this->frames > 0;
+        }
+        else if(strcmp(argv[i], "--warmup") == 0) {
+            this->warmup = atoi(value);
+            ok = this->warmup >= 0;
+        }
+        else if(strcmp(argv[i], "--size") == 0) {
+            ok = sscanf(value, "%dx%d", &(this->width), &(this->height)) == 2
+                && this->width > 0 && this->height > 0;
+        }
+        else if(strcmp(argv[i], "--step") == 0) {
+            this->step = atof(value);
+            ok = this->step > 0.0;
+        }
+        else if(strcmp(argv[i], "--report") == 0) {
+            this->reportFile = value;
+        }
+        else {
+            ok = GL_FALSE;
+        }
+        if(!ok) {
+            fprintf(stderr, "Bad argument: %s %s\n", argv[i], value ? value : "");
+            fprintf(stderr, "Usage: %s [--benchmark] [--headless] [--frames N] [--warmup N] [--size WxH] [--step S] [--report FILE]\n", argv[0]);
+            return GL_FALSE;
+        }
+        i++; // Past the value
+    }
+    return GL_TRUE;
+}
+
+
+double Benchmark::time(unsigned long frame) {
+    return frame * this->step;
+}
+
+
+/*
+ * camera(double time, float *phi, float *theta)
+ * Turn once around the scene in 12 seconds, tilting up and down.
+ */
+void Benchmark::camera(double time, float *phi, float *theta) {
+    *phi = (float)(2.0 * M_PI * time / 12.0);
+    *theta = (float)(0.3 * sin(2.0 * M_PI * time / 6.0));
+}
+
+
+void Benchmark::beginLoad() {
+    this->loadStart = Utilities::getTime();
+}
+
+void Benchmark::endLoad(const char *name) {
+    this->loadNames.push_back(name);
+    this->loadTimes.push_back(1000.0 * (Utilities::getTime() - this->loadStart));
+}
+
+
+/*
+ * beginFrames()
+ * The first frame is timed from here, so it doesn't include the loading,
+ * even with no warmup.
+ */
+void Benchmark::beginFrames() {
+    this->frameStart = Utilities::getTime();
+}
+
+
+/*
+ * endFrame(int drawcalls, unsigned long triangles)
+ * Count a frame, and time it if the warmup is over. The time of a frame
+ * is from the end of the one before, so it covers the whole loop.
+ */
+int Benchmark::endFrame(int drawcalls, unsigned long triangles) {
+
+    double now = Utilities::getTime();
+    if(this->frameCount >= this->warmup) {
+        this->frameTimes.push_back((float)(1000.0 * (now - this->frameStart)));
+        this->drawCalls += drawcalls;
+        this->triangles += (double)triangles;
+    }
+    this->frameStart = now;
+    this->frameCount++;
+    return this->frameCount >= this->warmup + this->frames;
+}
+
+
+/*
+ * writeReport(FrameStats *stats, const char *renderer, unsigned long long imagehash)
+ * Write the results as one JSON object. The CPU and GPU times are those
+ * of the measured frames, the last ones in stats.
+ */
+int Benchmark::writeReport(FrameStats *stats, const char *renderer, unsigned long long imagehash) {
+
+    FILE *file = this->reportFile ? fopen(this->reportFile, "w") : stdout;
+    if(!file) {
+        fprintf(stderr, "Unable to write the benchmark report to %s.\n", this->reportFile);
+        return GL_FALSE;
+    }
+    int measured = (int)this->frameTimes.size();
+
+    fprintf(file, "{\n  \"renderer\": \"");
+    for(const char *c = renderer; *c; c++) { // Escape what JSON needs escaped
+        if(*c == '"' || *c == '\\') fputc('\\', file);
+        if((unsigned char)*c >= 32) fputc(*c, file);
+    }
+    fprintf(file, "\",\n  \"width\": %d, \"height\": %d, \"frames\": %d, \"warmup\": %d, \"step\": %g,\n",
+        this->width, this->height, measured, this->warmup, this->step);
+
+    fprintf(file, "  \"load_ms\": {");
+    for(size_t i = 0; i < this->loadNames.size(); i++) {
+        fprintf(file, "%s\"%s\": %.3f", i > 0 ? ", " : "", this->loadNames[i].c_str(), this->loadTimes[i]);
+    }
+    fprintf(file, "},\n");
+
+    for(int clock = 0; clock < 3; clock++) {
+        FrameSummary s;
+        const char *name;
+        if(clock == 0) {
+            name = "frame_ms";
+            s = FrameStats::summarizeTimes(this->frameTimes, stats->budget);
+        }
+        else {
+            name = (clock == 1) ? "cpu_ms" : "gpu_ms";
+            s = stats->summarize(measured, clock == 2);
+        }
+        fprintf(file, "  \"%s\": {\"count\": %d, \"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p95\": %.3f, "
+            "\"p99\": %.3f, \"max\": %.3f, \"over_budget\": %d},\n",
+            name, s.count, s.min, s.avg, s.p50, s.p95, s.p99, s.max, s.overBudget);
+    }
+    fprintf(file, "  \"budget_ms\": %.3f,\n", stats->budget);
+    fprintf(file, "  \"draw_calls_per_frame\": %.1f,\n", measured > 0 ? this->drawCalls / measured : 0.0);
+    fprintf(file, "  \"triangles_per_frame\": %.0f,\n", measured > 0 ? this->triangles / measured : 0.0);
+    fprintf(file, "  \"image_hash\": \"%016llx\"\n}\n", imagehash);
+
+    if(file == stdout) return GL_TRUE;
+    return fclose(file) == 0 ? GL_TRUE : GL_FALSE;
+}
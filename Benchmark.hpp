@@ -0,0 +1,83 @@
+/* Benchmark.hpp */
+/* Settings and results of a run of GLprimer without a user, which gives
+ * the same frames every time, so runs can be compared. */
+/* Usage: parseArguments() reads these command line switches:
+ *     --benchmark        Run the benchmark instead of the interactive program
+ *     --headless         Run the benchmark without a window (see Headless.hpp)
+ *     --frames N         Number of frames to measure (500)
+ *     --warmup N         Number of frames to draw first, not measured (50)
+ *     --size WxH         Size of the offscreen image in pixels (1024x1024)
+ *     --step S           Simulated time between frames in seconds (1/60)
+ *     --report FILE      Where to write the report (standard output)
+ * If enabled, draw to a Framebuffer of the given size, take the time of
+ * each frame from time() instead of the clock, and the view from camera()
+ * instead of the mouse and keyboard. Time loading with beginLoad() and
+ * endLoad(), and call endFrame() after each frame. When it returns GL_TRUE,
+ * the run is over, and writeReport() writes the results as JSON: load
+ * times, percentiles of the frame times, draw calls and triangles per
+ * frame, and a hash of the last image. */
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "FrameStats.hpp"
+
+class Benchmark {
+
+public:
+
+int enabled;            // GL_TRUE if --benchmark or --headless was given
+int headless;           // GL_TRUE if --headless was given
+int frames;             // Frames to measure
+int warmup;             // Frames to draw before measuring
+int width;              // Size of the offscreen image
+int height;
+double step;            // Seconds of simulated time per frame
+const char *reportFile; // NULL for standard output
+
+/* Constructor, with the default settings */
+Benchmark();
+
+/* Destructor */
+~Benchmark();
+
+// Read the command line. Prints the usage and returns GL_FALSE if it is wrong.
+int parseArguments(int argc, char *argv[]);
+
+// Simulated time of a frame, in seconds
+double time(unsigned long frame);
+
+// Scripted view at a time, as the angles of a MouseRotator
+void camera(double time, float *phi, float *theta);
+
+// Time a part of the loading, under a name in the report
+void beginLoad();
+void endLoad(const char *name);
+
+// Start the clock of the first frame. Call right before the main loop.
+void beginFrames();
+
+// Count a frame, with its draw calls and triangles. Returns GL_TRUE after the last frame.
+int endFrame(int drawcalls, unsigned long triangles);
+
+// Write the report, with the CPU and GPU times from stats and a hash of the last image.
+// Returns GL_FALSE if the file can't be written.
+int writeReport(FrameStats *stats, const char *renderer, unsigned long long imagehash);
+
+private:
+
+std::vector<std::string> loadNames;
+std::vector<double> loadTimes;   // Milliseconds
+double loadStart;
+std::vector<float> frameTimes;  // Wall clock time of each measured frame, in milliseconds
+double frameStart;              // When the last frame ended
+int frameCount;                 // Frames drawn, warmup included
+double drawCalls;               // Sums over the measured frames
+double triangles;
+};
+
+#endif // BENCHMARK_HPP
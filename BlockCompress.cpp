@@ -0,0 +1,357 @@
+/*
+ * BC1/BC3 block compression.
+ * Each 4x4 block is loaded into separate float arrays per channel,
+ * so the per-pixel loops over the 16 pixels are straight-line code
+ * that the compiler turns into SIMD instructions.
+ * This code is in the public domain.
+ */
+
+#include "BlockCompress.hpp"
+
+#include <cstring>
+#include <cmath>
+
+
+/* A 4x4 block of pixels, one array per channel, values 0 to 255 */
+struct Block {
+    float r[16];
+    float g[16];
+    float b[16];
+    float a[16];
+};
+
+/* Fetch a block from BGR(A) pixels. Pixels outside the image
+ * repeat the last row or column. */
+static void loadBlock(const unsigned char *pixels, unsigned int width, unsigned int height,
+                      unsigned int channels, size_t rowbytes, unsigned int bx, unsigned int by, Block *block) {
+    for(unsigned int j = 0; j < 4; j++) {
+        unsigned int y = 4*by + j < height ? 4*by + j : height - 1;
+        for(unsigned int i = 0; i < 4; i++) {
+            unsigned int x = 4*bx + i < width ? 4*bx + i : width - 1;
+            const unsigned char *p = pixels + y * rowbytes + (size_t)x * channels;
+            block->b[4*j+i] = p[0];
+            block->g[4*j+i] = p[1];
+            block->r[4*j+i] = p[2];
+            block->a[4*j+i] = channels == 4 ? p[3] : 255.0f;
+        }
+    }
+}
+
+
+/* ---- RGB565 endpoints ---- */
+
+static inline int quantize(float c, int maxvalue) {
+    int q = (int)(c * maxvalue / 255.0f + 0.5f);
+    return q < 0 ? 0 : (q > maxvalue ? maxvalue : q);
+}
+
+static inline unsigned int pack565(const float *rgb) {
+    return (quantize(rgb[0], 31) << 11) | (quantize(rgb[1], 63) << 5) | quantize(rgb[2], 31);
+}
+
+// Expand to 8 bits by bit replication, like the hardware does
+static inline void unpack565(unsigned int c, int *rgb) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors of a block in four-color mode (color0 > color1)
+static void makePalette(unsigned int c0, unsigned int c1, int palette[4][3]) {
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for(int k = 0; k < 3; k++) {
+        palette[2][k] = (2*palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2*palette[1][k]) / 3;
+    }
+}
+
+
+/* ---- Color block (BC1, and the color half of BC3) ---- */
+
+/* Pick the closest palette color for each pixel. Returns the squared error. */
+static float selectIndices(const Block *block, unsigned int c0, unsigned int c1, unsigned char *indices) {
+    int palette[4][3];
+    float error = 0.0f;
+    makePalette(c0, c1, palette);
+    for(int k = 0; k < 16; k++) {
+        float best = 1e30f;
+        unsigned char bestindex = 0;
+        for(int m = 0; m < 4; m++) {
+            float dr = block->r[k] - palette[m][0];
+            float dg = block->g[k] - palette[m][1];
+            float db = block->b[k] - palette[m][2];
+            float d = dr*dr + dg*dg + db*db;
+            if(d < best) {
+                best = d;
+                bestindex = (unsigned char)m;
+            }
+        }
+        indices[k] = bestindex;
+        error += best;
+    }
+    return error;
+}
+
+/* Quantize two endpoints and order them for four-color mode.
+ * Returns GL_FALSE if they became the same color. */
+static int makeEndpoints(const float *e0, const float *e1, unsigned int *c0, unsigned int *c1) {
+    *c0 = pack565(e0);
+    *c1 = pack565(e1);
+    if(*c0 < *c1) {
+        unsigned int temp = *c0;
+        *c0 = *c1;
+        *c1 = temp;
+    }
+    return *c0 != *c1;
+}
+
+/* Least squares endpoints for a given set of indices */
+static int refineEndpoints(const Block *block, const unsigned char *indices, float *e0, float *e1) {
+    static const float weight0[4] = {1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f};
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f}, bx[3] = {0.0f, 0.0f, 0.0f};
+    for(int k = 0; k < 16; k++) {
+        float w0 = weight0[indices[k]], w1 = 1.0f - w0;
+        aa += w0*w0;
+        bb += w1*w1;
+        ab += w0*w1;
+        ax[0] += w0*block->r[k]; ax[1] += w0*block->g[k]; ax[2] += w0*block->b[k];
+        bx[0] += w1*block->r[k]; bx[1] += w1*block->g[k]; bx[2] += w1*block->b[k];
+    }
+    float det = aa*bb - ab*ab;
+    if(fabsf(det) < 1e-6f) return GL_FALSE; // All pixels use the same index
+    for(int k = 0; k < 3; k++) {
+        e0[k] = (ax[k]*bb - bx[k]*ab) / det;
+        e1[k] = (bx[k]*aa - ax[k]*ab) / det;
+    }
+    return GL_TRUE;
+}
+
+static void writeColorBlock(unsigned int c0, unsigned int c1, const unsigned char *indices, unsigned char *out) {
+    unsigned int bits = 0;
+    for(int k = 0; k < 16; k++) {
+        bits |= (unsigned int)indices[k] << (2*k);
+    }
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    out[4] = bits & 0xff; out[5] = (bits >> 8) & 0xff;
+    out[6] = (bits >> 16) & 0xff; out[7] = bits >> 24;
+}
+
+static void encodeColorBlock(const Block *block, unsigned char *out) {
+
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    float e0[3], e1[3];
+    unsigned char indices[16], newindices[16];
+    unsigned int c0, c1;
+
+    for(int k = 0; k < 16; k++) {
+        mean[0] += block->r[k]; mean[1] += block->g[k]; mean[2] += block->b[k];
+    }
+    mean[0] /= 16.0f; mean[1] /= 16.0f; mean[2] /= 16.0f;
+
+    for(int k = 0; k < 16; k++) {
+        float r = block->r[k] - mean[0], g = block->g[k] - mean[1], b = block->b[k] - mean[2];
+        cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+        cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+    }
+
+    // The principal axis, by a few steps of power iteration
+    for(int iter = 0; iter < 4; iter++) {
+        float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+        float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+        float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+        float length = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+        if(length < 1e-6f) break; // A flat block, any axis will do
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+    float length2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+
+    // The extent of the block along the axis
+    float tmin = 1e30f, tmax = -1e30f;
+    for(int k = 0; k < 16; k++) {
+        float t = ((block->r[k] - mean[0])*axis[0] + (block->g[k] - mean[1])*axis[1]
+                 + (block->b[k] - mean[2])*axis[2]) / length2;
+        tmin = fminf(tmin, t);
+        tmax = fmaxf(tmax, t);
+    }
+    // Move the endpoints in a little, since few pixels are at the very ends
+    float inset = (tmax - tmin) / 16.0f;
+    tmin += inset;
+    tmax -= inset;
+    for(int k = 0; k < 3; k++) {
+        e0[k] = mean[k] + tmax * axis[k];
+        e1[k] = mean[k] + tmin * axis[k];
+    }
+
+    if(!makeEndpoints(e0, e1, &c0, &c1)) {
+        memset(indices, 0, sizeof(indices)); // A single color block
+        writeColorBlock(c0, c1, indices, out);
+        return;
+    }
+    float error = selectIndices(block, c0, c1, indices);
+
+    // One least squares refinement step, kept only if it helps
+    if(refineEndpoints(block, indices, e0, e1)) {
+        unsigned int n0, n1;
+        if(makeEndpoints(e0, e1, &n0, &n1)) {
+            float newerror = selectIndices(block, n0, n1, newindices);
+            if(newerror < error) {
+                c0 = n0;
+                c1 = n1;
+                memcpy(indices, newindices, sizeof(indices));
+            }
+        }
+    }
+    writeColorBlock(c0, c1, indices, out);
+}
+
+
+/* ---- Alpha block (the alpha half of BC3) ---- */
+
+/* Eight alpha values evenly spaced between the min and max,
+ * so each pixel just rounds to the nearest step. */
+static void encodeAlphaBlock(const Block *block, unsigned char *out) {
+
+    float amin = 255.0f, amax = 0.0f;
+    unsigned long long bits = 0;
+
+    for(int k = 0; k < 16; k++) {
+        amin = fminf(amin, block->a[k]);
+        amax = fmaxf(amax, block->a[k]);
+    }
+    out[0] = (unsigned char)amax; // alpha0 > alpha1 selects the 8 value mode
+    out[1] = (unsigned char)amin;
+
+    if(amax > amin) {
+        float scale = 7.0f / (amax - amin);
+        for(int k = 0; k < 16; k++) {
+            int step = (int)((block->a[k] - amin) * scale + 0.5f); // 0 is amin, 7 is amax
+            // Index 0 is alpha0 (amax), 1 is alpha1 (amin), 2-7 go from amax down to amin
+            int index = step == 7 ? 0 : (step == 0 ? 1 : 8 - step);
+            bits |= (unsigned long long)index << (3*k);
+        }
+    }
+    for(int k = 0; k < 6; k++) {
+        out[2+k] = (unsigned char)(bits >> (8*k));
+    }
+}
+
+
+/* ---- Public functions ---- */
+
+unsigned int BlockCompress::blockBytes(unsigned int channels) {
+    return channels == 4 ? BC3_BLOCKBYTES : BC1_BLOCKBYTES;
+}
+
+size_t BlockCompress::encodedSize(unsigned int width, unsigned int height, unsigned int channels) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(channels);
+}
+
+void BlockCompress::encodeImage(const unsigned char *pixels, unsigned int width, unsigned int height,
+                                unsigned int channels, unsigned char *blocks, size_t rowbytes) {
+
+    if(rowbytes == 0) rowbytes = (size_t)width * channels;
+    unsigned int blockswide = (width + 3) / 4;
+    unsigned int blockshigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(channels);
+
+    Utilities::parallelRows(blockshigh, (size_t)blockswide * 256, [&](unsigned int first, unsigned int end) {
+        Block block;
+        for(unsigned int by = first; by < end; by++) {
+            for(unsigned int bx = 0; bx < blockswide; bx++) {
+                unsigned char *out = blocks + ((size_t)by * blockswide + bx) * bytes;
+                loadBlock(pixels, width, height, channels, rowbytes, bx, by, &block);
+                if(channels == 4) {
+                    encodeAlphaBlock(&block, out);
+                    out += 8;
+                }
+                encodeColorBlock(&block, out);
+            }
+        }
+    });
+}
+
+void BlockCompress::decodeImage(const unsigned char *blocks, unsigned int width, unsigned int height,
+                                unsigned int channels, unsigned char *pixels) {
+
+    unsigned int blockswide = (width + 3) / 4;
+    unsigned int blockshigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(channels);
+
+    for(unsigned int by = 0; by < blockshigh; by++) {
+        for(unsigned int bx = 0; bx < blockswide; bx++) {
+            const unsigned char *in = blocks + ((size_t)by * blockswide + bx) * bytes;
+            int alpha[8];
+            unsigned long long alphabits = 0;
+            if(channels == 4) {
+                alpha[0] = in[0];
+                alpha[1] = in[1];
+                if(alpha[0] > alpha[1]) {
+                    for(int i = 2; i < 8; i++) alpha[i] = ((8-i)*alpha[0] + (i-1)*alpha[1]) / 7;
+                }
+                else {
+                    for(int i = 2; i < 6; i++) alpha[i] = ((6-i)*alpha[0] + (i-1)*alpha[1]) / 5;
+                    alpha[6] = 0;
+                    alpha[7] = 255;
+                }
+                for(int k = 0; k < 6; k++) alphabits |= (unsigned long long)in[2+k] << (8*k);
+                in += 8;
+            }
+            unsigned int c0 = in[0] | (in[1] << 8);
+            unsigned int c1 = in[2] | (in[3] << 8);
+            unsigned int bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+            int palette[4][3];
+            makePalette(c0, c1, palette);
+            if(c0 <= c1 && channels == 3) { // Three-color mode, only in BC1
+                for(int k = 0; k < 3; k++) {
+                    palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+                    palette[3][k] = 0;
+                }
+            }
+            for(unsigned int j = 0; j < 4; j++) {
+                for(unsigned int i = 0; i < 4; i++) {
+                    unsigned int x = 4*bx + i, y = 4*by + j;
+                    if(x >= width || y >= height) continue;
+                    int k = 4*j + i;
+                    const int *color = palette[(bits >> (2*k)) & 3];
+                    unsigned char *p = pixels + ((size_t)y * width + x) * channels;
+                    p[0] = (unsigned char)color[2]; // BGR order
+                    p[1] = (unsigned char)color[1];
+                    p[2] = (unsigned char)color[0];
+                    if(channels == 4) p[3] = (unsigned char)alpha[(alphabits >> (3*k)) & 7];
+                }
+            }
+        }
+    }
+}
+
+void BlockCompress::compress(Mipmap::MipChain *compressed, const Mipmap::MipChain *chain) {
+
+    memset(compressed, 0, sizeof(Mipmap::MipChain));
+    Mipmap::setLayout(compressed, chain->width[0], chain->height[0], chain->channels,
+                      blockBytes(chain->channels), chain->numlevels);
+    compressed->owneddata = new unsigned char[compressed->size];
+    compressed->data = compressed->owneddata;
+    for(unsigned int level = 0; level < chain->numlevels; level++) {
+        size_t rowbytes = (size_t)chain->width[level] * chain->channels;
+        rowbytes = (rowbytes + chain->rowalignment - 1) / chain->rowalignment * chain->rowalignment;
+        encodeImage(chain->data + chain->offset[level], chain->width[level], chain->height[level],
+                    chain->channels, compressed->owneddata + compressed->offset[level], rowbytes);
+    }
+}
+
+double BlockCompress::psnr(const unsigned char *a, const unsigned char *b, size_t numpixels, unsigned int channels) {
+    double sum = 0.0;
+    for(size_t i = 0; i < numpixels * channels; i++) {
+        double d = (double)a[i] - (double)b[i];
+        sum += d*d;
+    }
+    if(sum == 0.0) return HUGE_VAL;
+    double mse = sum / (numpixels * channels);
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
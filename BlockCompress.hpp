@@ -0,0 +1,69 @@
+/* BlockCompress.hpp */
+/*
+ * A BC1/BC3 (DXT1/DXT5, S3TC) texture compressor.
+ * Usage: call compress() to turn an uncompressed MipChain into a block
+ * compressed one, or encodeImage() for a single image. BC1 is used for RGB
+ * images (8 bytes per 4x4 block) and BC3 for RGBA (16 bytes per block).
+ * The input is BGR(A), the byte order of TGA files that Texture keeps.
+ * decodeImage() and psnr() are there to check the quality on the CPU.
+ * The encoder fits the endpoints along the principal axis of each
+ * block and refines them with a least squares step. Rows of blocks
+ * are split over several threads.
+ * This code is in the public domain.
+ */
+
+#ifndef BLOCKCOMPRESS_HPP // Avoid including this header twice
+#define BLOCKCOMPRESS_HPP
+
+#include <cstddef> // For size_t
+
+#include "Mipmap.hpp"
+
+namespace BlockCompress {
+
+// Bytes per 4x4 block
+enum {
+    BC1_BLOCKBYTES = 8,
+    BC3_BLOCKBYTES = 16
+};
+
+/*
+ * blockBytes() - BC1 for 3 channels, BC3 for 4 channels.
+ */
+unsigned int blockBytes(unsigned int channels);
+
+/*
+ * encodedSize() - Number of bytes for an encoded image.
+ */
+size_t encodedSize(unsigned int width, unsigned int height, unsigned int channels);
+
+/*
+ * encodeImage() - Encode BGR or BGRA pixels to BC1 or BC3 blocks.
+ * Edge blocks of images that are not a multiple of 4 in size are
+ * padded by repeating the last row and column. rowbytes is the distance
+ * between rows in pixels, 0 for tightly packed rows.
+ */
+void encodeImage(const unsigned char *pixels, unsigned int width, unsigned int height,
+                 unsigned int channels, unsigned char *blocks, size_t rowbytes = 0);
+
+/*
+ * decodeImage() - Decode BC1 or BC3 blocks to BGR or BGRA pixels.
+ */
+void decodeImage(const unsigned char *blocks, unsigned int width, unsigned int height,
+                 unsigned int channels, unsigned char *pixels);
+
+/*
+ * compress() - Encode all levels of an uncompressed mip chain
+ * into a new, block compressed chain (with tightly packed blocks).
+ */
+void compress(Mipmap::MipChain *compressed, const Mipmap::MipChain *chain);
+
+/*
+ * psnr() - Peak signal to noise ratio in dB between two images
+ * with the same layout, over all channels. Infinite if they are equal.
+ */
+double psnr(const unsigned char *a, const unsigned char *b, size_t numpixels, unsigned int channels);
+
+}
+
+#endif // BLOCKCOMPRESS_HPP
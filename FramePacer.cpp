@@ -0,0 +1,169 @@
+#include "FramePacer.hpp"
+
+#include <cstring> // For memset()
+
+/* Constructor */
+FramePacer::FramePacer(int maxframes) {
+    memset(&(this->last), 0, sizeof(this->last));
+    memset(&(this->total), 0, sizeof(this->total));
+    memset(this->slots, 0, sizeof(this->slots));
+    this->framesTimed = 0;
+    this->waits = 0;
+    this->frame = 0;
+    this->gpuOffset = 0.0;
+    this->stats = NULL;
+    this->setMaxFrames(maxframes);
+}
+
+/* Destructor */
+FramePacer::~FramePacer() {
+}
+
+
+void FramePacer::setMaxFrames(int maxframes) {
+    if(maxframes < 1) maxframes = 1;
+    if(maxframes > FRAMEPACER_MAXFRAMES) maxframes = FRAMEPACER_MAXFRAMES;
+    this->maxframes = maxframes;
+}
+
+int FramePacer::maxFrames() {
+    return this->maxframes;
+}
+
+void FramePacer::setStats(FrameStats *stats) {
+    this->stats = stats;
+}
+
+
+/*
+ * beginFrame()
+ * Retire the frames that have to be done before this one can start,
+ * oldest first, waiting for them if need be. Then start timing this one.
+ */
+void FramePacer::beginFrame() {
+
+    if(this->frame % 256 == 0) this->calibrate(); // The clocks may drift apart
+    double start = Utilities::getTime();
+    int waited = GL_FALSE;
+    for(unsigned long k = this->frame - FRAMEPACER_SLOTS; k != this->frame - this->maxframes + 1; k++) {
+        Slot *slot = &(this->slots[k % FRAMEPACER_SLOTS]);
+        if(slot->fence != 0 && slot->frame == k) {
+            if(slot->signaled == 0.0) this->poll(slot);
+            if(slot->signaled == 0.0) waited = GL_TRUE;
+            this->retire(slot);
+        }
+    }
+    if(waited) this->waits++;
+
+    Slot *slot = &(this->slots[this->frame % FRAMEPACER_SLOTS]);
+    if(slot->queries[0] == 0) {
+        glGenQueries(2, slot->queries);
+    }
+    slot->frame = this->frame;
+    slot->begin = Utilities::getTime();
+    slot->wait = slot->begin - start;
+    slot->signaled = 0.0;
+    glQueryCounter(slot->queries[0], GL_TIMESTAMP);
+}
+
+
+/*
+ * endFrame()
+ * Mark the end of the frame on the GPU, and check which of the frames
+ * in flight are done, for the time they finished.
+ */
+void FramePacer::endFrame() {
+
+    Slot *slot = &(this->slots[this->frame % FRAMEPACER_SLOTS]);
+    glQueryCounter(slot->queries[1], GL_TIMESTAMP);
+    slot->submit = Utilities::getTime();
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    for(int i = 0; i < FRAMEPACER_SLOTS; i++) {
+        if(this->slots[i].fence != 0 && this->slots[i].signaled == 0.0) {
+            this->poll(&(this->slots[i]));
+        }
+    }
+    this->frame++;
+}
+
+
+/*
+ * finish()
+ * Retire all frames in flight, oldest first.
+ */
+void FramePacer::finish() {
+
+    for(unsigned long k = this->frame - FRAMEPACER_SLOTS; k != this->frame; k++) {
+        Slot *slot = &(this->slots[k % FRAMEPACER_SLOTS]);
+        if(slot->fence != 0 && slot->frame == k) this->retire(slot);
+    }
+}
+
+
+/*
+ * private
+ * poll(Slot *slot)
+ * Note the time if the fence of a slot has signaled, without waiting.
+ */
+void FramePacer::poll(Slot *slot) {
+
+    GLenum status = glClientWaitSync(slot->fence, 0, 0);
+    if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        slot->signaled = Utilities::getTime();
+    }
+}
+
+
+/*
+ * private
+ * retire(Slot *slot)
+ * Wait for the fence of a slot, if it has not signaled yet, and read the
+ * timestamps of the frame. They are there by now, so that doesn't wait.
+ */
+void FramePacer::retire(Slot *slot) {
+
+    if(slot->signaled == 0.0) {
+        glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // At most a second
+        slot->signaled = Utilities::getTime();
+    }
+    glDeleteSync(slot->fence);
+    slot->fence = 0;
+
+    GLuint64 gpustart = 0, gpuend = 0;
+    glGetQueryObjectui64v(slot->queries[0], GL_QUERY_RESULT, &gpustart);
+    glGetQueryObjectui64v(slot->queries[1], GL_QUERY_RESULT, &gpuend);
+
+    // On the CPU clock, in milliseconds from the start of the frame
+    double origin = slot->begin + this->gpuOffset;
+    this->last.frame = slot->frame;
+    this->last.wait = 1000.0 * slot->wait;
+    this->last.submit = 1000.0 * (slot->submit - slot->begin);
+    this->last.gpuStart = 1000.0 * (gpustart * 1e-9 - origin);
+    this->last.gpuEnd = 1000.0 * (gpuend * 1e-9 - origin);
+    this->last.signaled = 1000.0 * (slot->signaled - slot->begin);
+
+    this->total.wait += this->last.wait;
+    this->total.submit += this->last.submit;
+    this->total.gpuStart += this->last.gpuStart;
+    this->total.gpuEnd += this->last.gpuEnd;
+    this->total.signaled += this->last.signaled;
+    this->framesTimed++;
+    if(this->stats) {
+        this->stats->record(this->last.frame, this->last.submit, this->last.gpuEnd - this->last.gpuStart);
+    }
+}
+
+
+/*
+ * private
+ * calibrate()
+ * Find the difference between the GPU clock, which the timestamps use,
+ * and the CPU clock. GL_TIMESTAMP is the GPU time right now, without
+ * waiting for earlier commands.
+ */
+void FramePacer::calibrate() {
+
+    GLint64 gputime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gputime);
+    this->gpuOffset = gputime * 1e-9 - Utilities::getTime();
+}
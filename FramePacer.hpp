@@ -0,0 +1,107 @@
+/* FramePacer.hpp */
+/* Class to limit how many frames the CPU may run ahead of the GPU, and to
+ * time where each frame spends its time on the way. */
+/* Usage: call beginFrame() first thing in each frame, and endFrame() last,
+ * after glfwSwapBuffers(). endFrame() puts a fence after the frame, and
+ * beginFrame() waits for the fence of the frame maxFrames back, so at most
+ * maxFrames frames are queued or drawing at any time. One frame in flight
+ * gives the least latency from input to screen, but the CPU and GPU then
+ * take turns instead of working at the same time. Two or three frames keep
+ * both busy, at the cost of one or two frames more latency.
+ * Each frame gets a GL_TIMESTAMP query at the start and at the end, so the
+ * GPU timeline can be laid against the CPU one. The results are read once
+ * the fence of the frame has signaled, when they are sure to be there, so
+ * no query makes the CPU wait. They show up in last, a few frames late,
+ * and are added to the totals for averages, and to a FrameStats if one
+ * is given to setStats(). finish() waits for all frames in flight, so
+ * the times of the last frames are in too. */
+
+#ifndef FRAMEPACER_HPP
+#define FRAMEPACER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "Utilities.hpp" // For GL extensions in Windows
+#include "FrameStats.hpp"
+
+// Most frames allowed in flight
+#define FRAMEPACER_MAXFRAMES 3
+
+// Frames kept track of: those in flight, and the one being made
+#define FRAMEPACER_SLOTS (FRAMEPACER_MAXFRAMES + 1)
+
+/* Times in a frame, in milliseconds from when beginFrame() returned */
+struct FrameTiming {
+    unsigned long frame;  // Number of the frame, from 0
+    double wait;          // Time beginFrame() waited for an older frame, before the start
+    double submit;        // When endFrame() was called: the CPU is done with the frame
+    double gpuStart;      // When the GPU got to the start of the frame
+    double gpuEnd;        // When the GPU got to the end of the frame
+    double signaled;      // When the CPU first saw the fence signaled: the frame is done
+};
+
+class FramePacer {
+
+public:
+
+FrameTiming last;           // The last frame timed, a few frames back
+FrameTiming total;          // Sums of all frames timed, for averages
+unsigned long framesTimed;  // Number of frames in total
+unsigned long waits;        // Number of times beginFrame() had to wait for the GPU
+
+/* Constructor */
+FramePacer(int maxframes = 2);
+
+/* Destructor */
+~FramePacer();
+
+// Set the number of frames in flight, from 1 to FRAMEPACER_MAXFRAMES
+void setMaxFrames(int maxframes);
+int maxFrames();
+
+// Wait until there is room for one more frame. Call first in each frame.
+void beginFrame();
+
+// Fence the frame, and check for finished frames. Call last in each frame.
+void endFrame();
+
+// Wait for all frames in flight, and read their times
+void finish();
+
+// Add the CPU (submit) and GPU time of each frame timed to a FrameStats, or to none for NULL
+void setStats(FrameStats *stats);
+
+private:
+
+/* One frame on its way through the CPU and the GPU */
+struct Slot {
+    GLsync fence;           // After the frame, or 0 if the slot is free
+    GLuint queries[2];      // GL_TIMESTAMP at the start and at the end
+    double begin;           // CPU time when the frame started, in seconds
+    double wait;            // Seconds beginFrame() waited
+    double submit;          // CPU time of endFrame()
+    double signaled;        // CPU time the fence was seen signaled, or 0
+    unsigned long frame;
+};
+
+// Internal "private" functions
+void poll(Slot *slot);      // Note the time if the fence of a slot has signaled
+void retire(Slot *slot);    // Wait for the fence of a slot, and read its times
+void calibrate();           // Measure the GPU clock against the CPU clock
+
+Slot slots[FRAMEPACER_SLOTS];
+int maxframes;
+FrameStats *stats;
+unsigned long frame;        // Number of the frame being made
+double gpuOffset;           // GPU clock minus CPU clock, in seconds
+};
+
+#endif // FRAMEPACER_HPP
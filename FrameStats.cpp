@@ -0,0 +1,237 @@
+#include "FrameStats.hpp"
+
+#include <algorithm> // For std::sort()
+#include <csignal>
+
+// Set by the signal handler, which can't do much more than this
+static volatile sig_atomic_t exportSignaled = 0;
+
+/* Constructor */
+FrameStats::FrameStats(int capacity, double budget) : ring((capacity > 0 ? capacity : 1) + 1), written(0) {
+    this->budget = budget;
+    this->overBudget = 0;
+}
+
+/* Destructor */
+FrameStats::~FrameStats() {
+}
+
+
+/*
+ * record(unsigned long frame, double cpu, double gpu)
+ * Add a frame to the ring, over the oldest one if it is full. The count
+ * goes up after the frame is in place, so readers never see it half done.
+ */
+int FrameStats::record(unsigned long frame, double cpu, double gpu) {
+
+    unsigned long n = this->written.load(std::memory_order_relaxed);
+    Sample *sample = &(this->ring[n % this->ring.size()]);
+    sample->frame = frame;
+    sample->cpu = (float)cpu;
+    sample->gpu = (float)gpu;
+    this->written.store(n + 1, std::memory_order_release);
+
+    if(cpu > this->budget || gpu > this->budget) {
+        this->overBudget++;
+        return GL_TRUE;
+    }
+    return GL_FALSE;
+}
+
+
+/*
+ * private
+ * snapshot(int window, std::vector<Sample> &samples)
+ * Copy the last window frames, or all kept for 0, oldest first. If
+ * record() wrote over some of them meanwhile, those are left out. The
+ * ring has one spare place, for the frame record() may be writing.
+ */
+void FrameStats::snapshot(int window, std::vector<Sample> &samples) {
+
+    unsigned long size = this->ring.size();
+    unsigned long end = this->written.load(std::memory_order_acquire);
+    unsigned long count = end < size - 1 ? end : size - 1;
+    if(window > 0 && (unsigned long)window < count) count = window;
+    unsigned long start = end - count;
+
+    samples.resize(count);
+    for(unsigned long i = 0; i < count; i++) {
+        samples[i] = this->ring[(start + i) % size];
+    }
+
+    // record() may be writing frame number "now" over frame now - size
+    std::atomic_thread_fence(std::memory_order_acquire);
+    unsigned long now = this->written.load(std::memory_order_relaxed);
+    if(now + 1 > start + size) { // The oldest ones were written over
+        unsigned long lost = now + 1 - size - start;
+        if(lost > count) lost = count;
+        samples.erase(samples.begin(), samples.begin() + lost);
+    }
+}
+
+
+/*
+ * summarize(int window, int gpu)
+ * Statistics of the CPU or GPU times of the last window frames.
+ */
+FrameSummary FrameStats::summarize(int window, int gpu) {
+
+    std::vector<Sample> samples;
+    std::vector<float> times;
+
+    this->snapshot(window, samples);
+    times.resize(samples.size());
+    for(size_t i = 0; i < samples.size(); i++) {
+        times[i] = gpu ? samples[i].gpu : samples[i].cpu;
+    }
+    return summarizeTimes(times, this->budget);
+}
+
+
+/*
+ * summarizeTimes(std::vector<float> &times, double budget)
+ * Statistics of a list of times, which is sorted on the way. The
+ * percentiles are the nearest rank: the smallest time that at least that
+ * share of the frames is no longer than.
+ */
+FrameSummary FrameStats::summarizeTimes(std::vector<float> &times, double budget) {
+
+    FrameSummary summary;
+    summary.count = (int)times.size();
+    summary.overBudget = 0;
+    summary.min = summary.avg = summary.p50 = summary.p95 = summary.p99 = summary.max = 0.0;
+    for(int i = 0; i <= FRAMESTATS_BINS; i++) {
+        summary.bins[i] = 0;
+    }
+    if(times.empty()) return summary;
+
+    double sum = 0.0;
+    for(size_t i = 0; i < times.size(); i++) {
+        sum += times[i];
+        if(times[i] > budget) summary.overBudget++;
+        int bin = (int)(times[i] / (2.0 * budget) * FRAMESTATS_BINS);
+        summary.bins[bin < FRAMESTATS_BINS ? bin : FRAMESTATS_BINS]++;
+    }
+    std::sort(times.begin(), times.end());
+    int n = (int)times.size();
+    summary.min = times[0];
+    summary.max = times[n - 1];
+    summary.avg = sum / n;
+    summary.p50 = times[(n * 50 + 99) / 100 - 1];
+    summary.p95 = times[(n * 95 + 99) / 100 - 1];
+    summary.p99 = times[(n * 99 + 99) / 100 - 1];
+    return summary;
+}
+
+
+/*
+ * report(FILE *out, int window)
+ * Print the statistics of the CPU and GPU times, each with a histogram
+ * in bins of one eighth of the budget.
+ */
+void FrameStats::report(FILE *out, int window) {
+
+    for(int gpu = 0; gpu < 2; gpu++) {
+        FrameSummary s = this->summarize(window, gpu);
+        if(s.count == 0) continue;
+        fprintf(out, "%s frame times over %d frames (ms): min %.2f, avg %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f, %d over the %.2f ms budget\n",
+            gpu ? "GPU" : "CPU", s.count, s.min, s.avg, s.p50, s.p95, s.p99, s.max, s.overBudget, this->budget);
+        int most = 1;
+        for(int i = 0; i <= FRAMESTATS_BINS; i++) {
+            if(s.bins[i] > most) most = s.bins[i];
+        }
+        double binwidth = 2.0 * this->budget / FRAMESTATS_BINS;
+        for(int i = 0; i <= FRAMESTATS_BINS; i++) {
+            char bar[41];
+            int length = (s.bins[i] * 40 + most - 1) / most;
+            for(int j = 0; j < length; j++) bar[j] = '#';
+            bar[length] = '\0';
+            if(i < FRAMESTATS_BINS) {
+                fprintf(out, "  %6.2f-%6.2f %6d %s\n", i * binwidth, (i + 1) * binwidth, s.bins[i], bar);
+            }
+            else {
+                fprintf(out, "  %6.2f-       %6d %s\n", i * binwidth, s.bins[i], bar);
+            }
+        }
+    }
+}
+
+
+/*
+ * exportCSV(const char *filename)
+ * Write one line for each frame kept, with a header line.
+ */
+int FrameStats::exportCSV(const char *filename) {
+
+    std::vector<Sample> samples;
+    FILE *file = fopen(filename, "w");
+    if(!file) {
+        fprintf(stderr, "Unable to write frame statistics to %s.\n", filename);
+        return GL_FALSE;
+    }
+    this->snapshot(0, samples);
+    fprintf(file, "frame,cpu_ms,gpu_ms,over_budget\n");
+    for(size_t i = 0; i < samples.size(); i++) {
+        int over = samples[i].cpu > this->budget || samples[i].gpu > this->budget;
+        fprintf(file, "%lu,%.3f,%.3f,%d\n", samples[i].frame, samples[i].cpu, samples[i].gpu, over);
+    }
+    return fclose(file) == 0 ? GL_TRUE : GL_FALSE;
+}
+
+
+/*
+ * exportJSON(const char *filename)
+ * Write the statistics of both clocks, and the frames kept.
+ */
+int FrameStats::exportJSON(const char *filename) {
+
+    std::vector<Sample> samples;
+    FILE *file = fopen(filename, "w");
+    if(!file) {
+        fprintf(stderr, "Unable to write frame statistics to %s.\n", filename);
+        return GL_FALSE;
+    }
+    fprintf(file, "{\n  \"budget_ms\": %.3f,\n", this->budget);
+    for(int gpu = 0; gpu < 2; gpu++) {
+        FrameSummary s = this->summarize(0, gpu);
+        fprintf(file, "  \"%s\": {\"count\": %d, \"over_budget\": %d, \"min\": %.3f, \"avg\": %.3f, "
+            "\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"histogram\": [",
+            gpu ? "gpu" : "cpu", s.count, s.overBudget, s.min, s.avg, s.p50, s.p95, s.p99, s.max);
+        for(int i = 0; i <= FRAMESTATS_BINS; i++) {
+            fprintf(file, i > 0 ? ", %d" : "%d", s.bins[i]);
+        }
+        fprintf(file, "]},\n");
+    }
+    this->snapshot(0, samples);
+    fprintf(file, "  \"frames\": [");
+    for(size_t i = 0; i < samples.size(); i++) {
+        int over = samples[i].cpu > this->budget || samples[i].gpu > this->budget;
+        fprintf(file, "%s\n    {\"frame\": %lu, \"cpu_ms\": %.3f, \"gpu_ms\": %.3f, \"over_budget\": %s}",
+            i > 0 ? "," : "", samples[i].frame, samples[i].cpu, samples[i].gpu, over ? "true" : "false");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    return fclose(file) == 0 ? GL_TRUE : GL_FALSE;
+}
+
+
+#ifdef SIGUSR1
+static void onExportSignal(int) {
+    exportSignaled = 1;
+}
+#endif
+
+/*
+ * catchSignal()
+ * Make SIGUSR1 ask for an export, on systems that have it.
+ */
+void FrameStats::catchSignal() {
+#ifdef SIGUSR1
+    signal(SIGUSR1, onExportSignal);
+#endif
+}
+
+int FrameStats::exportRequested() {
+    if(!exportSignaled) return GL_FALSE;
+    exportSignaled = 0;
+    return GL_TRUE;
+}
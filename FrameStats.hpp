@@ -0,0 +1,87 @@
+/* FrameStats.hpp */
+/* Class to record the CPU and GPU time of every frame, and to find the
+ * slow frames an average hides. */
+/* Usage: call record() once for each frame, with its times, for instance
+ * from a FramePacer. It keeps the last "capacity" frames. summarize()
+ * gives the minimum, average, median, 95th and 99th percentile and maximum
+ * over the last "window" frames, or over all of them for a window of 0,
+ * and report() prints them with a histogram of the frame times.
+ * A frame is flagged as over budget if its CPU or GPU time is longer than
+ * the budget, usually the refresh interval of the display.
+ * exportCSV() and exportJSON() write all frames kept to a file. Call
+ * catchSignal() to have SIGUSR1 ask for an export, where there is one,
+ * and check exportRequested() once per frame to do it.
+ * One thread may record() while others read the statistics. The frames
+ * are kept in a ring buffer without locks, and a reader drops any frame
+ * that was written over while it was copied. */
+
+#ifndef FRAMESTATS_HPP
+#define FRAMESTATS_HPP
+
+#include <cstdio>
+#include <vector>
+#include <atomic>
+
+#include "Utilities.hpp" // For GL_TRUE and GL_FALSE
+
+// Number of bins in the histogram, up to twice the budget, plus one for the rest
+#define FRAMESTATS_BINS 16
+
+/* Statistics of one clock over a window of frames, in milliseconds */
+struct FrameSummary {
+    int count;              // Number of frames
+    int overBudget;         // Number of frames longer than the budget
+    double min, avg, p50, p95, p99, max;
+    int bins[FRAMESTATS_BINS + 1]; // Histogram, the last bin for twice the budget and more
+};
+
+class FrameStats {
+
+public:
+
+double budget;              // Time allowed for a frame, in milliseconds
+unsigned long overBudget;   // Number of frames over budget, of all recorded
+
+/* Constructor */
+FrameStats(int capacity = 4096, double budget = 1000.0 / 60.0);
+
+/* Destructor */
+~FrameStats();
+
+// Add a frame. Returns GL_TRUE if it was over budget.
+int record(unsigned long frame, double cpu, double gpu);
+
+// Statistics over the last window frames, or all of them for 0, of the CPU (gpu = 0) or GPU (gpu = 1) times
+FrameSummary summarize(int window, int gpu);
+
+// Statistics of any list of times, in milliseconds. The list is sorted.
+static FrameSummary summarizeTimes(std::vector<float> &times, double budget);
+
+// Print the statistics of both clocks, with histograms
+void report(FILE *out, int window);
+
+// Write all frames kept, and their statistics. Returns GL_FALSE on failure.
+int exportCSV(const char *filename);
+int exportJSON(const char *filename);
+
+// Ask for an export on SIGUSR1, and check if one was asked for since the last call
+static void catchSignal();
+static int exportRequested();
+
+private:
+
+/* One frame, in the ring buffer */
+struct Sample {
+    unsigned long frame;
+    float cpu;              // Milliseconds
+    float gpu;
+};
+
+// Internal "private" function
+void snapshot(int window, std::vector<Sample> &samples); // Copy the last frames
+
+std::vector<Sample> ring;
+std::atomic<unsigned long> written; // Number of frames recorded, which only record() changes
+};
+
+#endif // FRAMESTATS_HPP
@@ -0,0 +1,78 @@
+#include "Framebuffer.hpp"
+#include "GLState.hpp"
+
+#include <vector>
+
+/* Constructor */
+Framebuffer::Framebuffer() {
+    this->framebufferID = 0;
+    this->colorbufferID = 0;
+    this->depthbufferID = 0;
+    this->width = 0;
+    this->height = 0;
+}
+
+/* Destructor */
+Framebuffer::~Framebuffer() {
+}
+
+
+/*
+ * create(int width, int height)
+ * Make a framebuffer object with a color and a depth renderbuffer.
+ * Renderbuffers rather than textures, since they are only drawn to and
+ * read back, never sampled.
+ */
+int Framebuffer::create(int width, int height) {
+
+    this->width = width;
+    this->height = height;
+
+    glGenRenderbuffers(1, &(this->colorbufferID));
+    glBindRenderbuffer(GL_RENDERBUFFER, this->colorbufferID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &(this->depthbufferID));
+    glBindRenderbuffer(GL_RENDERBUFFER, this->depthbufferID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &(this->framebufferID));
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebufferID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorbufferID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthbufferID);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Framebuffer of %dx%d pixels is incomplete (status 0x%x).\n", width, height, status);
+        return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+
+void Framebuffer::bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, this->framebufferID);
+    GLState::viewport(0, 0, this->width, this->height);
+}
+
+
+/*
+ * checksum()
+ * Read the color buffer and hash it. This waits for the GPU to finish
+ * drawing, so call it only at the end.
+ */
+unsigned long long Framebuffer::checksum() {
+
+    std::vector<unsigned char> pixels((size_t)this->width * this->height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->framebufferID);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < pixels.size(); i++) {
+        hash ^= pixels[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
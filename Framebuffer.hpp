@@ -0,0 +1,53 @@
+/* Framebuffer.hpp */
+/* Class for an offscreen render target of a fixed size, with a color and
+ * a depth buffer, for rendering without a window on screen. */
+/* Usage: call create() once there is an OpenGL context, and bind() before
+ * drawing, instead of drawing to the window. bind() also sets the viewport
+ * to the whole target. checksum() reads back the pixels and hashes them,
+ * so two runs that should give the same image can be compared.
+ * Like Texture, this class leaves its OpenGL objects to be deleted with
+ * the context, so it can be destroyed after the window is closed. */
+
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "Utilities.hpp" // For GL extensions in Windows
+
+class Framebuffer {
+
+public:
+
+GLuint framebufferID;
+GLuint colorbufferID;   // GL_RGBA8 renderbuffer
+GLuint depthbufferID;   // GL_DEPTH_COMPONENT24 renderbuffer
+int width;
+int height;
+
+/* Constructor */
+Framebuffer();
+
+/* Destructor */
+~Framebuffer();
+
+// Make the target. Returns GL_FALSE if OpenGL can't draw to it.
+int create(int width, int height);
+
+// Draw to the target from now on, to all of it
+void bind();
+
+// 64-bit FNV-1a hash of the color buffer, as RGBA bytes
+unsigned long long checksum();
+
+};
+
+#endif // FRAMEBUFFER_HPP
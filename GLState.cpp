@@ -0,0 +1,236 @@
+#include "GLState.hpp"
+
+// Value for state we don't know, which never matches a real value
+#define GLSTATE_UNKNOWN 0xFFFFFFFFu
+
+// Texture units we keep a copy for. Others are passed on.
+#define GLSTATE_MAXUNITS 32
+
+// The targets and capabilities in the copy, in the order of the arrays below
+static const GLenum bufferTargets[] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+    GL_PIXEL_PACK_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_TEXTURE_BUFFER
+};
+static const GLenum textureTargets[] = {
+    GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP
+};
+static const GLenum capabilities[] = {
+    GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_RASTERIZER_DISCARD, GL_SCISSOR_TEST,
+    GL_STENCIL_TEST, GL_POLYGON_OFFSET_FILL, GL_FRAMEBUFFER_SRGB, GL_MULTISAMPLE, GL_PRIMITIVE_RESTART
+};
+#define GLSTATE_NUMBUFFERS (sizeof(bufferTargets) / sizeof(bufferTargets[0]))
+#define GLSTATE_NUMTEXTURES (sizeof(textureTargets) / sizeof(textureTargets[0]))
+#define GLSTATE_NUMCAPS (sizeof(capabilities) / sizeof(capabilities[0]))
+
+/* The shadow copy */
+static GLuint program;
+static GLuint pipeline;
+static GLuint vertexArray;
+static GLuint buffers[GLSTATE_NUMBUFFERS];
+static GLuint activeUnit;     // 0 for GL_TEXTURE0, GLSTATE_MAXUNITS for a unit not in the copy
+static GLuint textures[GLSTATE_MAXUNITS][GLSTATE_NUMTEXTURES];
+static GLuint enabled[GLSTATE_NUMCAPS]; // GL_TRUE, GL_FALSE or GLSTATE_UNKNOWN
+static GLuint polygonModes;   // For GL_FRONT_AND_BACK, the only face in the core profile
+static GLint viewportBox[4];
+static int viewportKnown;
+static int initialized = 0;   // The copy is set to unknown on first use
+
+unsigned long GLState::callsIssued = 0;
+unsigned long GLState::callsElided = 0;
+
+
+/*
+ * indexOf() - The place of a value in one of the arrays above, or -1.
+ */
+static int indexOf(const GLenum *list, size_t count, GLenum value) {
+    for(size_t i = 0; i < count; i++) {
+        if(list[i] == value) return (int)i;
+    }
+    return -1;
+}
+
+/*
+ * changed() - Update one value in the copy. GL_TRUE if the call must be sent.
+ */
+static int changed(GLuint *shadow, GLuint value) {
+    if(!initialized) GLState::invalidate();
+    if(*shadow == value) {
+        GLState::callsElided++;
+        return GL_FALSE;
+    }
+    *shadow = value;
+    GLState::callsIssued++;
+    return GL_TRUE;
+}
+
+/*
+ * passedOn() - Count a call for state that is not in the copy.
+ */
+static int passedOn() {
+    GLState::callsIssued++;
+    return GL_TRUE;
+}
+
+
+void GLState::useProgram(GLuint id) {
+    if(changed(&program, id)) glUseProgram(id);
+}
+
+void GLState::bindProgramPipeline(GLuint id) {
+    if(changed(&pipeline, id)) glBindProgramPipeline(id);
+}
+
+/*
+ * bindVertexArray() - The element array buffer binding is part of the
+ * vertex array, so it changes with it.
+ */
+void GLState::bindVertexArray(GLuint id) {
+    if(changed(&vertexArray, id)) {
+        glBindVertexArray(id);
+        buffers[indexOf(bufferTargets, GLSTATE_NUMBUFFERS, GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint id) {
+    int i = indexOf(bufferTargets, GLSTATE_NUMBUFFERS, target);
+    if(i < 0 ? passedOn() : changed(&buffers[i], id)) glBindBuffer(target, id);
+}
+
+/*
+ * bindBufferRange() - Indexed bindings are not in the copy, since they
+ * mostly change with each call, but the generic binding changes too.
+ */
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size) {
+    if(!initialized) invalidate();
+    passedOn();
+    glBindBufferRange(target, index, id, offset, size);
+    int i = indexOf(bufferTargets, GLSTATE_NUMBUFFERS, target);
+    if(i >= 0) buffers[i] = id;
+}
+
+void GLState::activeTexture(GLenum unit) {
+    if(unit - GL_TEXTURE0 >= GLSTATE_MAXUNITS) { // Not in the copy, and no unit we know is active
+        if(!initialized) invalidate();
+        passedOn();
+        glActiveTexture(unit);
+        activeUnit = GLSTATE_MAXUNITS; // Known, but not in the copy
+        return;
+    }
+    if(changed(&activeUnit, unit - GL_TEXTURE0)) glActiveTexture(unit);
+}
+
+void GLState::bindTexture(GLenum target, GLuint id) {
+    if(!initialized) invalidate();
+    if(activeUnit == GLSTATE_UNKNOWN) { // Ask once, rather than never keeping a copy of the bindings
+        GLint unit = GL_TEXTURE0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+        activeUnit = (GLuint)unit - GL_TEXTURE0;
+        if(activeUnit >= GLSTATE_MAXUNITS) activeUnit = GLSTATE_MAXUNITS;
+    }
+    int i = indexOf(textureTargets, GLSTATE_NUMTEXTURES, target);
+    if(i < 0 || activeUnit >= GLSTATE_MAXUNITS ? passedOn() : changed(&textures[activeUnit][i], id)) {
+        glBindTexture(target, id);
+    }
+}
+
+void GLState::enable(GLenum cap) {
+    int i = indexOf(capabilities, GLSTATE_NUMCAPS, cap);
+    if(i < 0 ? passedOn() : changed(&enabled[i], GL_TRUE)) glEnable(cap);
+}
+
+void GLState::disable(GLenum cap) {
+    int i = indexOf(capabilities, GLSTATE_NUMCAPS, cap);
+    if(i < 0 ? passedOn() : changed(&enabled[i], GL_FALSE)) glDisable(cap);
+}
+
+void GLState::polygonMode(GLenum face, GLenum mode) {
+    if(face != GL_FRONT_AND_BACK ? passedOn() : changed(&polygonModes, mode)) glPolygonMode(face, mode);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    if(!initialized) invalidate();
+    if(viewportKnown && viewportBox[0] == x && viewportBox[1] == y
+        && viewportBox[2] == width && viewportBox[3] == height) {
+        callsElided++;
+        return;
+    }
+    viewportBox[0] = x;
+    viewportBox[1] = y;
+    viewportBox[2] = width;
+    viewportBox[3] = height;
+    viewportKnown = GL_TRUE;
+    callsIssued++;
+    glViewport(x, y, width, height);
+}
+
+
+/*
+ * Deleting a bound object binds 0 in its place. Only the units that we
+ * have a copy for are unbound here, for the active unit and the others.
+ */
+void GLState::deleteProgramPipelines(GLsizei n, const GLuint *ids) {
+    if(!initialized) invalidate();
+    for(GLsizei i = 0; i < n; i++) {
+        if(ids[i] != 0 && pipeline == ids[i]) pipeline = 0;
+    }
+    glDeleteProgramPipelines(n, ids);
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint *ids) {
+    if(!initialized) invalidate();
+    for(GLsizei i = 0; i < n; i++) {
+        if(ids[i] != 0 && vertexArray == ids[i]) vertexArray = 0;
+    }
+    // The one bound may have been deleted even if we don't know which one it is
+    buffers[indexOf(bufferTargets, GLSTATE_NUMBUFFERS, GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+    glDeleteVertexArrays(n, ids);
+}
+
+void GLState::deleteBuffers(GLsizei n, const GLuint *ids) {
+    if(!initialized) invalidate();
+    for(GLsizei i = 0; i < n; i++) {
+        for(size_t j = 0; j < GLSTATE_NUMBUFFERS; j++) {
+            if(ids[i] != 0 && buffers[j] == ids[i]) buffers[j] = 0;
+        }
+        // A buffer may still be the element array buffer of a vertex array we don't know about
+        buffers[indexOf(bufferTargets, GLSTATE_NUMBUFFERS, GL_ELEMENT_ARRAY_BUFFER)] = GLSTATE_UNKNOWN;
+    }
+    glDeleteBuffers(n, ids);
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint *ids) {
+    if(!initialized) invalidate();
+    for(GLsizei i = 0; i < n; i++) {
+        for(int unit = 0; unit < GLSTATE_MAXUNITS; unit++) {
+            for(size_t j = 0; j < GLSTATE_NUMTEXTURES; j++) {
+                if(ids[i] != 0 && textures[unit][j] == ids[i]) textures[unit][j] = 0;
+            }
+        }
+    }
+    glDeleteTextures(n, ids);
+}
+
+
+/*
+ * invalidate() - Set the whole copy to unknown.
+ */
+void GLState::invalidate() {
+    program = GLSTATE_UNKNOWN;
+    pipeline = GLSTATE_UNKNOWN;
+    vertexArray = GLSTATE_UNKNOWN;
+    for(size_t i = 0; i < GLSTATE_NUMBUFFERS; i++) {
+        buffers[i] = GLSTATE_UNKNOWN;
+    }
+    activeUnit = GLSTATE_UNKNOWN;
+    for(int unit = 0; unit < GLSTATE_MAXUNITS; unit++) {
+        for(size_t i = 0; i < GLSTATE_NUMTEXTURES; i++) {
+            textures[unit][i] = GLSTATE_UNKNOWN;
+        }
+    }
+    for(size_t i = 0; i < GLSTATE_NUMCAPS; i++) {
+        enabled[i] = GLSTATE_UNKNOWN;
+    }
+    polygonModes = GLSTATE_UNKNOWN;
+    viewportKnown = GL_FALSE;
+    initialized = 1;
+}
@@ -0,0 +1,65 @@
+/* GLState.hpp */
+/*
+ * A shadow copy of the OpenGL state that is changed most often, so calls
+ * that would set it to what it already is are never sent to the driver.
+ * Usage: call the functions below instead of the OpenGL functions with
+ * the same names. All code that changes this state must go through here,
+ * or the shadow copy will be wrong: call invalidate() after any code that
+ * doesn't (like a library that makes its own OpenGL calls), and the next
+ * call of each kind is sent whatever the copy says.
+ * The state starts out unknown, so the first call of each kind is sent.
+ * Deleting objects through here keeps the copy right when OpenGL unbinds
+ * them, and when a new object later gets the same name.
+ * Covered: the program, program pipeline and vertex array in use, buffer
+ * bindings, texture bindings for each unit and the active unit, the usual
+ * glEnable() capabilities, the polygon mode and the viewport. Targets and
+ * capabilities not in the copy are passed on to OpenGL every time.
+ * callsIssued and callsElided count the calls sent and skipped.
+ * There is one copy, for the one context of the program.
+ */
+
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "Utilities.hpp" // For OpenGL extensions in Windows
+
+namespace GLState {
+
+// Number of calls sent to OpenGL, and skipped since they changed nothing
+extern unsigned long callsIssued;
+extern unsigned long callsElided;
+
+void useProgram(GLuint program);
+void bindProgramPipeline(GLuint pipeline);
+void bindVertexArray(GLuint array);
+void bindBuffer(GLenum target, GLuint buffer);
+void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size); // Sets the generic binding too
+void activeTexture(GLenum unit);
+void bindTexture(GLenum target, GLuint texture); // On the active unit
+void enable(GLenum cap);
+void disable(GLenum cap);
+void polygonMode(GLenum face, GLenum mode);
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// Delete objects, and unbind them in the copy as OpenGL does
+void deleteProgramPipelines(GLsizei n, const GLuint *pipelines);
+void deleteVertexArrays(GLsizei n, const GLuint *arrays);
+void deleteBuffers(GLsizei n, const GLuint *buffers);
+void deleteTextures(GLsizei n, const GLuint *textures);
+
+// Forget the state, so the next call of each kind is sent
+void invalidate();
+
+}
+
+#endif // GLSTATE_HPP
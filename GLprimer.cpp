@@ -27,6 +27,7 @@
 #include <cmath>
 
 #include <cstdio>
+#include <cstring> // For memcpy()
 
 // In MacOS X, tell GLFW to include the modern OpenGL headers.
 // Windows does not want this, so we make this Mac-only.
@@ -44,11 +45,57 @@
 #include <GLFW/glfw3.h>
 
 #include "Utilities.hpp"
+#include "GLState.hpp"
 #include "Shader.hpp"
+#include "ShaderVariants.hpp"
 #include "TriangleSoup.hpp"
 #include "Texture.hpp"
+#include "TextureArray.hpp"
+#include "TextureStreamer.hpp"
+#include "AssetRegistry.hpp"
+#include "UniformBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "FramePacer.hpp"
+#include "Profiler.hpp"
+#include "FrameStats.hpp"
+#include "Framebuffer.hpp"
+#include "Benchmark.hpp"
+#include "Headless.hpp"
+#include "JobSystem.hpp"
 #include "Rotator.hpp"
 
+// Material switches, one bit each in a ShaderVariants mask, #defined by these names in the shaders
+#define MATERIAL_TEXTURED (1 << 0)
+#define MATERIAL_SPECULAR (1 << 1)
+const char *materialDefines[] = {"TEXTURED", "SPECULAR"};
+
+/* Everything it takes to make the draw calls of a frame, and what they need
+ * from the CPU. The job system fills in one of these for the next frame
+ * while the OpenGL thread draws the one before. */
+struct SceneFrame {
+    // Set by startScene() on the OpenGL thread
+    float time;
+    float keyPhi, keyTheta, mousePhi, mouseTheta;
+    int height;                         // Of the viewport, for the texture detail needed
+    GLuint shapeTexture;                // The texture name may change as it streams in
+    // The same every frame
+    JobSystem *jobs;
+    RenderQueue *queue;                 // The draw calls, sorted, for the OpenGL thread to execute
+    ShaderPipeline *shapeShader, *planetShader;
+    Texture *texture;
+    GLuint planetTexture;
+    TriangleSoup *shape, *sphere;
+    GLfloat shapeRadius;
+    int numPlanets;
+    TextureStreamer *streamer;
+    Profiler *profiler;
+    int zone;
+    // Made by prepareScene()
+    FrameBlock frameBlock;
+    ObjectBlock objectBlock;
+    InstancesBlock planetBlock;
+};
+
 //FUNCTION DECLERATION//
 void createVertexBuffer(int location, int dimensions, const float *data, int datasize);
 
@@ -72,6 +119,15 @@ void mat4translate(float M[], float x, float y, float z);
 
 void mat4perspective(float M[], float vfov, float aspect, float znear, float zfar);
 
+Job *startScene(SceneFrame *scene, unsigned long frame, Benchmark *benchmark, GLFWwindow *window,
+    KeyRotator *keys, MouseRotator *mouse, int height);
+
+void prepareScene(Job *job, void *data);
+
+void prepareShape(Job *job, void *data);
+
+void preparePlanets(Job *job, void *data);
+
 /*
  * main(argc, argv) - the standard C++ entry point for the program
  */
@@ -79,19 +135,47 @@ int main(int argc, char *argv[]) {
     using namespace std;
 
     int width, height;
-	float time;
 
-	Texture myTexture, sphereTexture;
+	Texture *myTexture;
+	TextureArray planetTextures; // Earth, moon and sun, in that order
+	TextureStreamer textureStreamer; // Loads textures while we render (declared after them, so it stops first)
+	AssetRegistry assets(&textureStreamer); // Shares files loaded more than once (declared after the streamer it uses)
 	KeyRotator myKeyRotator;
 	MouseRotator myMouseRotator;
 
-	GLint location_time, location_M, location_R, location_MV, location_P, location_tex;
+	// IDs of the shader variables outside the uniform blocks, the same in all programs
+	const int uniform_tex = Shader::uniformID("tex");
+
+	// Uniform blocks, copied to a ring buffer for each draw call
+	UniformBuffer uniformBuffer;
+	// The draw calls of a frame, sorted to change state less. One is made while the other is drawn.
+	RenderQueue renderQueue(uniform_tex), nextRenderQueue(uniform_tex);
+	JobSystem jobs; // Worker threads, one for each core but this one, that make the draw calls
+	SceneFrame scenes[2];
+	Job *sceneJob = NULL; // Preparing the next frame
+	unsigned long bindsSubmitted = 0, bindsIssued = 0, frames = 0; // For the average binds per frame
+	FramePacer framePacer(2); // Frames the CPU may run ahead of the GPU, changed by the keys 1, 2 and 3
+	Profiler profiler; // Times of the parts of a frame, printed with the key P
+	const int zoneClear = profiler.zoneID("clear");
+	const int zoneUpdate = profiler.zoneID("texture and shader updates");
+	const int zoneScene = profiler.zoneID("scene setup");
+	const int zoneDraw = profiler.zoneID("draw");
+	int dumpKey = GL_FALSE; // The P key was down in the last frame
+	int quit = GL_FALSE;    // The main loop ends when this is set
+	FrameStats frameStats; // CPU and GPU time of each frame, written to files on exit and on SIGUSR1
+	Benchmark benchmark; // Settings from the command line for a run without a user
+	Framebuffer offscreen; // Where the benchmark draws, instead of the window
 
     const GLFWvidmode *vidmode;  // GLFW struct to hold information about the display
 	GLFWwindow *window;    // GLFW struct to hold information about the window
 
-	Shader myShader;
-	TriangleSoup myShape;
+	// The programs, in one variant for each set of material switches
+	ShaderVariants materials("vertex.glsl", "fragment.glsl", materialDefines, 2);
+	ShaderVariants planetMaterials("planetvertex.glsl", "planetfragment.glsl", materialDefines, 2);
+	const unsigned int shapeMaterial = MATERIAL_TEXTURED | MATERIAL_SPECULAR;
+	const unsigned int planetMaterial = MATERIAL_TEXTURED | MATERIAL_SPECULAR; // Shiny like the shapes, as before the variants
+	ShaderPipeline *myShader, *planetShader;
+	TriangleSoup *myShape;
     TriangleSoup mySphere;
 
 	// Vertex coordinates (x,y,z) for three vertices
@@ -99,52 +183,73 @@ int main(int argc, char *argv[]) {
 
 
 
-    /*Matrices*/
-
-    //GLfloat M[16]; // final matrix
-    GLfloat R[16]; //final rotation matrix
-    GLfloat T[16]; // translation matrix
-    GLfloat R1[16]; // rotation matrix Orbit
-    GLfloat R2[16]; // rotation matrix around y axis own axis
-    GLfloat Rx[16]; // rotation depending on key rotation
-    GLfloat Ry[16]; // rotation depending on mouse rotation
-    GLfloat S[16]; // scaling matrix
-    GLfloat V[16]; // rotation of viewpoint
-    GLfloat MV[16];
-    GLfloat P[16];
-    GLfloat T2[16];
-
-
-    // Initialise GLFW
-    glfwInit();
-
-    // Determine the desktop size
-    vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    const char *planetFiles[] = {"textures/earth.tga", "textures/moon.tga", "textures/sun.tga"};
+    const int numPlanets = 3;
 
-	// Make sure we are getting a GL context of at least version 3.3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	// Exclude old legacy cruft from the context. We don't need it, and we don't want it.
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    // Open a square window (aspect 1:1) to fill half the screen height
-    window = glfwCreateWindow(vidmode->height/2, vidmode->height/2, "GLprimer", NULL, NULL);
-    if (!window)
-    {
-        cout << "Unable to open window. Terminating." << endl;
-        glfwTerminate(); // No window was opened, so we can't continue in any useful way
+    if(!benchmark.parseArguments(argc, argv)) {
         return -1;
     }
 
-    // Make the newly created window the "current context" for OpenGL
-    // (This step is strictly required, or things will simply not work)
-    glfwMakeContextCurrent(window);
+    if(benchmark.headless) {
+        // No window system at all, just a context to draw offscreen
+        if(!Headless::createContext(3, 3)) {
+            cout << "Unable to create a headless context. Terminating." << endl;
+            return -1;
+        }
+        window = NULL;
+        vidmode = NULL;
+    }
+    else {
+        // Initialise GLFW
+        glfwInit();
+
+        // Determine the desktop size (there may be no monitor for a benchmark)
+        GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+        vidmode = monitor ? glfwGetVideoMode(monitor) : NULL;
+
+		// Make sure we are getting a GL context of at least version 3.3
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		// Exclude old legacy cruft from the context. We don't need it, and we don't want it.
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		// A benchmark draws offscreen, so its window is only for the context
+		if(benchmark.enabled) glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+        // Open a square window (aspect 1:1) to fill half the screen height
+        int windowsize = vidmode ? vidmode->height/2 : 512;
+        window = glfwCreateWindow(windowsize, windowsize, "GLprimer", NULL, NULL);
+        if (!window)
+        {
+            cout << "Unable to open window. Terminating." << endl;
+            glfwTerminate(); // No window was opened, so we can't continue in any useful way
+            return -1;
+        }
+
+        // Make the newly created window the "current context" for OpenGL
+        // (This step is strictly required, or things will simply not work)
+        glfwMakeContextCurrent(window);
+    }
 
     // Load extensions (only needed in Microsoft Windows)
     Utilities::loadExtensions();
 
-    myShader.createShader("vertex.glsl", "fragment.glsl");
+    // Compile all programs (or load them from the cache) before the first frame
+    benchmark.beginLoad();
+    Shader::bindUniformBlock("Frame", UNIFORMBLOCK_FRAME, sizeof(FrameBlock));
+    Shader::bindUniformBlock("Object", UNIFORMBLOCK_OBJECT, sizeof(ObjectBlock));
+    Shader::bindUniformBlock("Instances", UNIFORMBLOCK_OBJECT, sizeof(InstancesBlock));
+    Shader::define("UNIFORMBLOCK_MAXINSTANCES", UNIFORMBLOCK_MAXINSTANCES); // The size of the Instances array
+    materials.setHotReload(!benchmark.enabled); // Edit the shader files while the program runs
+    planetMaterials.setHotReload(!benchmark.enabled);
+    materials.warmUp(&shapeMaterial, 1);
+    planetMaterials.warmUp(&planetMaterial, 1);
+    myShader = materials.variant(shapeMaterial);
+    planetShader = planetMaterials.variant(planetMaterial);
+    benchmark.endLoad("shaders");
+    cout << "Shader programs: " << materials.numPrograms() + planetMaterials.numPrograms() << " linked for "
+         << materials.numVariants() + planetMaterials.numVariants() << " variants" << endl;
 
     //glUniformMatrix4fv(location_M, 1, GL_FALSE, M); //Copy the value
 
@@ -152,156 +257,377 @@ int main(int argc, char *argv[]) {
     cout << "GL vendor:       " << glGetString(GL_VENDOR) << endl;
     cout << "GL renderer:     " << glGetString(GL_RENDERER) << endl;
     cout << "GL version:      " << glGetString(GL_VERSION) << endl;
-    cout << "Desktop size:    " << vidmode->width << "x" << vidmode->height << " pixels" << endl;
-
+    if(vidmode) {
+        cout << "Desktop size:    " << vidmode->width << "x" << vidmode->height << " pixels" << endl;
+    }
 
 
-    glfwSwapInterval(0); // Do not wait for screen refresh between frames
 
-    location_time = glGetUniformLocation(myShader.programID, "time");
-    //location_M = glGetUniformLocation(myShader.programID, "M");
-    location_R = glGetUniformLocation(myShader.programID, "R");
-    location_MV = glGetUniformLocation(myShader.programID, "MV");
-    location_P = glGetUniformLocation(myShader.programID, "P");
-    location_tex = glGetUniformLocation(myShader.programID, "tex"); // Locate the sampler2D uniform in the shader program
+    FrameStats::catchSignal();
+    framePacer.setStats(&frameStats);
 
-    glUseProgram(myShader.programID); //Activate the shader to set its variable
+    if(window) {
+        glfwSwapInterval(0); // Do not wait for screen refresh between frames (framePacer limits how far ahead we get)
 
-    //If the variable is not found, -1 is returned
-    if(location_time == -1){
-        cout << "Unable to locate variable 'time' in shader!" << endl;
+        myKeyRotator.init(window);
+        myMouseRotator.init(window);
+    }
+    else {
+        // No input without a window, so the benchmark script moves the camera alone
+        myKeyRotator.phi = myKeyRotator.theta = 0.0f;
+        myMouseRotator.phi = myMouseRotator.theta = 0.0f;
     }
-
-    myKeyRotator.init(window);
-    myMouseRotator.init(window);
 
 
+    benchmark.beginLoad();
     mySphere.createSphere(1.0, 200);
     //myShape.createBox(1.0,1.0,1.0);
-    myShape.readOBJ("meshes/trex.obj");
+    myShape = assets.acquireMesh("meshes/trex.obj");
+    benchmark.endLoad("meshes");
     // Generate one texture object with data from a TGA file
-    myTexture.createTexture("textures/trex.tga");
-    sphereTexture.createTexture("textures/earth.tga");
+    // (a benchmark loads all of it first, so every run draws the same)
+    benchmark.beginLoad();
+    myTexture = assets.acquireTexture("textures/trex.tga", benchmark.enabled ? 0 : ASSET_PROGRESSIVE); // Only the mip levels it needs on screen
+    GLfloat shapeRadius = myShape->radius(); // For the size of the shape on screen
+    // All planets share one array texture, so they can be drawn in one call
+    planetTextures.createTextureArray(planetFiles, numPlanets, TEXTURE_MIPMAP_KAISER | TEXTURE_MIPMAP_GAMMA | TEXTURE_COMPRESS);
+    if(benchmark.enabled) {
+        textureStreamer.setBudget(0);
+        while(textureStreamer.pending() > 0) {
+            textureStreamer.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if(!offscreen.create(benchmark.width, benchmark.height)) {
+            if(window) glfwTerminate();
+            else Headless::destroyContext();
+            return -1;
+        }
+    }
+    benchmark.endLoad("textures");
+    for(int s = 0; s < 2; s++) {
+        SceneFrame *scene = &scenes[s];
+        memset(scene, 0, sizeof(*scene));
+        scene->jobs = &jobs;
+        scene->queue = (s == 0) ? &renderQueue : &nextRenderQueue;
+        scene->shapeShader = myShader;
+        scene->planetShader = planetShader;
+        scene->texture = myTexture;
+        scene->planetTexture = planetTextures.textureID;
+        scene->shape = myShape;
+        scene->sphere = &mySphere;
+        scene->shapeRadius = shapeRadius;
+        scene->numPlanets = numPlanets;
+        scene->streamer = &textureStreamer;
+        scene->profiler = &profiler;
+        scene->zone = zoneScene;
+        for(int i = 0; i < numPlanets; i++) {
+            scene->planetBlock.instances[i].layer = (GLfloat)i;
+        }
+    }
+    cout << "Job system: " << jobs.numWorkers() << " worker threads" << endl;
+
+    GLState::enable(GL_DEPTH_TEST);
 
-    glEnable(GL_DEPTH_TEST);
+    benchmark.beginFrames();
 
     // Main loop
-    while(!glfwWindowShouldClose(window))
+    while(!quit)
     {
-        // Get window size. It may start out different from the requested
-        // size, and will change if the user resizes the window.
-        glfwGetWindowSize( window, &width, &height );
-        // Set viewport. This is the pixel rectangle we want to draw into.
-        glViewport( 0, 0, width, height ); // The entire window
+        framePacer.beginFrame(); // Wait here if the GPU is too far behind
+        profiler.beginFrame();
+        if(FrameStats::exportRequested()) {
+            frameStats.exportCSV("framestats.csv");
+            frameStats.exportJSON("framestats.json");
+        }
+
+        if(benchmark.enabled) {
+            offscreen.bind(); // Also sets the viewport
+            width = offscreen.width;
+            height = offscreen.height;
+        }
+        else {
+            // Get window size. It may start out different from the requested
+            // size, and will change if the user resizes the window.
+            glfwGetWindowSize( window, &width, &height );
+            // Set viewport. This is the pixel rectangle we want to draw into.
+            GLState::viewport( 0, 0, width, height ); // The entire window
+        }
 
 		// Set the clear color and depth, and clear the buffers for drawing
         glClearColor(0.3f, 0.3f, 0.3f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        Utilities::displayFPS(window);
+        {
+            GpuZone gpuzone(&profiler, zoneClear);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
-        /* ---- Rendering code should go here ---- */
-        time = (float)glfwGetTime(); //Number of seconds since the program was started
+        if(window) Utilities::displayFPS(window);
 
-        glUseProgram(myShader.programID);//Activate the shader to set its variables
+        {
+            GpuZone gpuzone(&profiler, zoneUpdate);
+            CpuZone cpuzone(&profiler, zoneUpdate);
+            textureStreamer.update(); // Upload a little more of any textures that are loading
+            assets.update(); // Load and delete the assets asked for and given back on other threads
 
-        glBindTexture(GL_TEXTURE_2D, myTexture.textureID);
+            // Swap in edited shaders when they are compiled. Their uniforms keep their IDs.
+            materials.update();
+            planetMaterials.update();
+        }
 
-        glUniform1f(location_time, time); //Copy the value to the shade program
-        glUniform1i(location_tex, 0);
+        /* ---- Rendering code should go here ---- */
+        // The draw calls of this frame were made on the job system while the
+        // last one was drawn. The first frame has none before it, so it waits.
+        SceneFrame *scene = &scenes[frames % 2];
+        if(!sceneJob) sceneJob = startScene(scene, frames, &benchmark, window, &myKeyRotator, &myMouseRotator, height);
+        jobs.wait(sceneJob);
+        // Make the next frame's while this one is drawn
+        sceneJob = startScene(&scenes[(frames + 1) % 2], frames + 1, &benchmark, window,
+            &myKeyRotator, &myMouseRotator, height);
+
+        // The camera and time, for all programs
+        uniformBuffer.beginFrame();
+        uniformBuffer.bind(UNIFORMBLOCK_FRAME, &scene->frameBlock, sizeof(scene->frameBlock));
+
+        GLState::enable(GL_CULL_FACE);
+        GLState::polygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        {
+            GpuZone gpuzone(&profiler, zoneDraw);
+            CpuZone cpuzone(&profiler, zoneDraw);
+            scene->queue->execute(&uniformBuffer); // Draw, sorted by program, texture, mesh and depth
+        }
+        bindsSubmitted += scene->queue->bindsSubmitted;
+        bindsIssued += scene->queue->bindsIssued;
+        frames++;
+        if(benchmark.enabled && benchmark.endFrame(scene->queue->numItems, scene->queue->triangles)) {
+            quit = GL_TRUE;
+        }
 
-        myKeyRotator.poll(window);
-        myMouseRotator.poll(window);
+        uniformBuffer.endFrame();
+        profiler.endFrame();
 
-        //mat4identity(M); // initializing M to identity matrix
-        mat4identity(R);
-        mat4identity(P);
-        mat4identity(MV);
+		// Swap buffers, i.e. display the image and prepare for next frame.
+        // Nothing is shown in a benchmark, but the commands still have to go.
+        if(benchmark.enabled) glFlush();
+        else glfwSwapBuffers(window);
+        framePacer.endFrame();
 
+        // A headless benchmark has no window and no input
+        if(!window) continue;
 
-        mat4rotx(Rx, myMouseRotator.theta);
-        mat4roty(Ry, myMouseRotator.phi);
-        mat4mult(Rx,Ry,R);
+		// Poll events (read keyboard and mouse input)
+		glfwPollEvents();
 
+        // Exit if the ESC key is pressed (and also if the window is closed).
+        if(glfwGetKey(window, GLFW_KEY_ESCAPE) || glfwWindowShouldClose(window)) {
+          quit = GL_TRUE;
+        }
 
-        mat4rotx(Rx, -myKeyRotator.theta);
-        mat4roty(Ry, myKeyRotator.phi);
+        // Trade latency for throughput with the keys 1 to 3
+        for(int key = GLFW_KEY_1; key <= GLFW_KEY_3; key++) {
+            if(glfwGetKey(window, key) && framePacer.maxFrames() != key - GLFW_KEY_0) {
+                framePacer.setMaxFrames(key - GLFW_KEY_0);
+                cout << "Frames in flight: " << framePacer.maxFrames() << endl;
+            }
+        }
 
-        mat4scale(S, 0.5); //setting scaler
-        mat4rotx(V, M_PI/10); // view point angle
-        mat4translate(T, 0.0, 0.0, -3.0);
-        mat4roty(R1, time*M_PI/8); //Orbit rotation
-        mat4roty(R2, time*M_PI/2);
-        mat4perspective(P, M_PI/4, 1, 0.1, 100.0);
+        // Print the frame profile when P is pressed
+        if(glfwGetKey(window, GLFW_KEY_P) && !dumpKey) {
+            profiler.dump(stdout);
+        }
+        dumpKey = glfwGetKey(window, GLFW_KEY_P);
 
-        mat4mult(T, Rx, MV);//Rotation around y-axis
-        mat4mult(MV, Ry, MV);
-        mat4mult(MV, V, MV);
+    }
 
+    if(sceneJob) jobs.wait(sceneJob); // It uses the texture streamer and the queues
+    framePacer.finish(); // Time the last frames too
+    if(benchmark.enabled) {
+        benchmark.writeReport(&frameStats, (const char*)glGetString(GL_RENDERER), offscreen.checksum());
+    }
 
-        glEnable(GL_CULL_FACE);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    cout << "Uniform uploads: " << Shader::uploadsIssued << " made, "
+         << Shader::uploadsElided << " skipped as unchanged" << endl;
+    if(frames > 0) {
+        cout << "State binds per frame: " << (double)bindsSubmitted / frames << " in submitted order, "
+             << (double)bindsIssued / frames << " sorted" << endl;
+    }
+    cout << "GL state calls: " << GLState::callsIssued << " made, "
+         << GLState::callsElided << " skipped as redundant" << endl;
+    cout << "Uniform stream: " << (uniformBuffer.stream.persistent ? "persistently mapped, " : "orphaned each frame, ")
+         << uniformBuffer.stream.stalls << " stalls waiting for the GPU" << endl;
+    if(framePacer.framesTimed > 0) {
+        double n = (double)framePacer.framesTimed;
+        cout << "Frame timeline (average ms from frame start): CPU submit " << framePacer.total.submit / n
+             << ", GPU start " << framePacer.total.gpuStart / n << ", GPU end " << framePacer.total.gpuEnd / n
+             << ", done " << framePacer.total.signaled / n << endl;
+        cout << "Frame pacing: " << framePacer.maxFrames() << " frames in flight, waited for the GPU in "
+             << framePacer.waits << " of " << frames << " frames, "
+             << framePacer.total.wait / n << " ms per frame" << endl;
+    }
 
-        //glUniformMatrix4fv(location_M, 1, GL_FALSE, M); //Copy the value
-        glUniformMatrix4fv(location_R, 1, GL_FALSE, R); //Copy the value
-        glUniformMatrix4fv(location_MV, 1, GL_FALSE, MV); //Copy the value
-        glUniformMatrix4fv(location_P, 1, GL_FALSE, P); //Copy the value
+    profiler.dump(stdout);
+    frameStats.report(stdout, 0);
+    frameStats.exportCSV("framestats.csv");
+    frameStats.exportJSON("framestats.json");
 
+    // Give back the shared assets while the context is still there
+    assets.release(myTexture);
+    assets.release(myShape);
 
-        myShape.render();
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // Close the OpenGL window and terminate GLFW, or drop the headless context.
+    if(window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    else Headless::destroyContext();
 
-        glBindTexture(GL_TEXTURE_2D, sphereTexture.textureID);
-        glUniform1i(location_tex, 0);
+    return 0;
+}
 
-        mat4identity(MV);
-        mat4identity(T2);
 
-        mat4scale(S, 0.2); //setting scaler
-        mat4rotx(V, M_PI/10); // view point angle
-        mat4translate(T, 0.0, 0.0, -3.0);
-        mat4roty(R1, time*M_PI/3); //Orbit rotation
-        mat4translate(T2, 1.0, 0.0, 0.0);
+//FUNCTIONS//
 
-        mat4mult(T, V, MV);//Rotation around y-axis
-        mat4mult(MV,R1,MV);
-        //mat4mult(MV, R1, MV);
-        mat4mult(MV, T2, MV);
-        mat4mult(MV,R2,MV);
-        mat4mult(MV, S, MV);
+/*
+ * startScene() - Set the time and the camera of a frame, and start making
+ * its draw calls on the job system. The input is read here, since GLFW
+ * can only be used on the main thread, and so is the texture name.
+ */
+Job *startScene(SceneFrame *scene, unsigned long frame, Benchmark *benchmark, GLFWwindow *window,
+    KeyRotator *keys, MouseRotator *mouse, int height) {
 
-        //glUniformMatrix4fv(location_R, 1, GL_FALSE, R); //Copy the value
-        glUniformMatrix4fv(location_MV, 1, GL_FALSE, MV); //Copy the value
-        //glUniformMatrix4fv(location_P, 1, GL_FALSE, P); //Copy the value
+    scene->time = (float)Utilities::getTime(); //Number of seconds since the program was started
+    if(benchmark->enabled) {
+        scene->time = (float)benchmark->time(frame); // The same every run
+        benchmark->camera(scene->time, &mouse->phi, &mouse->theta);
+    }
+    else {
+        keys->poll(window);
+        mouse->poll(window);
+    }
+    scene->keyPhi = keys->phi;
+    scene->keyTheta = keys->theta;
+    scene->mousePhi = mouse->phi;
+    scene->mouseTheta = mouse->theta;
+    scene->height = height;
+    scene->shapeTexture = scene->texture->textureID;
+
+    Job *job = scene->jobs->create(prepareScene, scene);
+    scene->jobs->run(job);
+    return job;
+}
 
-        mySphere.render();
+/*
+ * prepareScene() - A job to make the uniform blocks and draw calls of a
+ * frame. The objects are done by child jobs, on any threads, and are
+ * queued here when they are done, since a RenderQueue is for one thread
+ * at a time. The queue is sorted here too, so the OpenGL thread only
+ * has to make the calls. No OpenGL calls are made by these jobs.
+ */
+void prepareScene(Job *job, void *data) {
+
+    SceneFrame *scene = (SceneFrame*)data;
+    CpuZone cpuzone(scene->profiler, scene->zone);
+    GLfloat Rx[16]; // rotation depending on mouse rotation
+    GLfloat Ry[16];
+
+    mat4rotx(Rx, scene->mouseTheta);
+    mat4roty(Ry, scene->mousePhi);
+    mat4mult(Rx, Ry, scene->frameBlock.R);
+    mat4perspective(scene->frameBlock.P, M_PI/4, 1, 0.1, 100.0);
+    scene->frameBlock.time = scene->time;
+
+    Job *shape = scene->jobs->createChild(job, prepareShape, scene);
+    Job *planets = scene->jobs->createChild(job, preparePlanets, scene);
+    scene->jobs->run(shape);
+    scene->jobs->run(planets);
+    scene->jobs->wait(shape);
+    scene->jobs->wait(planets);
+
+    // Queue the draw calls, with the depth of the center in view space
+    scene->queue->submit(scene->shapeShader, GL_TEXTURE_2D, scene->shapeTexture, scene->shape, 1,
+        &scene->objectBlock, sizeof(scene->objectBlock), -scene->objectBlock.MV[14]);
+    scene->queue->submit(scene->planetShader, GL_TEXTURE_2D_ARRAY, scene->planetTexture, scene->sphere,
+        scene->numPlanets, &scene->planetBlock, sizeof(scene->planetBlock),
+        -scene->planetBlock.instances[0].MV[14]); // All matrices, at the earth
+    scene->queue->sort();
+}
 
+/*
+ * prepareShape() - A job to place the shape, turned by the keys.
+ */
+void prepareShape(Job *, void *data) {
 
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glUseProgram(0);
+    SceneFrame *scene = (SceneFrame*)data;
+    GLfloat *P = scene->frameBlock.P;
+    GLfloat *MV = scene->objectBlock.MV;
+    GLfloat Rx[16]; // rotation depending on key rotation
+    GLfloat Ry[16];
+    GLfloat V[16]; // rotation of viewpoint
+    GLfloat T[16]; // translation matrix
 
-		// Swap buffers, i.e. display the image and prepare for next frame.
-        glfwSwapBuffers(window);
+    mat4rotx(Rx, -scene->keyTheta);
+    mat4roty(Ry, scene->keyPhi);
+    mat4rotx(V, M_PI/10); // view point angle
+    mat4translate(T, 0.0, 0.0, -3.0);
+
+    mat4mult(T, Rx, MV);//Rotation around y-axis
+    mat4mult(MV, Ry, MV);
+    mat4mult(MV, V, MV);
+    mat4mult(P, MV, scene->objectBlock.PMV);
+    scene->streamer->reportScreenSize(scene->texture,
+        TextureStreamer::screenSize(P, MV, scene->shapeRadius, scene->height));
+}
 
-		// Poll events (read keyboard and mouse input)
-		glfwPollEvents();
+/*
+ * preparePlanets() - A job to place the earth, the moon and the sun.
+ */
+void preparePlanets(Job *, void *data) {
 
-        // Exit if the ESC key is pressed (and also if the window is closed).
-        if(glfwGetKey(window, GLFW_KEY_ESCAPE)) {
-          glfwSetWindowShouldClose(window, GL_TRUE);
-        }
+    SceneFrame *scene = (SceneFrame*)data;
+    InstanceBlock *planets = scene->planetBlock.instances;
+    float time = scene->time;
+    GLfloat T[16]; // translation matrix
+    GLfloat T2[16];
+    GLfloat R1[16]; // rotation matrix Orbit
+    GLfloat R2[16]; // rotation matrix around y axis own axis
+    GLfloat S[16]; // scaling matrix
+    GLfloat V[16]; // rotation of viewpoint
+    GLfloat MV[16];
 
+    // Earth
+    mat4roty(R2, time*M_PI/2);
+    mat4scale(S, 0.2); //setting scaler
+    mat4rotx(V, M_PI/10); // view point angle
+    mat4translate(T, 0.0, 0.0, -3.0);
+    mat4roty(R1, time*M_PI/3); //Orbit rotation
+    mat4translate(T2, 1.0, 0.0, 0.0);
+
+    mat4mult(T, V, MV);//Rotation around y-axis
+    mat4mult(MV,R1,MV);
+    mat4mult(MV, T2, MV);
+    mat4mult(MV, R2, planets[0].MV); // MV keeps the earth position, for the moon below
+    mat4mult(planets[0].MV, S, planets[0].MV);
+
+    // Moon, orbiting the earth
+    mat4roty(R2, time*M_PI);
+    mat4translate(T2, 0.35, 0.0, 0.0);
+    mat4scale(S, 0.06);
+    mat4mult(MV, R2, planets[1].MV);
+    mat4mult(planets[1].MV, T2, planets[1].MV);
+    mat4mult(planets[1].MV, S, planets[1].MV);
+
+    // Sun, far behind the scene
+    mat4translate(T2, -1.5, 1.0, -4.0);
+    mat4roty(R2, time*M_PI/20);
+    mat4scale(S, 0.6);
+    mat4mult(T, V, planets[2].MV);
+    mat4mult(planets[2].MV, T2, planets[2].MV);
+    mat4mult(planets[2].MV, R2, planets[2].MV);
+    mat4mult(planets[2].MV, S, planets[2].MV);
+
+    for(int i = 0; i < scene->numPlanets; i++) {
+        mat4mult(scene->frameBlock.P, planets[i].MV, planets[i].PMV);
     }
-
-    // Close the OpenGL window and terminate GLFW.
-    glfwDestroyWindow(window);
-    glfwTerminate();
-
-    return 0;
 }
-
-
-//FUNCTIONS//
 void createVertexBuffer(int location, int dimensions, const float *data, int datasize)
 {
 
@@ -309,7 +635,7 @@ void createVertexBuffer(int location, int dimensions, const float *data, int dat
 
 	// Generate buffer, activate it and copy the data
 	glGenBuffers(1, &bufferID);
-	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, bufferID);
 	glBufferData(GL_ARRAY_BUFFER, datasize, data, GL_STATIC_DRAW);
 	// Tell OpenGL how the data is stored in our buffer
 	// Attribute location (must match layout(location=#) statement in shader)
@@ -327,7 +653,7 @@ void createIndexBuffer(const unsigned int *data, int datasize) {
 	// Generate buffer, activate it and copy the data
 	glGenBuffers(1, &bufferID);
     // Activate (bind) the index buffer and copy data to it.
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferID);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferID);
     // Present our vertex indices to OpenGL
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, datasize, data, GL_STATIC_DRAW);
 }
@@ -0,0 +1,117 @@
+#include "Utilities.hpp" // For GL_TRUE, GL_FALSE and printError()
+#include "Headless.hpp"
+
+#include <chrono>
+#include <cstring> // For strstr()
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+static int active = GL_FALSE;
+static std::chrono::steady_clock::time_point startTime;
+
+
+/*
+ * createContext(int major, int minor)
+ * Open an EGL display, on the surfaceless platform if there is one, and
+ * make a core profile context that is current without any surface.
+ */
+int Headless::createContext(int major, int minor) {
+
+#ifdef __linux__
+    const char *clientextensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay && clientextensions && strstr(clientextensions, "EGL_MESA_platform_surfaceless")) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    else {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        Utilities::printError("Headless error", "Unable to open an EGL display");
+        return GL_FALSE;
+    }
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        Utilities::printError("Headless error", "EGL can't make a context current without a surface");
+        eglTerminate(display);
+        return GL_FALSE;
+    }
+
+    // Any config that can do OpenGL, or none at all if that is allowed,
+    // since nothing is drawn to a surface anyway
+    const EGLint configattribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = NULL;
+    EGLint numconfigs = 0;
+    eglChooseConfig(display, configattribs, &config, 1, &numconfigs);
+    if(numconfigs == 0) {
+        if(!strstr(extensions, "EGL_KHR_no_config_context")) {
+            Utilities::printError("Headless error", "EGL has no config for OpenGL");
+            eglTerminate(display);
+            return GL_FALSE;
+        }
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint contextattribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, major,
+        EGL_CONTEXT_MINOR_VERSION_KHR, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE};
+    eglBindAPI(EGL_OPENGL_API);
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextattribs);
+    if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "Headless error: Unable to make an OpenGL %d.%d core context (EGL error 0x%x)\n",
+            major, minor, eglGetError());
+        if(context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+        eglTerminate(display);
+        context = EGL_NO_CONTEXT;
+        return GL_FALSE;
+    }
+
+    startTime = std::chrono::steady_clock::now();
+    active = GL_TRUE;
+    return GL_TRUE;
+#else
+    Utilities::printError("Headless error", "Headless contexts need EGL, which is only used on Linux");
+    return GL_FALSE;
+#endif
+}
+
+
+void Headless::destroyContext() {
+#ifdef __linux__
+    if(!active) return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    context = EGL_NO_CONTEXT;
+    display = EGL_NO_DISPLAY;
+#endif
+    active = GL_FALSE;
+}
+
+
+int Headless::isActive() {
+    return active;
+}
+
+
+double Headless::getTime() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+
+void *Headless::getProcAddress(const char *name) {
+#ifdef __linux__
+    return (void*)eglGetProcAddress(name);
+#else
+    return NULL;
+#endif
+}
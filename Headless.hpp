@@ -0,0 +1,43 @@
+/* Headless.hpp */
+/* An OpenGL context without a window or a display, for running on
+ * machines with no screen and no GPU, like build and test servers. */
+/* Usage: call Headless::createContext() instead of glfwInit(),
+ * glfwCreateWindow() and glfwMakeContextCurrent(), and then
+ * Utilities::loadExtensions() as usual. Everything else, like Shader,
+ * Texture and TriangleSoup, works the same. There is no default
+ * framebuffer to draw to, so draw to a Framebuffer instead (see
+ * Framebuffer.hpp). Call destroyContext() when done.
+ * GLFW isn't initialized, so use Utilities::getTime() and
+ * Utilities::getProcAddress() rather than glfwGetTime() and
+ * glfwGetProcAddress(). They work with both kinds of context.
+ * The context is made with EGL, on the "surfaceless" platform of Mesa
+ * (EGL_MESA_platform_surfaceless) if there is one, which needs neither
+ * X11 nor a GPU, and runs with the llvmpipe software renderer. Without
+ * it, the default EGL display is tried. This is only for Linux, where
+ * the program then has to be linked with -lEGL. Elsewhere,
+ * createContext() fails. */
+
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+namespace Headless {
+
+// Make an OpenGL core profile context of at least a version, and make it current.
+// Returns GL_FALSE if that can't be done.
+int createContext(int major = 3, int minor = 3);
+
+// Release the context
+void destroyContext();
+
+// GL_TRUE between createContext() and destroyContext()
+int isActive();
+
+// Seconds since the context was made
+double getTime();
+
+// Look up an OpenGL function
+void *getProcAddress(const char *name);
+
+}
+
+#endif // HEADLESS_HPP
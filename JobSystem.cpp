@@ -0,0 +1,300 @@
+#include "JobSystem.hpp"
+#include "Utilities.hpp" // For GL_TRUE and GL_FALSE
+
+#include <chrono>
+
+/* A thread, its ring of jobs and its queue. The owner pushes and pops at
+ * the bottom of the queue, and other threads steal from the top. */
+struct JobSystem::Worker {
+    std::thread thread;                         // Not started for workers[0]
+    std::vector<Job*> blocks;                   // The ring that create() takes jobs from, in blocks of JOBSYSTEM_MAXJOBS
+    size_t nextJob;
+    std::atomic<Job*> queue[JOBSYSTEM_MAXJOBS];
+    std::atomic<long> top;                      // Next job to steal
+    std::atomic<long> bottom;                   // Next free place to push to
+    unsigned int random;                        // For picking whom to steal from
+
+    // Owner only: add a block of free jobs to the ring
+    void addBlock() {
+        Job *block = new Job[JOBSYSTEM_MAXJOBS];
+        for(int j = 0; j < JOBSYSTEM_MAXJOBS; j++) {
+            block[j].unfinished = 0;
+        }
+        this->blocks.push_back(block);
+    }
+
+    // Owner only: GL_FALSE if the queue has no room for another job.
+    // Thieves only make room, so a stale top is on the safe side.
+    int hasRoom() {
+        long b = this->bottom.load(std::memory_order_relaxed);
+        return b - this->top.load(std::memory_order_acquire) < JOBSYSTEM_MAXJOBS;
+    }
+
+    // Owner only: add a job at the bottom
+    void push(Job *job) {
+        long b = this->bottom.load(std::memory_order_relaxed);
+        this->queue[b & (JOBSYSTEM_MAXJOBS - 1)].store(job, std::memory_order_relaxed);
+        this->bottom.store(b + 1, std::memory_order_release); // The job before the new bottom
+    }
+
+    // Owner only: take the newest job, or NULL. The last one may be stolen at the same time.
+    Job *pop() {
+        long b = this->bottom.load(std::memory_order_relaxed) - 1;
+        this->bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // The new bottom before reading top
+        long t = this->top.load(std::memory_order_relaxed);
+        if(t > b) { // Empty
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        Job *job = this->queue[b & (JOBSYSTEM_MAXJOBS - 1)].load(std::memory_order_relaxed);
+        if(t == b) { // The last one, so race the thieves for it
+            if(!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = NULL;
+            }
+            this->bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // Any thread: take the oldest job, or NULL if there is none or another thread got it
+    Job *steal() {
+        long t = this->top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = this->bottom.load(std::memory_order_acquire);
+        if(t >= b) return NULL;
+        Job *job = this->queue[t & (JOBSYSTEM_MAXJOBS - 1)].load(std::memory_order_relaxed);
+        if(!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return NULL;
+        }
+        return job;
+    }
+};
+
+thread_local JobSystem::Worker *JobSystem::current = NULL;
+
+
+/* Constructor */
+JobSystem::JobSystem(int numworkers) {
+
+    if(numworkers < 0) {
+        numworkers = (int)std::thread::hardware_concurrency() - 1;
+        if(numworkers < 0) numworkers = 0;
+    }
+    this->sleeping = 0;
+    this->quit = GL_FALSE;
+    for(int i = 0; i <= numworkers; i++) {
+        Worker *worker = new Worker;
+        worker->nextJob = 0;
+        worker->top = 0;
+        worker->bottom = 0;
+        worker->random = 2463534242u + i; // Any nonzero seed
+        worker->addBlock();
+        this->workers.push_back(worker);
+    }
+    current = this->workers[0];
+    // Start the threads when all workers are there to steal from
+    for(size_t i = 1; i < this->workers.size(); i++) {
+        this->workers[i]->thread = std::thread(&JobSystem::work, this, this->workers[i]);
+    }
+}
+
+/* Destructor */
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->quit = GL_TRUE;
+    }
+    this->wakeup.notify_all();
+    for(size_t i = 1; i < this->workers.size(); i++) {
+        this->workers[i]->thread.join();
+    }
+    for(size_t i = 0; i < this->workers.size(); i++) {
+        for(size_t j = 0; j < this->workers[i]->blocks.size(); j++) {
+            delete[] this->workers[i]->blocks[j];
+        }
+        delete this->workers[i];
+    }
+    current = NULL;
+}
+
+
+/*
+ * create(JobFunction function, void *data)
+ * Take the next finished job in the ring of this thread. Jobs still
+ * unfinished are skipped, since they may be the very parent that is
+ * making this job. If the whole ring is in use, it grows by as many jobs
+ * as it has, so a job with any number of children can be made, and the
+ * cost of looking through the ring is spread over the new jobs.
+ */
+Job *JobSystem::create(JobFunction function, void *data) {
+
+    Worker *worker = current;
+    Job *job = NULL;
+    size_t size = worker->blocks.size() * JOBSYSTEM_MAXJOBS;
+    for(size_t tries = 0; tries < size; tries++) {
+        size_t i = worker->nextJob++ % size;
+        Job *next = &worker->blocks[i / JOBSYSTEM_MAXJOBS][i % JOBSYSTEM_MAXJOBS];
+        if(next->unfinished.load(std::memory_order_acquire) == 0) {
+            job = next;
+            break;
+        }
+    }
+    if(!job) {
+        size_t count = worker->blocks.size();
+        for(size_t i = 0; i < count; i++) {
+            worker->addBlock();
+        }
+        worker->nextJob = size + 1;
+        job = &worker->blocks[count][0];
+    }
+    job->function = function;
+    job->data = data;
+    job->parent = NULL;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    return job;
+}
+
+Job *JobSystem::createChild(Job *parent, JobFunction function, void *data) {
+
+    parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    Job *job = this->create(function, data);
+    job->parent = parent;
+    return job;
+}
+
+
+/*
+ * run(Job *job)
+ * Put a job in the queue of this thread, and wake a worker if any sleep.
+ * If the queue is full, the job is run right here instead.
+ */
+void JobSystem::run(Job *job) {
+
+    if(!current->hasRoom()) {
+        this->execute(job);
+        return;
+    }
+    current->push(job);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // The job before reading sleeping (see work())
+    if(this->sleeping.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->wakeup.notify_one();
+    }
+}
+
+
+/*
+ * wait(Job *job)
+ * Help out with other jobs until a job is finished. The job itself is
+ * likely to be among them, if no other thread has got to it yet.
+ */
+void JobSystem::wait(Job *job) {
+
+    while(!this->finished(job)) {
+        Job *next = this->getJob(current);
+        if(next) this->execute(next);
+        else std::this_thread::yield();
+    }
+}
+
+int JobSystem::finished(const Job *job) {
+    return job->unfinished.load(std::memory_order_acquire) == 0;
+}
+
+int JobSystem::numWorkers() {
+    return (int)this->workers.size() - 1;
+}
+
+
+/*
+ * private
+ * getJob(Worker *worker)
+ * The newest job of our own, or else the oldest of another thread's,
+ * starting from a random one so the thieves spread out. NULL if there
+ * is nothing to do.
+ */
+Job *JobSystem::getJob(Worker *worker) {
+
+    Job *job = worker->pop();
+    if(job) return job;
+
+    size_t count = this->workers.size();
+    worker->random ^= worker->random << 13; // xorshift32
+    worker->random ^= worker->random >> 17;
+    worker->random ^= worker->random << 5;
+    size_t first = worker->random % count;
+    for(size_t i = 0; i < count; i++) {
+        Worker *victim = this->workers[(first + i) % count];
+        if(victim == worker) continue;
+        job = victim->steal();
+        if(job) return job;
+    }
+    return NULL;
+}
+
+/*
+ * private
+ * execute(Job *job), finish(Job *job)
+ * A job counts itself as one unfinished part until its function is done.
+ * When the last part is done, its parent has one less child to wait for.
+ */
+void JobSystem::execute(Job *job) {
+    job->function(job, job->data);
+    this->finish(job);
+}
+
+void JobSystem::finish(Job *job) {
+    Job *parent = job->parent; // The job may be taken for a new one as soon as it is finished
+    if(job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent) {
+        this->finish(parent);
+    }
+}
+
+int JobSystem::hasWork() {
+    for(size_t i = 0; i < this->workers.size(); i++) {
+        Worker *worker = this->workers[i];
+        if(worker->top.load(std::memory_order_seq_cst) < worker->bottom.load(std::memory_order_seq_cst)) {
+            return GL_TRUE;
+        }
+    }
+    return GL_FALSE;
+}
+
+
+/*
+ * private
+ * work(Worker *worker)
+ * The loop of a worker thread. After JOBSYSTEM_SPINS tries without
+ * finding a job, the worker sleeps. It counts itself as sleeping before
+ * it looks in the queues one last time, and run() pushes its job before
+ * it looks at the count, so either the worker sees the job or run() sees
+ * the worker, and no job is left with everyone asleep. The timeout is in
+ * case a wakeup is missed anyway.
+ */
+void JobSystem::work(Worker *worker) {
+
+    current = worker;
+    int idle = 0;
+    while(!this->quit.load(std::memory_order_relaxed)) {
+        Job *job = this->getJob(worker);
+        if(job) {
+            this->execute(job);
+            idle = 0;
+            continue;
+        }
+        if(++idle < JOBSYSTEM_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        this->sleeping.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            if(!this->quit && !this->hasWork()) {
+                this->wakeup.wait_for(lock, std::chrono::milliseconds(10));
+            }
+        }
+        this->sleeping.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
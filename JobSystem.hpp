@@ -0,0 +1,111 @@
+/* JobSystem.hpp */
+/* A pool of worker threads that run small jobs, and that take work from
+ * each other when they run out. */
+/* Usage: make one JobSystem, on the thread that will hand it work. For
+ * each job, create() a Job with a function and a pointer to its data,
+ * run() it and later wait() for it. A job may make more jobs the same
+ * way, and createChild() makes one that its parent waits for: a job is
+ * only finished when its function has returned and all its children are
+ * finished, so waiting for the parent is enough.
+ *     Job *job = jobs.create(prepareFrame, &scene);
+ *     jobs.run(job);
+ *     ... // Something else, on this thread
+ *     jobs.wait(job);
+ * Each thread has its own double-ended queue of jobs. It runs the newest
+ * of its own jobs first, which are the most likely to be in its cache,
+ * and when it has none, it steals the oldest job from another thread,
+ * which is likely to be a large one that splits into more jobs. A thread
+ * that waits runs other jobs meanwhile, so waiting inside a job doesn't
+ * block a worker.
+ * Jobs are not allocated one by one. Each thread takes them in turn
+ * from a ring of JOBSYSTEM_MAXJOBS, skipping those not finished, and the
+ * ring grows if they all are. A Job pointer stays valid until the job is
+ * finished, and after that until the ring comes around to it again. The
+ * data is not copied, and has to stay there until the job is finished.
+ * A thread queues at most JOBSYSTEM_MAXJOBS jobs, and run() runs the
+ * job at once when its queue is full.
+ * create(), createChild(), run() and wait() may only be called from the
+ * thread that made the JobSystem, and from jobs. Workers with nothing to
+ * do spin for a while, and then sleep until run() wakes them. */
+
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs in each block of the ring of a thread, and the size of its queue (a power of 2)
+#define JOBSYSTEM_MAXJOBS 4096
+
+// Times an idle worker looks for work before it goes to sleep
+#define JOBSYSTEM_SPINS 64
+
+struct Job;
+
+// A job function, which gets the Job it runs for and the data it was made with
+typedef void (*JobFunction)(Job *job, void *data);
+
+/* A unit of work. The padding makes it one cache line on most CPUs, so
+ * jobs next to each other in a ring don't slow each other down. */
+struct Job {
+    JobFunction function;
+    void *data;
+    Job *parent;                    // The job that waits for this one, or NULL
+    std::atomic<int> unfinished;    // 1 until the function returns, plus 1 for each unfinished child
+    char padding[64 - 3 * sizeof(void*) - sizeof(std::atomic<int>)];
+};
+
+class JobSystem {
+
+public:
+
+/* Constructor. With numworkers < 0, there is one worker for each core
+ * but the one of the calling thread. With 0, jobs run when waited for. */
+JobSystem(int numworkers = -1);
+
+/* Destructor. Stops the workers, so wait() for all jobs first. */
+~JobSystem();
+
+// Make a job, to start with run()
+Job *create(JobFunction function, void *data);
+
+// Make a job that parent is not finished without
+Job *createChild(Job *parent, JobFunction function, void *data);
+
+// Start a job on this thread, or any other that steals it
+void run(Job *job);
+
+// Run other jobs until a job and its children are finished
+void wait(Job *job);
+
+// GL_TRUE if a job and its children are finished
+int finished(const Job *job);
+
+// Number of worker threads, not counting the one that made the JobSystem
+int numWorkers();
+
+private:
+
+struct Worker;
+
+// Internal "private" functions
+Job *getJob(Worker *worker);                // Pop a job of our own, or steal one
+void execute(Job *job);                     // Run a job and finish it
+void finish(Job *job);                      // Count down, and tell the parent when done
+int hasWork();                              // GL_TRUE if any queue has jobs
+void work(Worker *worker);                  // The loop of a worker thread
+
+std::vector<Worker*> workers;               // workers[0] is the thread that made us
+std::atomic<int> sleeping;                  // Number of workers waiting for wakeup
+std::atomic<int> quit;                      // Set by the destructor
+std::mutex mutex;                           // For wakeup
+std::condition_variable wakeup;
+
+static thread_local Worker *current;        // The worker of the calling thread
+
+};
+
+#endif // JOBSYSTEM_HPP
@@ -0,0 +1,288 @@
+/*
+ * KTX (version 1) file reading and writing.
+ * A KTX file is a 64-byte header, a block of key/value pairs, and then
+ * for each mip level a 32-bit image size followed by the image data.
+ * All sections are padded to multiples of 4 bytes. read() walks the
+ * mapped file once and points the chain to the levels in place, so
+ * the data can go straight from the mapping to OpenGL.
+ * This code is in the public domain.
+ */
+
+#include "Ktx.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+static const unsigned char ktxIdentifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+#define KTX_ENDIANNESS 0x04030201 // Reads as 0x01020304 in the other byte order
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+static inline size_t pad4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static inline size_t padTo(size_t n, unsigned int alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+/* Number of components for an uncompressed format, 0 if unknown */
+static unsigned int components(GLenum format) {
+    switch(format) {
+        case GL_RED: return 1;
+        case GL_RG: return 2;
+        case GL_RGB: case GL_BGR: return 3;
+        case GL_RGBA: case GL_BGRA: return 4;
+        default: return 0;
+    }
+}
+
+/* Channels and block size for the S3TC formats, GL_FALSE for other formats */
+static int s3tcFormat(GLenum internalformat, unsigned int *channels, unsigned int *blockbytes) {
+    switch(internalformat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: *channels = 3; *blockbytes = 8; return GL_TRUE;
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: *channels = 4; *blockbytes = 8; return GL_TRUE;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: *channels = 4; *blockbytes = 16; return GL_TRUE;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: *channels = 4; *blockbytes = 16; return GL_TRUE;
+        default: return GL_FALSE;
+    }
+}
+
+/* Copy the value of key from the key/value data, or "" if it isn't there */
+static void findValue(const unsigned char *keyvalues, size_t size,
+                      const char *key, char *value, size_t maxlength) {
+    size_t pos = 0;
+    size_t keylength = strlen(key);
+
+    value[0] = '\0';
+    while(pos + 4 <= size) {
+        uint32_t length;
+        memcpy(&length, keyvalues + pos, 4);
+        pos += 4;
+        if(length > size - pos) return; // Corrupt
+        const char *pair = (const char*)keyvalues + pos;
+        if(length > keylength && memcmp(pair, key, keylength + 1) == 0) {
+            size_t n = length - keylength - 1;
+            if(n > maxlength - 1) n = maxlength - 1;
+            memcpy(value, pair + keylength + 1, n);
+            value[n] = '\0'; // The value is usually \0 terminated already
+            return;
+        }
+        pos += pad4(length);
+    }
+}
+
+void Ktx::formatFor(const Mipmap::MipChain *chain, Format *format) {
+    memset(format, 0, sizeof(Format));
+    if(chain->blockbytes > 0) {
+        format->typesize = 1;
+        format->internalformat = chain->channels == 4 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                                                      : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+    else {
+        format->type = GL_UNSIGNED_BYTE;
+        format->typesize = 1;
+        format->format = chain->channels == 4 ? GL_BGRA : GL_BGR;
+        format->internalformat = chain->channels == 4 ? GL_RGBA8 : GL_RGB8;
+    }
+    format->baseinternalformat = chain->channels == 4 ? GL_RGBA : GL_RGB;
+    format->generatemipmaps = GL_FALSE;
+}
+
+int Ktx::read(const char *filename, Mipmap::MipChain *chain, Format *format,
+              const char *key, char *value, size_t maxlength) {
+
+    KtxHeader header;
+
+    memset(chain, 0, sizeof(Mipmap::MipChain));
+    if(key) value[0] = '\0';
+    if(!Utilities::mapFile(filename, &chain->file)) return GL_FALSE;
+
+    const unsigned char *data = chain->file.data;
+    size_t filesize = chain->file.size;
+    if(filesize < sizeof(KtxHeader)) {
+        Mipmap::release(chain);
+        return GL_FALSE;
+    }
+    memcpy(&header, data, sizeof(KtxHeader));
+    if(memcmp(header.identifier, ktxIdentifier, sizeof(ktxIdentifier)) != 0) {
+        fprintf(stderr, "%s is not a KTX file.\n", filename);
+        Mipmap::release(chain);
+        return GL_FALSE;
+    }
+    if(header.endianness != KTX_ENDIANNESS) {
+        fprintf(stderr, "%s is in the wrong byte order.\n", filename);
+        Mipmap::release(chain);
+        return GL_FALSE;
+    }
+    if(header.pixelWidth == 0 || header.pixelDepth != 0
+        || header.numberOfArrayElements != 0 || header.numberOfFaces != 1
+        || header.numberOfMipmapLevels > MIPMAP_MAXLEVELS
+        || header.bytesOfKeyValueData > filesize - sizeof(KtxHeader)) {
+        fprintf(stderr, "%s is not a 2D KTX texture.\n", filename);
+        Mipmap::release(chain);
+        return GL_FALSE;
+    }
+
+    format->type = header.glType;
+    format->typesize = header.glTypeSize;
+    format->format = header.glFormat;
+    format->internalformat = header.glInternalFormat;
+    format->baseinternalformat = header.glBaseInternalFormat;
+    format->generatemipmaps = header.numberOfMipmapLevels == 0;
+
+    unsigned int numlevels = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+    unsigned int width = header.pixelWidth;
+    unsigned int height = header.pixelHeight > 0 ? header.pixelHeight : 1; // 1D textures have height 0
+    unsigned int bytesperpixel = 0;
+    if(header.glType != 0) { // Uncompressed
+        chain->channels = components(header.glFormat);
+        bytesperpixel = chain->channels * header.glTypeSize;
+        if(bytesperpixel == 0) {
+            fprintf(stderr, "%s has an unsupported pixel format.\n", filename);
+            Mipmap::release(chain);
+            return GL_FALSE;
+        }
+    }
+    else if(!s3tcFormat(header.glInternalFormat, &chain->channels, &chain->blockbytes)) {
+        // Some other compressed format. Assume 4x4 blocks, and get the
+        // block size from the size of level 0 further down.
+        chain->channels = header.glBaseInternalFormat == GL_RGBA ? 4 : 3;
+    }
+    if(key) findValue(data + sizeof(KtxHeader), header.bytesOfKeyValueData, key, value, maxlength);
+
+    // Walk the levels, checking that each one is all there
+    size_t pos = sizeof(KtxHeader) + header.bytesOfKeyValueData;
+    for(unsigned int level = 0; level < numlevels; level++) {
+        uint32_t imagesize;
+        if(pos + 4 > filesize) break;
+        memcpy(&imagesize, data + pos, 4);
+        pos += 4;
+        if(imagesize > filesize - pos) break;
+
+        size_t expected;
+        size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+        if(bytesperpixel > 0) {
+            expected = padTo((size_t)width * bytesperpixel, 4) * height;
+        }
+        else {
+            if(chain->blockbytes == 0 && blocks > 0) chain->blockbytes = imagesize / blocks;
+            expected = blocks * chain->blockbytes;
+        }
+        if(imagesize < expected || expected == 0) break;
+
+        chain->width[level] = width;
+        chain->height[level] = height;
+        chain->offset[level] = pos;
+        chain->levelsize[level] = imagesize;
+        chain->numlevels = level + 1;
+        pos += pad4(imagesize); // mipPadding
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    if(chain->numlevels != numlevels) {
+        fprintf(stderr, "%s is truncated or corrupt.\n", filename);
+        Mipmap::release(chain);
+        return GL_FALSE;
+    }
+
+    chain->rowalignment = 4;
+    chain->data = data; // Level offsets are from the start of the file
+    chain->size = filesize;
+    return GL_TRUE;
+}
+
+int Ktx::write(const char *filename, const Mipmap::MipChain *chain, const Format *format,
+               const char *key, const char *value) {
+
+    static const unsigned char zeros[4] = {0, 0, 0, 0};
+    char tempfile[1040];
+    KtxHeader header;
+    FILE *file;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.identifier, ktxIdentifier, sizeof(ktxIdentifier));
+    header.endianness = KTX_ENDIANNESS;
+    header.glType = format->type;
+    header.glTypeSize = format->typesize;
+    header.glFormat = format->format;
+    header.glInternalFormat = format->internalformat;
+    header.glBaseInternalFormat = format->baseinternalformat;
+    header.pixelWidth = chain->width[0];
+    header.pixelHeight = chain->height[0];
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = format->generatemipmaps ? 0 : chain->numlevels;
+    uint32_t keyvaluesize = 0;
+    if(key) {
+        keyvaluesize = strlen(key) + 1 + strlen(value) + 1;
+        header.bytesOfKeyValueData = 4 + pad4(keyvaluesize);
+    }
+
+    // Write to a temporary file and rename it, so that a concurrent
+    // reader never sees a half-written file
+    snprintf(tempfile, sizeof(tempfile), "%s.tmp", filename);
+    file = fopen(tempfile, "wb");
+    if(file == NULL) return GL_FALSE;
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if(key && ok) {
+        ok = fwrite(&keyvaluesize, 4, 1, file) == 1
+          && fwrite(key, 1, strlen(key) + 1, file) == strlen(key) + 1
+          && fwrite(value, 1, strlen(value) + 1, file) == strlen(value) + 1
+          && fwrite(zeros, 1, pad4(keyvaluesize) - keyvaluesize, file) == pad4(keyvaluesize) - keyvaluesize;
+    }
+
+    unsigned int numlevels = format->generatemipmaps ? 1 : chain->numlevels;
+    for(unsigned int level = 0; level < numlevels && ok; level++) {
+        const unsigned char *src = chain->data + chain->offset[level];
+        if(chain->blockbytes > 0) {
+            uint32_t imagesize = chain->levelsize[level];
+            ok = fwrite(&imagesize, 4, 1, file) == 1
+              && fwrite(src, 1, imagesize, file) == imagesize
+              && fwrite(zeros, 1, pad4(imagesize) - imagesize, file) == pad4(imagesize) - imagesize;
+            continue;
+        }
+        // Uncompressed rows are padded to 4 bytes in the file
+        size_t rowbytes = (size_t)chain->width[level] * chain->channels * format->typesize;
+        size_t srcrowbytes = padTo(rowbytes, chain->rowalignment);
+        size_t dstrowbytes = pad4(rowbytes);
+        uint32_t imagesize = dstrowbytes * chain->height[level];
+        ok = fwrite(&imagesize, 4, 1, file) == 1;
+        if(srcrowbytes == dstrowbytes) {
+            ok = ok && fwrite(src, 1, imagesize, file) == imagesize;
+        }
+        else {
+            for(unsigned int row = 0; row < chain->height[level] && ok; row++) {
+                ok = fwrite(src + row * srcrowbytes, 1, rowbytes, file) == rowbytes
+                  && fwrite(zeros, 1, dstrowbytes - rowbytes, file) == dstrowbytes - rowbytes;
+            }
+        }
+    }
+
+    ok = (fclose(file) == 0) && ok;
+    if(ok) {
+        remove(filename); // rename() doesn't replace existing files in Windows
+        ok = rename(tempfile, filename) == 0;
+    }
+    if(!ok) remove(tempfile);
+    return ok ? GL_TRUE : GL_FALSE;
+}
@@ -0,0 +1,60 @@
+/* Ktx.hpp */
+/*
+ * Reading and writing of KTX (version 1) texture files.
+ * Usage: call read() to map a KTX file and get its levels as a MipChain
+ * that points right into the mapping, ready to upload with the GL
+ * formats from the file. Call write() to save a MipChain as KTX.
+ * Only plain 2D textures are supported (no arrays, cube maps or 3D).
+ * Files are written in native byte order, and only files in native
+ * byte order are read, which covers all little endian platforms.
+ * As the KTX format requires, uncompressed rows are padded to 4 bytes.
+ * The file format is described at
+ * https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+ * This code is in the public domain.
+ */
+
+#ifndef KTX_HPP // Avoid including this header twice
+#define KTX_HPP
+
+#include "Mipmap.hpp" // For MipChain
+
+namespace Ktx {
+
+/* The OpenGL format fields of a KTX file header */
+struct Format {
+    GLenum type;               // Pixel type, like GL_UNSIGNED_BYTE, or 0 if compressed
+    GLuint typesize;           // Size of type in bytes, 1 if compressed
+    GLenum format;             // Pixel format, like GL_BGR, or 0 if compressed
+    GLenum internalformat;     // Format on the GPU, like GL_RGB8 or a compressed format
+    GLenum baseinternalformat; // Like GL_RGB or GL_RGBA
+    int generatemipmaps;       // The file has only level 0, and asks for mipmaps to be generated
+};
+
+/*
+ * formatFor() - The format of a MipChain made by Mipmap or BlockCompress:
+ * BGR(A) bytes, or BC1/BC3 blocks.
+ */
+void formatFor(const Mipmap::MipChain *chain, Format *format);
+
+/*
+ * read() - Map a KTX file and point the chain to its levels.
+ * If key is not NULL, the value for that key in the key/value data is
+ * copied to value (or an empty string if the key is missing).
+ * Returns GL_TRUE on success, GL_FALSE if the file is missing or invalid.
+ * Release the chain with Mipmap::release().
+ */
+int read(const char *filename, Mipmap::MipChain *chain, Format *format,
+         const char *key, char *value, size_t maxlength);
+
+/*
+ * write() - Write a chain to a KTX file, with one optional key/value pair
+ * (key may be NULL). The file is written under a temporary name and then
+ * renamed, so a reader never sees a half-written file.
+ * Returns GL_TRUE on success, GL_FALSE otherwise.
+ */
+int write(const char *filename, const Mipmap::MipChain *chain, const Format *format,
+          const char *key, const char *value);
+
+}
+
+#endif // KTX_HPP
@@ -0,0 +1,369 @@
+/*
+ * CPU mipmap generation and caching.
+ * Each level is made from the floating point version of the level
+ * above it, so there is no rounding error building up down the chain.
+ * Filtering is separable: a horizontal pass into a temporary image,
+ * then a vertical pass. Both passes are split into bands of rows that
+ * are processed by separate threads (see Utilities::parallelRows()). Pixels are kept as 4 floats
+ * (RGB is padded) to fit one SSE register, and the vertical pass
+ * works on whole rows, which the compiler vectorizes.
+ * This code is in the public domain.
+ */
+
+#include "Mipmap.hpp"
+#include "Ktx.hpp" // The cache file format
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <sys/stat.h> // For stat(), to check if a cache file is up to date
+
+// Some <cmath> headers define M_PI, some don't. Make sure we have it.
+#ifndef M_PI
+#define M_PI (3.14159265359)
+#endif // M_PI
+
+#if defined(__SSE__) || defined(_M_X64)
+#define MIPMAP_SSE
+#include <xmmintrin.h>
+#endif
+
+
+/* ---- Filter kernels ---- */
+
+#define KERNEL_RADIUS 3.0 // Lobes for the windowed sinc filters
+
+static double sinc(double x) {
+    if(fabs(x) < 1e-8) return 1.0;
+    x *= M_PI;
+    return sin(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0, for the Kaiser window
+static double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for(int k = 1; k < 32; k++) {
+        term *= (x / (2.0*k)) * (x / (2.0*k));
+        sum += term;
+    }
+    return sum;
+}
+
+static double lanczos(double x) {
+    if(fabs(x) >= KERNEL_RADIUS) return 0.0;
+    return sinc(x) * sinc(x / KERNEL_RADIUS);
+}
+
+static double kaiser(double x) {
+    const double beta = 4.0;
+    if(fabs(x) >= KERNEL_RADIUS) return 0.0;
+    double r = x / KERNEL_RADIUS;
+    return sinc(x) * besselI0(beta * sqrt(1.0 - r*r)) / besselI0(beta);
+}
+
+
+/* ---- Resampling weights ---- */
+
+/* For each destination pixel, a fixed number of source indices and
+ * weights. Unused taps have weight 0, which keeps the inner loops simple. */
+struct Weights {
+    unsigned int taps;
+    int *index;
+    float *weight;
+};
+
+static void makeWeights(Weights *w, unsigned int srcsize, unsigned int dstsize, int filter) {
+
+    double scale = (double)srcsize / dstsize; // Source pixels per destination pixel
+    double radius = (filter == Mipmap::FILTER_BOX) ? 0.5 * scale : KERNEL_RADIUS * scale;
+
+    w->taps = (unsigned int)ceil(2.0 * radius) + 2;
+    w->index = new int[dstsize * w->taps];
+    w->weight = new float[dstsize * w->taps];
+
+    for(unsigned int x = 0; x < dstsize; x++) {
+        double center = (x + 0.5) * scale;
+        int first = (int)floor(center - radius);
+        double sum = 0.0;
+        for(unsigned int t = 0; t < w->taps; t++) {
+            int i = first + (int)t;
+            double weight;
+            if(filter == Mipmap::FILTER_BOX) {
+                // Area of source pixel i covered by this destination pixel
+                double lo = center - radius, hi = center + radius;
+                weight = fmin(i + 1.0, hi) - fmax((double)i, lo);
+                if(weight < 0.0) weight = 0.0;
+            }
+            else {
+                double d = (i + 0.5 - center) / scale;
+                weight = (filter == Mipmap::FILTER_KAISER) ? kaiser(d) : lanczos(d);
+            }
+            // Clamp to the edge. Out-of-range taps reuse the edge pixel.
+            int clamped = i < 0 ? 0 : (i >= (int)srcsize ? (int)srcsize - 1 : i);
+            w->index[x*w->taps + t] = clamped;
+            w->weight[x*w->taps + t] = (float)weight;
+            sum += weight;
+        }
+        for(unsigned int t = 0; t < w->taps; t++) { // Normalize to unit sum
+            w->weight[x*w->taps + t] = (float)(w->weight[x*w->taps + t] / sum);
+        }
+    }
+}
+
+static void freeWeights(Weights *w) {
+    delete[] w->index;
+    delete[] w->weight;
+}
+
+
+/* ---- Conversion between 8-bit and float ---- */
+
+static float srgbToLinear(double c) {
+    return (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+}
+
+static double linearToSrgb(double c) {
+    return c <= 0.0031308 ? c * 12.92 : 1.055 * pow(c, 1.0/2.4) - 0.055;
+}
+
+#define ENCODE_STEPS 4096 // Resolution of the float to sRGB table
+
+struct Conversion {
+    float decode[256];                   // 8-bit to float for RGB
+    unsigned char encode[ENCODE_STEPS+1]; // Float in [0,1] to 8-bit for RGB
+    int gamma;
+};
+
+static void makeConversion(Conversion *conv, int gamma) {
+    conv->gamma = gamma;
+    for(int i = 0; i < 256; i++) {
+        conv->decode[i] = gamma ? srgbToLinear(i / 255.0) : i / 255.0f;
+    }
+    for(int i = 0; i <= ENCODE_STEPS; i++) {
+        double c = (double)i / ENCODE_STEPS;
+        conv->encode[i] = (unsigned char)(255.0 * (gamma ? linearToSrgb(c) : c) + 0.5);
+    }
+}
+
+static inline unsigned char encodeColor(const Conversion *conv, float c) {
+    if(!(c > 0.0f)) return 0; // Also catches NaN
+    if(c >= 1.0f) return 255;
+    if(!conv->gamma) return (unsigned char)(255.0f * c + 0.5f);
+    return conv->encode[(int)(c * ENCODE_STEPS + 0.5f)];
+}
+
+static inline unsigned char encodeAlpha(float a) {
+    if(!(a > 0.0f)) return 0;
+    if(a >= 1.0f) return 255;
+    return (unsigned char)(255.0f * a + 0.5f);
+}
+
+
+/* ---- Filtering passes ---- */
+
+// Horizontal pass: src is srcwidth x (rows), dst is dstwidth x (rows)
+static void filterRows(const float *src, unsigned int srcwidth, float *dst, unsigned int dstwidth,
+                       const Weights *w, unsigned int firstrow, unsigned int endrow) {
+    for(unsigned int y = firstrow; y < endrow; y++) {
+        const float *srcrow = src + (size_t)y * srcwidth * 4;
+        float *dstrow = dst + (size_t)y * dstwidth * 4;
+        for(unsigned int x = 0; x < dstwidth; x++) {
+            const int *index = w->index + x * w->taps;
+            const float *weight = w->weight + x * w->taps;
+#ifdef MIPMAP_SSE
+            __m128 acc = _mm_setzero_ps();
+            for(unsigned int t = 0; t < w->taps; t++) {
+                __m128 pixel = _mm_loadu_ps(srcrow + 4*index[t]);
+                acc = _mm_add_ps(acc, _mm_mul_ps(pixel, _mm_set1_ps(weight[t])));
+            }
+            _mm_storeu_ps(dstrow + 4*x, acc);
+#else
+            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for(unsigned int t = 0; t < w->taps; t++) {
+                const float *pixel = srcrow + 4*index[t];
+                for(int c = 0; c < 4; c++) acc[c] += weight[t] * pixel[c];
+            }
+            for(int c = 0; c < 4; c++) dstrow[4*x + c] = acc[c];
+#endif
+        }
+    }
+}
+
+// Vertical pass: each destination row is a weighted sum of whole source rows
+static void filterColumns(const float *src, float *dst, unsigned int width,
+                          const Weights *w, unsigned int firstrow, unsigned int endrow) {
+    size_t rowlength = (size_t)width * 4;
+    for(unsigned int y = firstrow; y < endrow; y++) {
+        float *dstrow = dst + y * rowlength;
+        for(size_t i = 0; i < rowlength; i++) dstrow[i] = 0.0f;
+        for(unsigned int t = 0; t < w->taps; t++) {
+            float weight = w->weight[y * w->taps + t];
+            if(weight == 0.0f) continue;
+            const float *srcrow = src + (size_t)w->index[y * w->taps + t] * rowlength;
+            for(size_t i = 0; i < rowlength; i++) dstrow[i] += weight * srcrow[i];
+        }
+    }
+}
+
+
+/*
+ * setLayout() - Set the size and position of each level.
+ */
+void Mipmap::setLayout(MipChain *chain, unsigned int width, unsigned int height,
+                       unsigned int channels, unsigned int blockbytes, unsigned int numlevels) {
+
+    if(numlevels == 0 || numlevels > MIPMAP_MAXLEVELS) numlevels = MIPMAP_MAXLEVELS;
+    chain->channels = channels;
+    chain->blockbytes = blockbytes;
+    chain->rowalignment = 1;
+    size_t offset = 0;
+    unsigned int w = width, h = height;
+    for(unsigned int level = 0; level < numlevels; level++) {
+        chain->width[level] = w;
+        chain->height[level] = h;
+        chain->offset[level] = offset;
+        if(blockbytes > 0) { // Whole 4x4 blocks, also for the smallest levels
+            chain->levelsize[level] = (size_t)((w + 3) / 4) * ((h + 3) / 4) * blockbytes;
+        }
+        else {
+            chain->levelsize[level] = (size_t)w * h * channels;
+        }
+        offset += chain->levelsize[level];
+        chain->numlevels = level + 1;
+        if(w == 1 && h == 1) break;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    chain->size = offset;
+}
+
+
+/*
+ * generate() - Build a full mip chain from level 0 pixels.
+ */
+void Mipmap::generate(MipChain *chain, const unsigned char *pixels,
+                      unsigned int width, unsigned int height, unsigned int channels,
+                      int filter, int flags) {
+
+    Conversion conv;
+    makeConversion(&conv, (flags & GAMMA_CORRECT) != 0);
+
+    memset(chain, 0, sizeof(MipChain));
+    setLayout(chain, width, height, channels, 0, 0);
+    chain->owneddata = new unsigned char[chain->size];
+    chain->data = chain->owneddata;
+    memcpy(chain->owneddata, pixels, (size_t)width * height * channels);
+
+    // Level 0 in float, 4 channels
+    float *current = new float[(size_t)width * height * 4];
+    Utilities::parallelRows(height, width, [&](unsigned int first, unsigned int end) {
+        for(size_t i = (size_t)first * width; i < (size_t)end * width; i++) {
+            const unsigned char *p = pixels + i * channels;
+            current[4*i] = conv.decode[p[0]];
+            current[4*i+1] = conv.decode[p[1]];
+            current[4*i+2] = conv.decode[p[2]];
+            current[4*i+3] = channels == 4 ? p[3] / 255.0f : 1.0f;
+        }
+    });
+
+    for(unsigned int level = 1; level < chain->numlevels; level++) {
+        unsigned int sw = chain->width[level-1], sh = chain->height[level-1];
+        unsigned int dw = chain->width[level], dh = chain->height[level];
+        Weights wx, wy;
+        makeWeights(&wx, sw, dw, filter);
+        makeWeights(&wy, sh, dh, filter);
+
+        float *temp = new float[(size_t)dw * sh * 4];
+        float *next = new float[(size_t)dw * dh * 4];
+        Utilities::parallelRows(sh, (size_t)dw * wx.taps, [&](unsigned int first, unsigned int end) {
+            filterRows(current, sw, temp, dw, &wx, first, end);
+        });
+        unsigned char *out = chain->owneddata + chain->offset[level];
+        Utilities::parallelRows(dh, (size_t)dw * wy.taps, [&](unsigned int first, unsigned int end) {
+            filterColumns(temp, next, dw, &wy, first, end);
+            for(size_t i = (size_t)first * dw; i < (size_t)end * dw; i++) {
+                out[i*channels] = encodeColor(&conv, next[4*i]);
+                out[i*channels+1] = encodeColor(&conv, next[4*i+1]);
+                out[i*channels+2] = encodeColor(&conv, next[4*i+2]);
+                if(channels == 4) out[i*channels+3] = encodeAlpha(next[4*i+3]);
+            }
+        });
+
+        freeWeights(&wx);
+        freeWeights(&wy);
+        delete[] temp;
+        delete[] current;
+        current = next;
+    }
+    delete[] current;
+}
+
+
+/*
+ * release() - Free the data in a mip chain.
+ */
+void Mipmap::release(MipChain *chain) {
+    if(chain->owneddata) {
+        delete[] chain->owneddata;
+        chain->owneddata = NULL;
+    }
+    Utilities::unmapFile(&chain->file);
+    chain->data = NULL;
+    chain->numlevels = 0;
+}
+
+
+/* ---- Cache files ---- */
+
+/* The cache is a KTX file. The source file size and modification time,
+ * and the settings used, are stored as a key/value pair, and a cache
+ * with a different value is out of date. */
+
+#define CACHE_KEY "TNM046.mipmapsource"
+
+void Mipmap::cacheFileName(const char *sourcefile, const char *suffix, char *cachefile, size_t maxlength) {
+    snprintf(cachefile, maxlength, "%s%s", sourcefile, suffix);
+}
+
+static int cacheValue(const char *sourcefile, int filter, int flags, int extraflags,
+                      char *value, size_t maxlength) {
+    struct stat filestat;
+    if(stat(sourcefile, &filestat) != 0) return GL_FALSE;
+    snprintf(value, maxlength, "size=%llu time=%lld filter=%d flags=%d extraflags=%d",
+             (unsigned long long)filestat.st_size, (long long)filestat.st_mtime,
+             filter, flags, extraflags);
+    return GL_TRUE;
+}
+
+int Mipmap::readCache(MipChain *chain, const char *sourcefile, const char *suffix,
+                      int filter, int flags, int extraflags) {
+
+    char cachefile[1024];
+    char expected[256];
+    char found[256];
+    Ktx::Format format;
+
+    memset(chain, 0, sizeof(MipChain));
+    if(!cacheValue(sourcefile, filter, flags, extraflags, expected, sizeof(expected))) return GL_FALSE;
+    cacheFileName(sourcefile, suffix, cachefile, sizeof(cachefile));
+    if(!Ktx::read(cachefile, chain, &format, CACHE_KEY, found, sizeof(found))) return GL_FALSE; // No cache yet
+
+    if(strcmp(expected, found) != 0 || chain->channels == 0) {
+        release(chain); // Stale, or not made by us
+        return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+int Mipmap::writeCache(const MipChain *chain, const char *sourcefile, const char *suffix,
+                       int filter, int flags, int extraflags) {
+
+    char cachefile[1024];
+    char value[256];
+    Ktx::Format format;
+
+    if(!cacheValue(sourcefile, filter, flags, extraflags, value, sizeof(value))) return GL_FALSE;
+    cacheFileName(sourcefile, suffix, cachefile, sizeof(cachefile));
+    Ktx::formatFor(chain, &format);
+    return Ktx::write(cachefile, chain, &format, CACHE_KEY, value);
+}
@@ -0,0 +1,104 @@
+/* Mipmap.hpp */
+/*
+ * CPU generation of mipmap chains for 8-bit RGB and RGBA images,
+ * with a cache file on disk so the work is done only once per image.
+ * The cache files are KTX files (see Ktx.hpp).
+ * Usage: call generate() with the level 0 pixels to build a MipChain,
+ * or readCache() to get one from an up-to-date cache file. Each level
+ * is at offset[level] in data, with the same pixel layout as the input
+ * and the bottom row first. Rows are tightly packed, except in chains
+ * read from KTX files, where they are padded to rowalignment bytes.
+ * Call release() when done.
+ * A chain can also hold block compressed levels (see BlockCompress.hpp).
+ * The filtering is done in floating point, 4 channels per pixel, by
+ * a separable resampler that is split over several threads.
+ * This code is in the public domain.
+ */
+
+#ifndef MIPMAP_HPP // Avoid including this header twice
+#define MIPMAP_HPP
+
+#include <cstddef> // For size_t
+
+#include "Utilities.hpp" // For MappedFile
+
+// A 65535x65535 image (the largest possible TGA) has 16 mip levels
+#define MIPMAP_MAXLEVELS 16
+
+namespace Mipmap {
+
+// Filters for generate()
+enum {
+    FILTER_BOX     = 0, // Average of the pixels under each destination pixel
+    FILTER_LANCZOS = 1, // Lanczos windowed sinc, 3 lobes. Sharper than box.
+    FILTER_KAISER  = 2  // Kaiser windowed sinc, 3 lobes, less ringing than Lanczos
+};
+
+// Flags for generate()
+enum {
+    GAMMA_CORRECT = 1  // Filter RGB in linear light (the data is sRGB). Alpha is always linear.
+};
+
+struct MipChain {
+    unsigned int channels;  // Bytes per pixel, 3 or 4 (before compression)
+    unsigned int blockbytes; // Bytes per 4x4 block for block compressed data, 0 if uncompressed
+    unsigned int numlevels; // Number of levels, including level 0
+    unsigned int width[MIPMAP_MAXLEVELS];
+    unsigned int height[MIPMAP_MAXLEVELS];
+    size_t offset[MIPMAP_MAXLEVELS]; // Start of each level in data
+    size_t levelsize[MIPMAP_MAXLEVELS]; // Number of bytes in each level
+    unsigned int rowalignment; // Rows start at multiples of this many bytes (1, or 4 for KTX)
+    size_t size;            // Total number of bytes in data
+    const unsigned char *data; // All levels, level 0 first
+    unsigned char *owneddata;  // Same as data if it was allocated by generate() or compress(), else NULL
+    Utilities::MappedFile file; // Mapped file if data came from readCache() or Ktx::read()
+};
+
+/*
+ * setLayout() - Set the size and offset of each level, for a chain with
+ * level 0 of the given size, down to 1x1 or numlevels levels, whichever
+ * comes first. numlevels 0 means all levels. blockbytes is 0 for
+ * uncompressed data. Doesn't allocate anything.
+ */
+void setLayout(MipChain *chain, unsigned int width, unsigned int height,
+               unsigned int channels, unsigned int blockbytes, unsigned int numlevels);
+
+/*
+ * generate() - Build a full mip chain, down to 1x1, from level 0 pixels.
+ * Level 0 is copied into the chain as it is.
+ */
+void generate(MipChain *chain, const unsigned char *pixels,
+              unsigned int width, unsigned int height, unsigned int channels,
+              int filter, int flags);
+
+/*
+ * release() - Free the data in a mip chain.
+ */
+void release(MipChain *chain);
+
+/*
+ * cacheFileName() - Name of a cache file for a source image file.
+ * The cache is kept next to the source, with suffix (like ".ktx") appended.
+ */
+void cacheFileName(const char *sourcefile, const char *suffix, char *cachefile, size_t maxlength);
+
+/*
+ * readCache() - Map a cache file, if it exists and was made from the current
+ * version of sourcefile with the same filter and flags. The chain then refers
+ * directly to the mapped file. Returns GL_TRUE on success, GL_FALSE otherwise.
+ * extraflags is for flags that affect the level 0 data, like premultiplied alpha.
+ * The source file and settings are recorded in the KTX key/value data.
+ */
+int readCache(MipChain *chain, const char *sourcefile, const char *suffix,
+              int filter, int flags, int extraflags);
+
+/*
+ * writeCache() - Write a mip chain to the cache file for sourcefile.
+ * Returns GL_TRUE on success, GL_FALSE otherwise.
+ */
+int writeCache(const MipChain *chain, const char *sourcefile, const char *suffix,
+               int filter, int flags, int extraflags);
+
+}
+
+#endif // MIPMAP_HPP
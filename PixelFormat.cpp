@@ -0,0 +1,304 @@
+/*
+ * Pixel format conversion kernels for 8-bit images.
+ * The SIMD versions are compiled with per-function target attributes,
+ * so they are available without special compiler flags for the whole
+ * project, and selected at runtime from what the CPU reports.
+ * Every SIMD loop leaves the last few pixels to the scalar version.
+ * This code is in the public domain.
+ */
+
+#include "PixelFormat.hpp"
+
+#include <cstring> // For memcpy()
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PIXELFORMAT_X86
+#include <immintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+/*
+ * Find out which instruction sets the CPU supports.
+ */
+static int detectSimdLevel() {
+#ifdef PIXELFORMAT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return PixelFormat::SIMD_AVX2;
+    if(__builtin_cpu_supports("ssse3")) return PixelFormat::SIMD_SSSE3;
+#endif
+    return PixelFormat::SIMD_SCALAR;
+}
+
+static int supportedSimdLevel() {
+    static const int level = detectSimdLevel(); // Detected only once
+    return level;
+}
+
+static int requestedSimdLevel = PixelFormat::SIMD_AVX2;
+
+int PixelFormat::simdLevel() {
+    int supported = supportedSimdLevel();
+    return requestedSimdLevel < supported ? requestedSimdLevel : supported;
+}
+
+void PixelFormat::setSimdLevel(int level) {
+    requestedSimdLevel = level;
+}
+
+
+/* ---- Scalar reference versions ---- */
+
+static void swapRedBlue24Scalar(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    for(size_t i = 0; i < numpixels; i++) {
+        unsigned char temp = src[3*i];
+        dst[3*i] = src[3*i+2];
+        dst[3*i+1] = src[3*i+1];
+        dst[3*i+2] = temp;
+    }
+}
+
+static void swapRedBlue32Scalar(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    for(size_t i = 0; i < numpixels; i++) {
+        unsigned char temp = src[4*i];
+        dst[4*i] = src[4*i+2];
+        dst[4*i+1] = src[4*i+1];
+        dst[4*i+2] = temp;
+        dst[4*i+3] = src[4*i+3];
+    }
+}
+
+static void expand24to32Scalar(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    for(size_t i = 0; i < numpixels; i++) {
+        dst[4*i] = src[3*i];
+        dst[4*i+1] = src[3*i+1];
+        dst[4*i+2] = src[3*i+2];
+        dst[4*i+3] = 255;
+    }
+}
+
+// c*a/255, rounded to nearest, without a division
+static inline unsigned char mulDiv255(unsigned int c, unsigned int a) {
+    unsigned int t = c * a + 128;
+    return (unsigned char)((t + (t >> 8)) >> 8);
+}
+
+static void premultiplyAlphaScalar(unsigned char *data, size_t numpixels) {
+    for(size_t i = 0; i < numpixels; i++) {
+        unsigned int a = data[4*i+3];
+        data[4*i] = mulDiv255(data[4*i], a);
+        data[4*i+1] = mulDiv255(data[4*i+1], a);
+        data[4*i+2] = mulDiv255(data[4*i+2], a);
+    }
+}
+
+
+#ifdef PIXELFORMAT_X86
+
+/* ---- SSSE3 versions, 16 bytes at a time ---- */
+
+// 24-bit pixels don't fit evenly in 16 bytes, so we swap 5 pixels (15 bytes)
+// per step and pass the 16th byte through. The next step overwrites it.
+TARGET_SSSE3
+static size_t swapRedBlue24SSSE3(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m128i mask = _mm_setr_epi8(2,1,0, 5,4,3, 8,7,6, 11,10,9, 14,13,12, 15);
+    size_t numbytes = 3 * numpixels;
+    size_t b = 0;
+    for(; b + 16 <= numbytes; b += 15) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + b));
+        _mm_storeu_si128((__m128i*)(dst + b), _mm_shuffle_epi8(v, mask));
+    }
+    return b / 3; // Number of pixels done
+}
+
+TARGET_SSSE3
+static size_t swapRedBlue32SSSE3(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m128i mask = _mm_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+    size_t i = 0;
+    for(; i + 4 <= numpixels; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 4*i));
+        _mm_storeu_si128((__m128i*)(dst + 4*i), _mm_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+// Spread 4 pixels (12 bytes) over 16 bytes and set the alpha bytes
+TARGET_SSSE3
+static size_t expand24to32SSSE3(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m128i mask = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+    for(; 3*i + 16 <= 3*numpixels; i += 4) { // Each load reads 16 bytes, but uses 12
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 3*i));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+        _mm_storeu_si128((__m128i*)(dst + 4*i), v);
+    }
+    return i;
+}
+
+// Widen to 16 bits, multiply by the alpha broadcast to each channel,
+// divide by 255 with the same rounding as mulDiv255(), and keep the
+// original alpha byte.
+TARGET_SSSE3
+static size_t premultiplyAlphaSSSE3(unsigned char *data, size_t numpixels) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i alphamask = _mm_set1_epi32((int)0xFF000000);
+    const __m128i alphalo = _mm_setr_epi8(3,-1,3,-1,3,-1,3,-1, 7,-1,7,-1,7,-1,7,-1);
+    const __m128i alphahi = _mm_setr_epi8(11,-1,11,-1,11,-1,11,-1, 15,-1,15,-1,15,-1,15,-1);
+    size_t i = 0;
+    for(; i + 4 <= numpixels; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + 4*i));
+        __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), _mm_shuffle_epi8(v, alphalo));
+        __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), _mm_shuffle_epi8(v, alphahi));
+        lo = _mm_add_epi16(lo, round);
+        hi = _mm_add_epi16(hi, round);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        __m128i result = _mm_packus_epi16(lo, hi);
+        result = _mm_or_si128(_mm_andnot_si128(alphamask, result), _mm_and_si128(alphamask, v));
+        _mm_storeu_si128((__m128i*)(data + 4*i), result);
+    }
+    return i;
+}
+
+
+/* ---- AVX2 versions, 32 bytes at a time ---- */
+/* AVX2 shuffles work within each 16-byte lane, so the
+ * masks are the SSSE3 masks repeated for both lanes. */
+
+// Two overlapping 16-byte loads, 15 bytes apart, fill the two lanes.
+// The low lane is stored first, so the high lane overwrites its
+// pass-through byte with the correctly swapped value.
+TARGET_AVX2
+static size_t swapRedBlue24AVX2(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m256i mask = _mm256_setr_epi8(2,1,0, 5,4,3, 8,7,6, 11,10,9, 14,13,12, 15,
+                                          2,1,0, 5,4,3, 8,7,6, 11,10,9, 14,13,12, 15);
+    size_t numbytes = 3 * numpixels;
+    size_t b = 0;
+    for(; b + 31 <= numbytes; b += 30) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + b));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + b + 15));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i*)(dst + b), _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(dst + b + 15), _mm256_extracti128_si256(v, 1));
+    }
+    return b / 3;
+}
+
+TARGET_AVX2
+static size_t swapRedBlue32AVX2(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m256i mask = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15,
+                                          2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+    size_t i = 0;
+    for(; i + 8 <= numpixels; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + 4*i));
+        _mm256_storeu_si256((__m256i*)(dst + 4*i), _mm256_shuffle_epi8(v, mask));
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t expand24to32AVX2(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    const __m256i mask = _mm256_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1,
+                                          0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+    for(; 3*i + 28 <= 3*numpixels; i += 8) { // The second load reads 16 bytes from offset 12
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + 3*i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + 3*i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+        _mm256_storeu_si256((__m256i*)(dst + 4*i), v);
+    }
+    return i;
+}
+
+TARGET_AVX2
+static size_t premultiplyAlphaAVX2(unsigned char *data, size_t numpixels) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi16(128);
+    const __m256i alphamask = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i alphalo = _mm256_setr_epi8(3,-1,3,-1,3,-1,3,-1, 7,-1,7,-1,7,-1,7,-1,
+                                             3,-1,3,-1,3,-1,3,-1, 7,-1,7,-1,7,-1,7,-1);
+    const __m256i alphahi = _mm256_setr_epi8(11,-1,11,-1,11,-1,11,-1, 15,-1,15,-1,15,-1,15,-1,
+                                             11,-1,11,-1,11,-1,11,-1, 15,-1,15,-1,15,-1,15,-1);
+    size_t i = 0;
+    for(; i + 8 <= numpixels; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + 4*i));
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), _mm256_shuffle_epi8(v, alphalo));
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), _mm256_shuffle_epi8(v, alphahi));
+        lo = _mm256_add_epi16(lo, round);
+        hi = _mm256_add_epi16(hi, round);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        __m256i result = _mm256_packus_epi16(lo, hi); // Per lane, so the pixel order is kept
+        result = _mm256_or_si256(_mm256_andnot_si256(alphamask, result), _mm256_and_si256(alphamask, v));
+        _mm256_storeu_si256((__m256i*)(data + 4*i), result);
+    }
+    return i;
+}
+
+#endif // PIXELFORMAT_X86
+
+
+/* ---- Public entry points: SIMD for the bulk, scalar for the tail ---- */
+
+void PixelFormat::swapRedBlue24(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    size_t done = 0;
+#ifdef PIXELFORMAT_X86
+    int level = simdLevel();
+    if(level >= SIMD_AVX2) done = swapRedBlue24AVX2(src, dst, numpixels);
+    else if(level >= SIMD_SSSE3) done = swapRedBlue24SSSE3(src, dst, numpixels);
+#endif
+    swapRedBlue24Scalar(src + 3*done, dst + 3*done, numpixels - done);
+}
+
+void PixelFormat::swapRedBlue32(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    size_t done = 0;
+#ifdef PIXELFORMAT_X86
+    int level = simdLevel();
+    if(level >= SIMD_AVX2) done = swapRedBlue32AVX2(src, dst, numpixels);
+    else if(level >= SIMD_SSSE3) done = swapRedBlue32SSSE3(src, dst, numpixels);
+#endif
+    swapRedBlue32Scalar(src + 4*done, dst + 4*done, numpixels - done);
+}
+
+void PixelFormat::expand24to32(const unsigned char *src, unsigned char *dst, size_t numpixels) {
+    size_t done = 0;
+#ifdef PIXELFORMAT_X86
+    int level = simdLevel();
+    if(level >= SIMD_AVX2) done = expand24to32AVX2(src, dst, numpixels);
+    else if(level >= SIMD_SSSE3) done = expand24to32SSSE3(src, dst, numpixels);
+#endif
+    expand24to32Scalar(src + 3*done, dst + 4*done, numpixels - done);
+}
+
+void PixelFormat::premultiplyAlpha(unsigned char *data, size_t numpixels) {
+    size_t done = 0;
+#ifdef PIXELFORMAT_X86
+    int level = simdLevel();
+    if(level >= SIMD_AVX2) done = premultiplyAlphaAVX2(data, numpixels);
+    else if(level >= SIMD_SSSE3) done = premultiplyAlphaSSSE3(data, numpixels);
+#endif
+    premultiplyAlphaScalar(data + 4*done, numpixels - done);
+}
+
+// Row swapping is pure data movement, which memcpy() already does
+// at full memory bandwidth, so this goes through a small stack buffer.
+void PixelFormat::flipRows(unsigned char *data, size_t rowbytes, size_t numrows) {
+    unsigned char temp[4096];
+    if(numrows < 2) return;
+    for(size_t top = 0, bottom = numrows - 1; top < bottom; top++, bottom--) {
+        unsigned char *toprow = data + top * rowbytes;
+        unsigned char *bottomrow = data + bottom * rowbytes;
+        for(size_t b = 0; b < rowbytes; b += sizeof(temp)) {
+            size_t n = rowbytes - b < sizeof(temp) ? rowbytes - b : sizeof(temp);
+            memcpy(temp, toprow + b, n);
+            memcpy(toprow + b, bottomrow + b, n);
+            memcpy(bottomrow + b, temp, n);
+        }
+    }
+}
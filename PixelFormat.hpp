@@ -0,0 +1,71 @@
+/* PixelFormat.hpp */
+/*
+ * Pixel format conversion kernels for 8-bit images, used by Texture
+ * for the conversions that can't be handed to the OpenGL driver.
+ * Usage: call the functions below on tightly packed pixel arrays.
+ * Each kernel has an SSSE3 and an AVX2 version using byte shuffles,
+ * and a plain scalar version. The fastest version the CPU supports
+ * is picked at runtime. setSimdLevel() can force a lower level,
+ * to compare the SIMD results against the scalar reference.
+ * This code is in the public domain.
+ */
+
+#ifndef PIXELFORMAT_HPP // Avoid including this header twice
+#define PIXELFORMAT_HPP
+
+#include <cstddef> // For size_t
+
+namespace PixelFormat {
+
+// Instruction set levels, in increasing order
+enum {
+    SIMD_SCALAR = 0,
+    SIMD_SSSE3  = 1,
+    SIMD_AVX2   = 2
+};
+
+/*
+ * simdLevel() - The instruction set level currently in use.
+ */
+int simdLevel();
+
+/*
+ * setSimdLevel() - Use at most the given instruction set level.
+ * Levels the CPU doesn't support are never used.
+ */
+void setSimdLevel(int level);
+
+/*
+ * swapRedBlue24() - Swap bytes 0 and 2 of each 3-byte pixel (BGR <-> RGB).
+ * src and dst may be the same array for in-place conversion.
+ */
+void swapRedBlue24(const unsigned char *src, unsigned char *dst, size_t numpixels);
+
+/*
+ * swapRedBlue32() - Swap bytes 0 and 2 of each 4-byte pixel (BGRA <-> RGBA).
+ * src and dst may be the same array for in-place conversion.
+ */
+void swapRedBlue32(const unsigned char *src, unsigned char *dst, size_t numpixels);
+
+/*
+ * expand24to32() - Expand 3-byte pixels to 4-byte pixels with alpha 255.
+ * The byte order is kept, so BGR becomes BGRA and RGB becomes RGBA.
+ * src and dst must not overlap.
+ */
+void expand24to32(const unsigned char *src, unsigned char *dst, size_t numpixels);
+
+/*
+ * premultiplyAlpha() - Multiply the color channels of 4-byte pixels
+ * by their alpha (byte 3), in place, rounded to nearest.
+ */
+void premultiplyAlpha(unsigned char *data, size_t numpixels);
+
+/*
+ * flipRows() - Reverse the order of the rows of an image, in place.
+ * Converts between top-down and bottom-up row order.
+ */
+void flipRows(unsigned char *data, size_t rowbytes, size_t numrows);
+
+}
+
+#endif // PIXELFORMAT_HPP
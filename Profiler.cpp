@@ -0,0 +1,168 @@
+#include "Profiler.hpp"
+
+/* Constructor */
+Profiler::Profiler() {
+    this->dropped = 0;
+    this->frame = 0;
+    this->started = GL_FALSE;
+    for(int i = 0; i <= PROFILER_LATENCY; i++) {
+        this->frames[i].used = 0;
+        this->frames[i].last = 0;
+    }
+}
+
+/* Destructor */
+Profiler::~Profiler() {
+}
+
+
+/*
+ * zoneID(const char *name)
+ * Get the ID for a zone name, adding it if it is new.
+ */
+int Profiler::zoneID(const char *name) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for(size_t i = 0; i < this->zones.size(); i++) {
+        if(this->zones[i].name == name) return (int)i;
+    }
+    Zone zone;
+    zone.name = name;
+    zone.gpu.count = zone.gpu.next = 0;
+    zone.cpu.count = zone.cpu.next = 0;
+    this->zones.push_back(zone);
+    return (int)this->zones.size() - 1;
+}
+
+
+/*
+ * beginFrame()
+ * Move on to the next frame of queries, which were last used
+ * PROFILER_LATENCY frames ago, and read their results first.
+ */
+void Profiler::beginFrame() {
+
+    this->frame = (this->frame + 1) % (PROFILER_LATENCY + 1);
+    Frame *frame = &(this->frames[this->frame]);
+    this->read(frame);
+    frame->marks.clear();
+    frame->used = 0;
+    this->started = GL_TRUE;
+}
+
+
+void Profiler::endFrame() {
+    this->started = GL_FALSE;
+}
+
+
+/*
+ * beginGpu(int zone)
+ * Put a timestamp query in the command stream at the start of a zone,
+ * and return the mark to end it with. Zones outside of a frame are not
+ * timed, and get the mark -1.
+ */
+int Profiler::beginGpu(int zone) {
+
+    if(!this->started) return -1;
+    Frame *frame = &(this->frames[this->frame]);
+    if(frame->used + 2 > (int)frame->queries.size()) {
+        size_t size = frame->queries.size();
+        frame->queries.resize(size > 0 ? 2 * size : 16);
+        glGenQueries((GLsizei)(frame->queries.size() - size), &(frame->queries[size]));
+    }
+    Mark mark;
+    mark.zone = zone;
+    mark.first = frame->used;
+    frame->used += 2;
+    frame->marks.push_back(mark);
+    frame->last = mark.first;
+    glQueryCounter(frame->queries[mark.first], GL_TIMESTAMP);
+    return (int)frame->marks.size() - 1;
+}
+
+
+/*
+ * endGpu(int mark)
+ * Put a timestamp query in the command stream at the end of a zone.
+ */
+void Profiler::endGpu(int mark) {
+
+    if(mark < 0) return;
+    Frame *frame = &(this->frames[this->frame]);
+    frame->last = frame->marks[mark].first + 1;
+    glQueryCounter(frame->queries[frame->last], GL_TIMESTAMP);
+}
+
+
+void Profiler::addCpu(int zone, double seconds) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    add(&(this->zones[zone].cpu), 1000.0 * seconds);
+}
+
+
+/*
+ * dump(FILE *out)
+ * Print the average, minimum and maximum time of each zone, on each
+ * clock it was timed on, over its last PROFILER_HISTORY times.
+ */
+void Profiler::dump(FILE *out) {
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    fprintf(out, "%-24s %5s %8s %8s %8s\n", "Zone (ms)", "", "avg", "min", "max");
+    for(size_t i = 0; i < this->zones.size(); i++) {
+        for(int clock = 0; clock < 2; clock++) {
+            History *history = clock ? &(this->zones[i].cpu) : &(this->zones[i].gpu);
+            if(history->count == 0) continue;
+            float sum = 0.0f, low = history->times[0], high = history->times[0];
+            for(int j = 0; j < history->count; j++) {
+                float t = history->times[j];
+                sum += t;
+                if(t < low) low = t;
+                if(t > high) high = t;
+            }
+            fprintf(out, "%-24s %5s %8.3f %8.3f %8.3f\n", this->zones[i].name.c_str(),
+                clock ? "CPU" : "GPU", sum / history->count, low, high);
+        }
+    }
+    if(this->dropped > 0) {
+        fprintf(out, "(%lu GPU times dropped, not done in time)\n", this->dropped);
+    }
+}
+
+
+/*
+ * private
+ * add(History *history, double milliseconds)
+ * Add a time to a history, over the oldest one if it is full.
+ */
+void Profiler::add(History *history, double milliseconds) {
+    history->times[history->next] = (float)milliseconds;
+    history->next = (history->next + 1) % PROFILER_HISTORY;
+    if(history->count < PROFILER_HISTORY) history->count++;
+}
+
+
+/*
+ * private
+ * read(Frame *frame)
+ * Read the timestamps of the zones in a frame. The GPU runs the queries
+ * in order, so if the one issued last is done, they all are. If it isn't,
+ * the frame is dropped rather than waited for.
+ */
+void Profiler::read(Frame *frame) {
+
+    if(frame->used == 0) return;
+    GLuint64 available = 0;
+    glGetQueryObjectui64v(frame->queries[frame->last], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available) {
+        this->dropped += frame->marks.size();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for(size_t i = 0; i < frame->marks.size(); i++) {
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(frame->queries[frame->marks[i].first], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(frame->queries[frame->marks[i].first + 1], GL_QUERY_RESULT, &end);
+        add(&(this->zones[frame->marks[i].zone].gpu), (end - start) * 1e-6);
+    }
+}
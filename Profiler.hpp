@@ -0,0 +1,149 @@
+/* Profiler.hpp */
+/* Class to time parts of a frame, on the GPU and on the CPU, and to keep
+ * running statistics for each part. */
+/* Usage: get an ID for each part to time, a "zone", with zoneID() once at
+ * startup. Call beginFrame() at the start of each frame and endFrame() at
+ * the end. In between, a GpuZone or CpuZone made on the stack times the
+ * rest of its scope:
+ *     { GpuZone zone(&profiler, drawZone); renderQueue.execute(...); }
+ * A GpuZone puts a GL_TIMESTAMP query at each end of the scope, from a
+ * pool of query objects for each frame. GL_TIMESTAMP is used rather than
+ * GL_TIME_ELAPSED, since elapsed time queries can't be nested, and zones
+ * often are. The results are read PROFILER_LATENCY frames later, when the
+ * GPU is done with them, so the CPU never waits for them. Results still
+ * not there by then are dropped, rather than waited for.
+ * A zone has to begin and end within the same frame.
+ * A CpuZone measures the wall clock time of its scope. It may be used on
+ * any thread.
+ * Each zone keeps its last PROFILER_HISTORY times on each clock, and
+ * dump() prints their average, minimum and maximum. */
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "Utilities.hpp" // For GL extensions in Windows
+
+// Frames between making GPU timestamps and reading them
+#define PROFILER_LATENCY 3
+
+// Number of times kept for each zone and clock
+#define PROFILER_HISTORY 120
+
+class Profiler {
+
+public:
+
+unsigned long dropped;      // GPU zones not done in time to be read
+
+/* Constructor */
+Profiler();
+
+/* Destructor */
+~Profiler();
+
+// Get the ID for a zone name, adding it if it is new. Call once for each zone, at startup.
+int zoneID(const char *name);
+
+// Read the GPU times from PROFILER_LATENCY frames ago. Call at the start of each frame.
+void beginFrame();
+
+// Call at the end of each frame
+void endFrame();
+
+// Mark the GPU start and end of a zone. Use GpuZone rather than these.
+int beginGpu(int zone);
+void endGpu(int mark);
+
+// Add a CPU time, in seconds, for a zone. CpuZone does this for a scope.
+void addCpu(int zone, double seconds);
+
+// Print the statistics for all zones
+void dump(FILE *out);
+
+private:
+
+/* The last times of a zone on one clock, in milliseconds */
+struct History {
+    float times[PROFILER_HISTORY];
+    int count;              // Number of times, up to PROFILER_HISTORY
+    int next;               // Where the next time goes
+};
+
+struct Zone {
+    std::string name;
+    History gpu;
+    History cpu;
+};
+
+/* Two GL_TIMESTAMP queries around a zone, in one frame */
+struct Mark {
+    int zone;
+    int first;              // Index of the first query in the frame pool
+};
+
+/* The queries of one frame */
+struct Frame {
+    std::vector<GLuint> queries; // The pool, which grows as needed and is reused
+    std::vector<Mark> marks;
+    int used;               // Number of queries used this time
+    int last;               // The query issued last, which the GPU gets to last
+};
+
+// Internal "private" functions
+static void add(History *history, double milliseconds);
+void read(Frame *frame);    // Read the timestamps of a frame, if they are there
+
+std::vector<Zone> zones;
+Frame frames[PROFILER_LATENCY + 1];
+int frame;                  // The frame being made
+int started;                // GL_TRUE between beginFrame() and endFrame()
+std::mutex mutex;           // Guards the CPU times, which may come from any thread
+};
+
+/* Times the GPU work of the commands issued in its scope */
+class GpuZone {
+public:
+GpuZone(Profiler *profiler, int zone) {
+    this->profiler = profiler;
+    this->mark = profiler->beginGpu(zone);
+}
+~GpuZone() {
+    this->profiler->endGpu(this->mark);
+}
+private:
+Profiler *profiler;
+int mark;
+};
+
+/* Times the CPU work in its scope */
+class CpuZone {
+public:
+CpuZone(Profiler *profiler, int zone) {
+    this->profiler = profiler;
+    this->zone = zone;
+    this->start = Utilities::getTime();
+}
+~CpuZone() {
+    this->profiler->addCpu(this->zone, Utilities::getTime() - this->start);
+}
+private:
+Profiler *profiler;
+int zone;
+double start;
+};
+
+#endif // PROFILER_HPP
@@ -0,0 +1,178 @@
+#include "RenderQueue.hpp"
+#include "GLState.hpp"
+
+// Bits of the sort key for each kind of state, from the top down
+#define RENDERQUEUE_PROGRAMBITS 16
+#define RENDERQUEUE_TEXTUREBITS 16
+#define RENDERQUEUE_MESHBITS 16
+#define RENDERQUEUE_DEPTHBITS 16
+
+/* Constructor */
+RenderQueue::RenderQueue(int samplerid, float fardepth) {
+    this->numItems = 0;
+    this->bindsSubmitted = 0;
+    this->bindsIssued = 0;
+    this->triangles = 0;
+    this->samplerID = samplerid;
+    this->farDepth = fardepth;
+    this->sorted = GL_FALSE;
+}
+
+/* Destructor */
+RenderQueue::~RenderQueue() {
+}
+
+
+/*
+ * submit()
+ * Store a draw call and its sort key. Pipelines and meshes are numbered
+ * in the order they are first seen, and textures by their OpenGL name.
+ * Numbers too large for their bits only make the order less good,
+ * since execute() compares the state itself.
+ */
+void RenderQueue::submit(ShaderPipeline *pipeline, GLenum target, GLuint texture, TriangleSoup *mesh, int instances,
+    const void *block, size_t blocksize, float depth) {
+
+    Item item;
+    item.pipeline = pipeline;
+    item.target = target;
+    item.texture = texture;
+    item.mesh = mesh;
+    item.instances = instances;
+    item.block = this->blocks.size();
+    item.blocksize = blocksize;
+    this->blocks.insert(this->blocks.end(), (const unsigned char*)block, (const unsigned char*)block + blocksize);
+
+    unsigned long long depthbucket = 0;
+    if(depth > 0.0f) {
+        float scaled = depth / this->farDepth * (float)((1 << RENDERQUEUE_DEPTHBITS) - 1);
+        depthbucket = scaled < (float)((1 << RENDERQUEUE_DEPTHBITS) - 1) ? (unsigned long long)scaled
+            : (1 << RENDERQUEUE_DEPTHBITS) - 1;
+    }
+    SortEntry entry;
+    entry.key = ((unsigned long long)(this->stateIndex(pipeline) & ((1 << RENDERQUEUE_PROGRAMBITS) - 1))
+            << (RENDERQUEUE_TEXTUREBITS + RENDERQUEUE_MESHBITS + RENDERQUEUE_DEPTHBITS))
+        | ((unsigned long long)(texture & ((1 << RENDERQUEUE_TEXTUREBITS) - 1))
+            << (RENDERQUEUE_MESHBITS + RENDERQUEUE_DEPTHBITS))
+        | ((unsigned long long)(this->stateIndex(mesh) & ((1 << RENDERQUEUE_MESHBITS) - 1))
+            << RENDERQUEUE_DEPTHBITS)
+        | depthbucket;
+    entry.item = (unsigned int)this->items.size();
+    this->order.push_back(entry);
+    this->items.push_back(item);
+    this->sorted = GL_FALSE;
+}
+
+
+/*
+ * sort()
+ * Count the binds the draw calls would need in the order submitted, and
+ * sort them by key. No OpenGL calls are made, so any thread may do this.
+ */
+void RenderQueue::sort() {
+
+    // What the draw calls would have needed in the order they came
+    this->bindsSubmitted = 0;
+    for(size_t i = 0; i < this->items.size(); i++) {
+        const Item &item = this->items[i];
+        const Item *last = (i > 0) ? &this->items[i - 1] : NULL;
+        if(!last || item.pipeline != last->pipeline) this->bindsSubmitted++;
+        if(!last || item.texture != last->texture || item.target != last->target) this->bindsSubmitted++;
+        if(!last || item.mesh != last->mesh) this->bindsSubmitted++;
+    }
+
+    this->sortKeys();
+    this->sorted = GL_TRUE;
+}
+
+
+/*
+ * execute(UniformBuffer *uniforms)
+ * Sort the draw calls by key, unless sort() did, and make them, with each
+ * one's uniform block bound from the UniformBuffer. The queue is then empty.
+ */
+void RenderQueue::execute(UniformBuffer *uniforms) {
+
+    if(!this->sorted) this->sort();
+
+    this->bindsIssued = 0;
+    this->triangles = 0;
+    const Item *last = NULL;
+    for(size_t i = 0; i < this->order.size(); i++) {
+        const Item &item = this->items[this->order[i].item];
+        if(!last || item.pipeline != last->pipeline) {
+            item.pipeline->use();
+            if(this->samplerID >= 0) item.pipeline->setInt(this->samplerID, 0);
+            this->bindsIssued++;
+        }
+        if(!last || item.texture != last->texture || item.target != last->target) {
+            GLState::bindTexture(item.target, item.texture);
+            this->bindsIssued++;
+        }
+        if(!last || item.mesh != last->mesh) {
+            item.mesh->bind();
+            this->bindsIssued++;
+        }
+        uniforms->bind(UNIFORMBLOCK_OBJECT, &this->blocks[item.block], item.blocksize);
+        item.mesh->draw(item.instances);
+        this->triangles += (unsigned long)item.mesh->numTriangles() * item.instances;
+        last = &item;
+    }
+    // The last state is left bound, so the next frame can start without binding it again
+
+    this->numItems = (int)this->items.size();
+    this->items.clear();
+    this->blocks.clear();
+    this->order.clear();
+    this->sorted = GL_FALSE;
+}
+
+
+/*
+ * private
+ * stateIndex(const void *state)
+ * A number for a pipeline or a mesh, the same every frame.
+ */
+unsigned int RenderQueue::stateIndex(const void *state) {
+
+    std::map<const void*, unsigned int>::iterator i = this->indices.find(state);
+    if(i != this->indices.end()) return i->second;
+    unsigned int index = (unsigned int)this->indices.size();
+    this->indices[state] = index;
+    return index;
+}
+
+
+/*
+ * private
+ * sortKeys()
+ * Sort order by key, least significant byte first, with one counting
+ * pass per byte. Bytes that are the same in all keys are skipped, which
+ * is most of them for a small scene. The sort is stable, so draw calls
+ * with the same key stay in the order they were submitted.
+ */
+void RenderQueue::sortKeys() {
+
+    size_t count = this->order.size();
+    if(count < 2) return;
+    this->scratch.resize(count);
+
+    for(int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {0};
+        for(size_t i = 0; i < count; i++) {
+            histogram[(this->order[i].key >> shift) & 0xff]++;
+        }
+        if(histogram[(this->order[0].key >> shift) & 0xff] == count) continue; // All the same
+
+        size_t start = 0;
+        for(int b = 0; b < 256; b++) {
+            size_t n = histogram[b];
+            histogram[b] = start;
+            start += n;
+        }
+        for(size_t i = 0; i < count; i++) {
+            this->scratch[histogram[(this->order[i].key >> shift) & 0xff]++] = this->order[i];
+        }
+        this->order.swap(this->scratch);
+    }
+}
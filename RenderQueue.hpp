@@ -0,0 +1,93 @@
+/* RenderQueue.hpp */
+/* A class to collect the draw calls of a frame, and make them in the order
+ * that needs the fewest changes of program, texture and vertex array. */
+/* Usage: call submit() for each draw call instead of drawing right away,
+ * with everything the draw call needs: the shader pipeline, the texture,
+ * the mesh, the per-object uniform block and the distance from the camera.
+ * Then call execute() once, after the per-frame uniform block is bound.
+ * sort() may be called first, on any thread, so the sorting is done by
+ * then, and execute() only makes the OpenGL calls on the OpenGL thread.
+ * A queue is only for one thread at a time.
+ * Each draw call gets a 64-bit sort key, with from the top down: the
+ * program, the texture, the vertex array and the depth, and the keys are
+ * sorted with a radix sort. Draw calls with the same program are then
+ * next to each other, within those the ones with the same texture, and
+ * so on, and execute() binds only what differs from the draw call before.
+ * Draw calls that share all state are drawn front to back, so the depth
+ * test can skip the fragment shader for what is hidden behind them.
+ * This is for opaque objects only: transparent ones need to be drawn back
+ * to front after them, whatever their state.
+ * bindsSubmitted and bindsIssued tell how many binds the last frame
+ * would have needed in the order submitted, and how many were made. */
+
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <map>
+#include <vector>
+
+#include "ShaderPipeline.hpp"
+#include "TriangleSoup.hpp"
+#include "UniformBuffer.hpp"
+
+class RenderQueue {
+
+public:
+
+int numItems;                   // Draw calls made by the last execute()
+unsigned long triangles;        // Triangles drawn by the last execute(), all instances
+unsigned long bindsSubmitted;   // Binds the last frame needed in submitted order
+unsigned long bindsIssued;      // Binds execute() made, after sorting
+
+/* Constructor. The sampler with ID samplerid (see Shader::uniformID()) is
+ * set to texture unit 0. Depths up to fardepth are told apart. */
+RenderQueue(int samplerid = -1, float fardepth = 100.0f);
+
+/* Destructor */
+~RenderQueue();
+
+// Add a draw call. block is copied, to the object uniform block for the call.
+void submit(ShaderPipeline *pipeline, GLenum target, GLuint texture, TriangleSoup *mesh, int instances,
+    const void *block, size_t blocksize, float depth);
+
+// Sort the draw calls. execute() does it if it's not done.
+void sort();
+
+// Sort and make the draw calls, and empty the queue
+void execute(UniformBuffer *uniforms);
+
+private:
+
+/* A submitted draw call */
+struct Item {
+    ShaderPipeline *pipeline;
+    GLenum target;
+    GLuint texture;
+    TriangleSoup *mesh;
+    int instances;
+    size_t block;               // Start of the uniform block in blocks
+    size_t blocksize;
+};
+
+/* A sort key, and the item it is for */
+struct SortEntry {
+    unsigned long long key;
+    unsigned int item;
+};
+
+// Internal "private" functions
+unsigned int stateIndex(const void *state); // Small number for a pipeline or mesh, for the keys
+void sortKeys();                            // Radix sort of order, by key
+
+std::vector<Item> items;                    // Draw calls in submitted order
+std::vector<unsigned char> blocks;          // Copies of their uniform blocks
+std::vector<SortEntry> order;               // Keys, sorted by execute()
+std::vector<SortEntry> scratch;             // For the radix sort
+std::map<const void*, unsigned int> indices; // From stateIndex()
+int samplerID;
+float farDepth;
+int sorted;                                 // GL_TRUE after sort(), until the next submit()
+
+};
+
+#endif // RENDERQUEUE_HPP
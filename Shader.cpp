@@ -1,4 +1,8 @@
 #include "Shader.hpp"
+#include "GLState.hpp"
+
+#include <cstring> // For memcmp() and strlen()
+#include <sys/stat.h> // For stat(), to see if a shader file was edited
 
 /*
  * Constructor without arguments.
@@ -6,6 +10,17 @@
  */
 Shader::Shader() {
     this->programID = 0;
+    this->pendingID = 0;
+    this->fallbackID = 0;
+    this->fallback = NULL;
+    this->shadowStale = GL_FALSE;
+    this->vertexShader = 0;
+    this->fragmentShader = 0;
+    this->sourcehash = 0;
+    this->fragmentSources = 0;
+    this->hotReload = GL_FALSE;
+    this->separable = GL_FALSE;
+    this->parallelCompile = GL_FALSE;
 }
 
 
@@ -16,6 +31,18 @@ Shader::Shader() {
  * assembles the shader program.
  */
 Shader::Shader(const char *vertexshaderfile, const char *fragmentshaderfile) {
+    this->programID = 0;
+    this->pendingID = 0;
+    this->fallbackID = 0;
+    this->fallback = NULL;
+    this->shadowStale = GL_FALSE;
+    this->vertexShader = 0;
+    this->fragmentShader = 0;
+    this->sourcehash = 0;
+    this->fragmentSources = 0;
+    this->hotReload = GL_FALSE;
+    this->separable = GL_FALSE;
+    this->parallelCompile = GL_FALSE;
     this->createShader(vertexshaderfile, fragmentshaderfile);
 }
 
@@ -25,88 +52,715 @@ Shader::Shader(const char *vertexshaderfile, const char *fragmentshaderfile) {
  * Cleans up by deleting the program if it was compiled.
  */
 Shader::~Shader() {
-    if(programID != 0)
+    if(programID != 0 && programID != fallbackID)
         glDeleteProgram(programID);
+    if(pendingID != 0) { // Still compiling
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        glDeleteProgram(pendingID);
+    }
+}
+
+
+// From KHR_parallel_shader_compile, which older headers don't have
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// How deep includes may be nested, to stop files that include themselves
+#define SHADER_MAXINCLUDEDEPTH 16
+
+// Identifies our program binary cache files, and the version of their layout
+#define SHADER_CACHEMAGIC "GLPRGBN1"
+
+/* Header of a program binary cache file, followed by the binary itself */
+struct ShaderCacheHeader {
+    char magic[8];
+    unsigned long long sourcehash;
+    GLuint format;  // Driver specific binary format from glGetProgramBinary()
+    GLuint length;  // Size of the binary in bytes
+};
+
+
+/*
+ * hashString() - Add a string to a 64-bit FNV-1a hash.
+ * The terminating 0 is included, so "ab","c" and "a","bc" hash differently.
+ */
+static unsigned long long hashString(unsigned long long hash, const char *str) {
+    if(str == NULL) str = "";
+    do {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ULL;
+    } while(*str++);
+    return hash;
+}
+
+
+/*
+ * binariesSupported() - Check for glGetProgramBinary() and glProgramBinary(),
+ * and a driver that has at least one binary format for them.
+ */
+static int binariesSupported() {
+    GLint major = 0, minor = 0, numformats = 0;
+
+#ifdef __WIN32__
+    if(!glGetProgramBinary || !glProgramBinary || !glProgramParameteri) return GL_FALSE;
+#endif
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if(major * 10 + minor < 41 && !Utilities::hasExtension("GL_ARB_get_program_binary")) {
+        return GL_FALSE;
+    }
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numformats);
+    return numformats > 0; // Some drivers have the functions, but no formats
+}
+
+
+// Names of all uniforms that have an ID, in ID order
+static std::vector<std::string> uniformNames;
+
+// Uniform block names and binding points, from bindUniformBlock()
+static std::vector<std::string> blockNames;
+static std::vector<GLuint> blockBindings;
+static std::vector<size_t> blockSizes;      // 0 for any size
+
+// Names and values from define(), for all programs
+static std::vector<std::string> constantNames;
+static std::vector<int> constantValues;
+
+unsigned long Shader::uploadsIssued = 0;
+unsigned long Shader::uploadsElided = 0;
+
+
+/*
+ * uniformComponents() - The number of 4-byte values in a uniform of a type.
+ */
+static int uniformComponents(GLenum type) {
+    switch(type) {
+        case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+            return 2;
+        case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+            return 3;
+        case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4:
+        case GL_FLOAT_MAT2:
+            return 4;
+        case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2:
+            return 6;
+        case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2:
+            return 8;
+        case GL_FLOAT_MAT3:
+            return 9;
+        case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3:
+            return 12;
+        case GL_FLOAT_MAT4:
+            return 16;
+        default: // Scalars and samplers
+            return 1;
+    }
+}
+
+
+/*
+ * fileTime() - The time a file was last modified, or 0 if it can't be read.
+ */
+static long long fileTime(const char *filename) {
+    struct stat filestat;
+    if(stat(filename, &filestat) != 0) return 0;
+    return (long long)filestat.st_mtime;
+}
+
+
+/*
+ * directiveArgument() - If a line is the preprocessor directive with a
+ * name, like "# version 330", the text after the name, otherwise NULL.
+ */
+static const char *directiveArgument(const char *line, const char *name) {
+    size_t length = strlen(name);
+    while(*line == ' ' || *line == '\t') line++;
+    if(*line++ != '#') return NULL;
+    while(*line == ' ' || *line == '\t') line++;
+    if(strncmp(line, name, length) != 0) return NULL;
+    line += length;
+    if(*line != ' ' && *line != '\t' && *line != '"') return NULL;
+    while(*line == ' ' || *line == '\t') line++;
+    return line;
+}
+
+
+/*
+ * sourcesChanged() - Check if any of the files are not as they were read.
+ */
+static int sourcesChanged(const std::vector<std::string> &files, const std::vector<long long> &times) {
+    for(size_t i = 0; i < files.size(); i++) {
+        if(fileTime(files[i].c_str()) != times[i]) return GL_TRUE;
+    }
+    return GL_FALSE;
 }
 
 
 /*
  * createShader() - create, load, compile and link the GLSL Shader objects.
+ * defines are names to #define in both shaders, separated by spaces.
  */
-void Shader::createShader(const char *vertexshaderfile, const char *fragmentshaderfile) {
+void Shader::createShader(const char *vertexshaderfile, const char *fragmentshaderfile, const char *defines) {
+    this->startShader(vertexshaderfile, fragmentshaderfile, defines);
+    this->finishShader();
+}
+
+
+/*
+ * compileAsync() - Start compiling a program, and return at once.
+ * programID is left as it is until update() finds the new program
+ * ready, or set to the fallback program if there is none yet.
+ */
+void Shader::compileAsync(const char *vertexshaderfile, const char *fragmentshaderfile, const Shader *fallback,
+    const char *defines) {
+    if(fallback != NULL && fallback->programID != 0) {
+        if(programID == fallbackID) { // Don't replace a program of our own
+            programID = fallback->programID;
+            reflectUniforms();
+        }
+        fallbackID = fallback->programID;
+        this->fallback = fallback;
+    }
+    this->startShader(vertexshaderfile, fragmentshaderfile, defines);
+}
+
+
+/*
+ * update() - Swap in a program started by compileAsync() if the driver is
+ * done with it, and start compiling the program again if hot reloading is
+ * on and a shader file was edited. Only KHR_parallel_shader_compile lets
+ * us ask the driver if it is done without waiting, so without it,
+ * update() waits for the program the first time it is called.
+ * Returns GL_TRUE if programID changed.
+ */
+int Shader::update() {
+
+    GLint completed = GL_TRUE;
+
+    if(pendingID == 0) {
+        if(hotReload && !sourceFiles.empty() && sourcesChanged(sourceFiles, sourceTimes)) {
+            std::string vertexshaderfile = vertexFile, fragmentshaderfile = fragmentFile, defines = defineList;
+            this->startShader(vertexshaderfile.empty() ? NULL : vertexshaderfile.c_str(),
+                fragmentshaderfile.empty() ? NULL : fragmentshaderfile.c_str(), defines.c_str());
+        }
+        if(pendingID == 0) return GL_FALSE;
+    }
+    if(parallelCompile) {
+        glGetProgramiv(pendingID, GL_COMPLETION_STATUS_KHR, &completed); // The same value for ARB
+    }
+    if(!completed) return GL_FALSE;
+    return this->finishShader();
+}
+
+
+/*
+ * ready() - GL_FALSE while a program is compiling.
+ */
+int Shader::ready() {
+    return pendingID == 0;
+}
+
+
+/*
+ * setHotReload() - Make update() recompile the program when a shader file is saved.
+ */
+void Shader::setHotReload(int reload) {
+    hotReload = reload;
+}
+
+
+/*
+ * warmUp() - Create all programs in a list. All of them are compiled
+ * before any is checked, so a driver that compiles in the background
+ * can do them in parallel. Each program is then used for a draw call
+ * with nothing drawn, because some drivers do the last part of the
+ * compiling only when a program is first drawn with.
+ */
+void Shader::warmUp(Shader *shaders, const char **vertexshaderfiles, const char **fragmentshaderfiles, int count) {
+
+    std::vector<Shader*> list;
+    for(int i = 0; i < count; i++) {
+        list.push_back(&shaders[i]);
+    }
+    if(count > 0) warmUp(&list[0], vertexshaderfiles, fragmentshaderfiles, NULL, count);
+}
+
+void Shader::warmUp(Shader **shaders, const char **vertexshaderfiles, const char **fragmentshaderfiles,
+    const char **defines, int count) {
+
+    GLuint vao;
+    int i;
+
+    for(i = 0; i < count; i++) {
+        shaders[i]->startShader(vertexshaderfiles[i], fragmentshaderfiles[i], defines ? defines[i] : NULL);
+    }
+    for(i = 0; i < count; i++) {
+        shaders[i]->finishShader();
+    }
+
+    glGenVertexArrays(1, &vao); // The core profile needs one bound to draw
+    GLState::bindVertexArray(vao);
+    GLState::enable(GL_RASTERIZER_DISCARD); // Nothing reaches the screen
+    for(i = 0; i < count; i++) {
+        if(shaders[i]->programID != 0) {
+            GLState::useProgram(shaders[i]->programID);
+            glDrawArrays(GL_POINTS, 0, 1);
+        }
+    }
+    GLState::disable(GL_RASTERIZER_DISCARD);
+    GLState::useProgram(0);
+    GLState::bindVertexArray(0);
+    GLState::deleteVertexArrays(1, &vao);
+}
+
+
+/*
+ * bindUniformBlock() - Add a uniform block to set the binding point of
+ * in each program linked from now on.
+ */
+void Shader::bindUniformBlock(const char *name, GLuint binding, size_t size) {
+    for(size_t i = 0; i < blockNames.size(); i++) {
+        if(blockNames[i] == name) {
+            blockBindings[i] = binding;
+            blockSizes[i] = size;
+            return;
+        }
+    }
+    blockNames.push_back(name);
+    blockBindings.push_back(binding);
+    blockSizes.push_back(size);
+}
+
+
+/*
+ * define() - Add a name and value to #define in every shader read from
+ * now on, or change the value of one already there.
+ */
+void Shader::define(const char *name, int value) {
+    for(size_t i = 0; i < constantNames.size(); i++) {
+        if(constantNames[i] == name) {
+            constantValues[i] = value;
+            return;
+        }
+    }
+    constantNames.push_back(name);
+    constantValues.push_back(value);
+}
+
+
+/*
+ * uniformID() - Get the ID for a uniform name, adding it if it is new.
+ * Call it once for each name at startup, not for every frame.
+ */
+int Shader::uniformID(const char *name) {
+    for(size_t i = 0; i < uniformNames.size(); i++) {
+        if(uniformNames[i] == name) return (int)i;
+    }
+    uniformNames.push_back(name);
+    return (int)uniformNames.size() - 1;
+}
+
+
+/*
+ * readSourceText() - Read a shader file with its includes in place.
+ * Returns GL_FALSE if a file can't be read.
+ */
+int Shader::readSourceText(const char *filename, std::string &source) {
+    Shader reader; // Only for its list of files
+    return reader.expandSource(filename, source, 0, 0);
+}
+
+
+/*
+ * Typed setters. Each one makes its glUniform*() call only if the value
+ * differs from the last one set. Separable programs are set with
+ * glProgramUniform*(), since they are not in use by glUseProgram().
+ */
+void Shader::setInt(int id, GLint value) {
+    const Uniform *u = changedUniform(id, &value, sizeof(value));
+    if(u && separable) glProgramUniform1i(programID, u->location, value);
+    else if(u) glUniform1i(u->location, value);
+}
+
+void Shader::setFloat(int id, GLfloat value) {
+    const Uniform *u = changedUniform(id, &value, sizeof(value));
+    if(u && separable) glProgramUniform1f(programID, u->location, value);
+    else if(u) glUniform1f(u->location, value);
+}
+
+void Shader::setFloats(int id, const GLfloat *values, int count) {
+    const Uniform *u = changedUniform(id, values, count * sizeof(GLfloat));
+    if(u && separable) glProgramUniform1fv(programID, u->location, count, values);
+    else if(u) glUniform1fv(u->location, count, values);
+}
+
+void Shader::setVec3(int id, const GLfloat *value) {
+    const Uniform *u = changedUniform(id, value, 3 * sizeof(GLfloat));
+    if(u && separable) glProgramUniform3fv(programID, u->location, 1, value);
+    else if(u) glUniform3fv(u->location, 1, value);
+}
+
+void Shader::setVec4(int id, const GLfloat *value) {
+    const Uniform *u = changedUniform(id, value, 4 * sizeof(GLfloat));
+    if(u && separable) glProgramUniform4fv(programID, u->location, 1, value);
+    else if(u) glUniform4fv(u->location, 1, value);
+}
+
+void Shader::setMatrix4(int id, const GLfloat *M, int count) {
+    const Uniform *u = changedUniform(id, M, count * 16 * sizeof(GLfloat));
+    if(u && separable) glProgramUniformMatrix4fv(programID, u->location, count, GL_FALSE, M);
+    else if(u) glUniformMatrix4fv(u->location, count, GL_FALSE, M);
+}
+
+
+/*
+ * private
+ * reflectUniforms() - List the active uniforms of programID, and make
+ * room for a copy of their values. Uniforms in uniform blocks have no
+ * location and are left out. Array names are listed without "[0]".
+ * The uniform blocks are set to their binding points here as well, and
+ * their sizes are checked. Both sizes are rounded up to whole vec4s, as
+ * drivers don't agree on whether the std140 size of a block ends with
+ * the padding after its last member.
+ */
+void Shader::reflectUniforms() {
+
+    GLint count = 0;
+    char name[256];
+
+    uniforms.clear();
+    values.clear();
+    uniformSlots.assign(uniformNames.size(), -1);
+    if(programID == 0) return;
+
+    for(size_t i = 0; i < blockNames.size(); i++) {
+        GLuint index = glGetUniformBlockIndex(programID, blockNames[i].c_str());
+        if(index == GL_INVALID_INDEX) continue;
+        glUniformBlockBinding(programID, index, blockBindings[i]);
+        if(blockSizes[i] > 0) {
+            GLint size = 0;
+            glGetActiveUniformBlockiv(programID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            if(((size_t)size + 15) / 16 != (blockSizes[i] + 15) / 16) {
+                char message[256];
+                snprintf(message, sizeof(message), "Uniform block %s is %d bytes in the shader, but %d in C++",
+                    blockNames[i].c_str(), (int)size, (int)blockSizes[i]);
+                Utilities::printError("Shader error", message);
+            }
+        }
+    }
+
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+    for(GLint i = 0; i < count; i++) {
+        Uniform u;
+        GLsizei length = 0;
+        glGetActiveUniform(programID, i, sizeof(name), &length, &u.size, &u.type, name);
+        u.location = glGetUniformLocation(programID, name);
+        if(u.location < 0) continue; // In a uniform block, or a built-in
+        if(length > 3 && strcmp(name + length - 3, "[0]") == 0) name[length - 3] = '\0';
+
+        int id = uniformID(name);
+        if(id >= (int)uniformSlots.size()) uniformSlots.resize(id + 1, -1);
+        uniformSlots[id] = (int)uniforms.size();
+        u.offset = values.size();
+        u.bytes = uniformComponents(u.type) * u.size * 4;
+        u.known = 0;
+        values.resize(u.offset + u.bytes);
+        uniforms.push_back(u);
+    }
+}
+
+
+/*
+ * private
+ * changedUniform() - Find the uniform with an ID, and compare a new value
+ * with the one it has. Returns the uniform if it needs a glUniform*() call,
+ * and NULL if it doesn't, or if it is not active in this program.
+ * A program borrowed from a fallback Shader is set by both Shaders, so
+ * neither shadow copy can be trusted: while we borrow it, every value is
+ * set, and the Shaders that own it forget what they have set.
+ */
+const Shader::Uniform *Shader::changedUniform(int id, const void *value, size_t bytes) {
+
+    if(shadowStale) {
+        for(size_t i = 0; i < uniforms.size(); i++) uniforms[i].known = 0;
+        shadowStale = GL_FALSE;
+    }
+    if(id < 0 || id >= (int)uniformSlots.size() || uniformSlots[id] < 0) return NULL;
+    Uniform *u = &uniforms[uniformSlots[id]];
+    if(bytes > u->bytes) bytes = u->bytes; // OpenGL ignores elements past the end of an array
+    unsigned char *shadow = &values[u->offset];
+    int borrowed = (fallbackID != 0 && programID == fallbackID);
+    if(!borrowed && bytes <= u->known && memcmp(shadow, value, bytes) == 0) {
+        uploadsElided++;
+        return NULL;
+    }
+    memcpy(shadow, value, bytes); // Values are always set from the start of an array
+    if(bytes > u->known) u->known = bytes;
+    for(const Shader *s = fallback; borrowed && s && s->programID == programID; s = s->fallback) {
+        s->shadowStale = GL_TRUE;
+    }
+    uploadsIssued++;
+    return u;
+}
+
+
+/*
+ * private
+ * startShader() - Load the sources, and create the program from the cache
+ * if it is up to date. Otherwise start compiling and linking the program,
+ * without waiting for the driver to finish.
+ */
+void Shader::startShader(const char *vertexshaderfile, const char *fragmentshaderfile, const char *defines) {
 
-    GLuint programObject;
-    GLuint vertexShader;
-    GLuint fragmentShader;
     const char *vertexShaderStrings[1];
     const char *fragmentShaderStrings[1];
 	unsigned char *vertexShaderAssembly;
 	unsigned char *fragmentShaderAssembly;
+    GLuint programObject;
+    int binaries = binariesSupported();
+
+    parallelCompile = Utilities::hasExtension("GL_KHR_parallel_shader_compile")
+        || Utilities::hasExtension("GL_ARB_parallel_shader_compile");
+
+    // If a program is already compiling, drop it. The current one stays until the new one is done.
+    if(pendingID != 0) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        glDeleteProgram(pendingID);
+    }
+    pendingID = 0;
+    vertexShader = 0;
+    fragmentShader = 0;
+
+    // Remember the files, and the times of all files as they are read, for hot reloading
+    vertexFile = vertexshaderfile ? vertexshaderfile : "";
+    fragmentFile = fragmentshaderfile ? fragmentshaderfile : "";
+    defineList = defines ? defines : "";
+    separable = (vertexshaderfile == NULL || fragmentshaderfile == NULL);
+    sourceFiles.clear();
+    sourceTimes.clear();
+
+    vertexShaderAssembly = vertexshaderfile ? readSource(vertexshaderfile) : NULL;
+    fragmentSources = sourceFiles.size();
+    fragmentShaderAssembly = fragmentshaderfile ? readSource(fragmentshaderfile) : NULL;
+
+    // The cache is named after the files and the defines, and only valid for the same sources and driver
+    if(vertexshaderfile && fragmentshaderfile) {
+        const char *fragmentname = fragmentshaderfile + strlen(fragmentshaderfile);
+        while(fragmentname > fragmentshaderfile && fragmentname[-1] != '/' && fragmentname[-1] != '\\')
+            fragmentname--;
+        cachefile = std::string(vertexshaderfile) + "." + fragmentname;
+    }
+    else { // A separable program, named after its one file
+        cachefile = vertexshaderfile ? vertexshaderfile : fragmentshaderfile;
+    }
+    if(!defineList.empty()) { // One file per variant, so they don't replace each other
+        char variant[32];
+        snprintf(variant, sizeof(variant), ".%016llx", hashString(0xcbf29ce484222325ULL, defineList.c_str()));
+        cachefile += variant;
+    }
+    cachefile += ".bin";
+    sourcehash = 0xcbf29ce484222325ULL; // FNV-1a offset basis
+    sourcehash = hashString(sourcehash, (char*)vertexShaderAssembly);
+    sourcehash = hashString(sourcehash, (char*)fragmentShaderAssembly);
+    sourcehash = hashString(sourcehash, (const char*)glGetString(GL_VENDOR));
+    sourcehash = hashString(sourcehash, (const char*)glGetString(GL_RENDERER));
+    sourcehash = hashString(sourcehash, (const char*)glGetString(GL_VERSION));
+
+    if(binaries && (vertexShaderAssembly || !vertexshaderfile) && (fragmentShaderAssembly || !fragmentshaderfile)
+        && loadBinary()) {
+        delete[] vertexShaderAssembly;
+        delete[] fragmentShaderAssembly;
+        return;
+    }
+
+    // Create the vertex shader.
+    if(vertexshaderfile) {
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        if(vertexShaderAssembly) { // Don't try to use a NULL pointer
+            vertexShaderStrings[0] = (char*)vertexShaderAssembly;
+            glShaderSource(vertexShader, 1, vertexShaderStrings, NULL);
+            glCompileShader(vertexShader);
+            delete[] vertexShaderAssembly;
+        }
+    }
+
+  	// Create the fragment shader.
+    if(fragmentshaderfile) {
+        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        if(fragmentShaderAssembly) { // Don't try to use a NULL pointer
+        	fragmentShaderStrings[0] = (char*)fragmentShaderAssembly;
+            glShaderSource(fragmentShader, 1, fragmentShaderStrings, NULL);
+            glCompileShader(fragmentShader);
+            delete[] fragmentShaderAssembly;
+        }
+    }
+
+    // Create a program object and attach the shaders.
+    programObject = glCreateProgram();
+    if(vertexShader != 0) glAttachShader(programObject, vertexShader);
+    if(fragmentShader != 0) glAttachShader(programObject, fragmentShader);
+    if(separable) { // May be used with stages of other programs
+        glProgramParameteri(programObject, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    }
+    if(binaries) { // Ask the driver to keep the binary around for us
+        glProgramParameteri(programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Link the program object. (Linking a program with failed shaders just fails.)
+    glLinkProgram(programObject);
+
+	pendingID = programObject; // finishShader() moves it to programID
+}
+
+
+/*
+ * private
+ * finishShader() - Wait for the compiling and linking started by
+ * startShader(), print any errors, and save the program in the cache.
+ * The new program replaces the current one if it linked. If it didn't,
+ * the current program is kept, so a typo while hot reloading leaves the
+ * last working version running. Returns GL_TRUE if programID changed.
+ */
+int Shader::finishShader() {
 
     GLint vertexCompiled;
     GLint fragmentCompiled;
-    GLint shadersLinked;
+    GLint shadersLinked = GL_TRUE;
     char str[4096]; // For error messages from the GLSL compiler and linker
 
-    // If a program is already stored in this object, delete it
-    if(programID != 0)
-        glDeleteProgram(programID);
+    if(pendingID == 0) return GL_FALSE; // Already finished
 
-    // Create the vertex shader.
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    if(vertexShader != 0 || fragmentShader != 0) { // Compiled, not loaded from the cache
+        if(vertexShader != 0) {
+            glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &vertexCompiled);
+            if(vertexCompiled  == GL_FALSE)
+            {
+                glGetShaderInfoLog(vertexShader, sizeof(str), NULL, str);
+                printError("Vertex shader compile error", str);
+                printSources(0, fragmentSources);
+            }
+        }
 
-    vertexShaderAssembly = readShaderFile(vertexshaderfile);
-    if(vertexShaderAssembly) { // Don't try to use a NULL pointer
-        vertexShaderStrings[0] = (char*)vertexShaderAssembly;
-        glShaderSource(vertexShader, 1, vertexShaderStrings, NULL);
-        glCompileShader(vertexShader);
-        delete[] vertexShaderAssembly;
+        if(fragmentShader != 0) {
+            glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &fragmentCompiled);
+            if(fragmentCompiled == GL_FALSE)
+            {
+                glGetShaderInfoLog(fragmentShader, sizeof(str), NULL, str);
+                printError("Fragment shader compile error", str);
+                printSources(fragmentSources, sourceFiles.size());
+            }
+        }
+
+        glGetProgramiv(pendingID, GL_LINK_STATUS, &shadersLinked);
+        if(shadersLinked == GL_FALSE)
+        {
+            glGetProgramInfoLog( pendingID, sizeof(str), NULL, str );
+            printError("Program object linking error", str);
+        }
+        glDeleteShader(vertexShader);   // After successful linking,
+        glDeleteShader(fragmentShader); // these are no longer needed (0 is ignored)
+        vertexShader = 0;
+        fragmentShader = 0;
+
+        if(shadersLinked == GL_TRUE && binariesSupported()) {
+            saveBinary();
+        }
     }
 
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS,
-                               &vertexCompiled);
-    if(vertexCompiled  == GL_FALSE)
-  	{
-        glGetShaderInfoLog(vertexShader, sizeof(str), NULL, str);
-        printError("Vertex shader compile error", str);
-  	}
+    if(shadersLinked == GL_FALSE && programID != 0) {
+        printError("Shader error", "Keeping the previous program");
+        glDeleteProgram(pendingID);
+        pendingID = 0;
+        return GL_FALSE;
+    }
+    if(programID != 0 && programID != fallbackID)
+        glDeleteProgram(programID);
+    programID = pendingID; // Save this value in the class variable
+    pendingID = 0;
+    reflectUniforms();
+    return GL_TRUE;
+}
 
-  	// Create the fragment shader.
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
-    fragmentShaderAssembly = readShaderFile(fragmentshaderfile);
-    if(fragmentShaderAssembly) { // Don't try to use a NULL pointer
-    	fragmentShaderStrings[0] = (char*)fragmentShaderAssembly;
-        glShaderSource(fragmentShader, 1, fragmentShaderStrings, NULL);
-        glCompileShader(fragmentShader);
-        delete[] fragmentShaderAssembly;
+/*
+ * private
+ * loadBinary() - Create the program from the cache file, if the file is
+ * there, was made from the same sources and driver, and the driver
+ * accepts it. Returns GL_TRUE if it worked, GL_FALSE to compile instead.
+ */
+int Shader::loadBinary() {
+
+    Utilities::MappedFile file;
+    const ShaderCacheHeader *header;
+    GLint linked = GL_FALSE;
+
+    if(!Utilities::mapFile(cachefile.c_str(), &file)) return GL_FALSE; // No cache yet
+    header = (const ShaderCacheHeader*)file.data;
+    if(file.size < sizeof(ShaderCacheHeader)
+        || memcmp(header->magic, SHADER_CACHEMAGIC, sizeof(header->magic)) != 0
+        || header->sourcehash != sourcehash
+        || file.size != sizeof(ShaderCacheHeader) + header->length) {
+        Utilities::unmapFile(&file); // Out of date, or not ours
+        return GL_FALSE;
     }
 
-    glGetProgramiv(fragmentShader, GL_COMPILE_STATUS, &fragmentCompiled);
-    if(fragmentCompiled == GL_FALSE)
-   	{
-        glGetShaderInfoLog(fragmentShader, sizeof(str), NULL, str);
-        printError("Fragment shader compile error", str);
+    pendingID = glCreateProgram();
+    if(separable) glProgramParameteri(pendingID, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    glProgramBinary(pendingID, header->format, file.data + sizeof(ShaderCacheHeader), header->length);
+    Utilities::unmapFile(&file);
+    glGetProgramiv(pendingID, GL_LINK_STATUS, &linked);
+    if(linked == GL_FALSE) { // The driver may reject binaries for any reason
+        glDeleteProgram(pendingID);
+        pendingID = 0;
+        return GL_FALSE;
     }
+    return GL_TRUE;
+}
 
-    // Create a program object and attach the two compiled shaders.
-    programObject = glCreateProgram();
-    glAttachShader(programObject, vertexShader);
-    glAttachShader(programObject, fragmentShader);
 
-    // Link the program object and print out the info log.
-    glLinkProgram(programObject);
-    glGetProgramiv(programObject, GL_LINK_STATUS, &shadersLinked);
+/*
+ * private
+ * saveBinary() - Write the linked program to the cache file. It is
+ * written to a temporary file first and then renamed, so that a
+ * program that is started meanwhile never reads half a file.
+ */
+void Shader::saveBinary() {
+
+    ShaderCacheHeader header;
+    GLint length = 0;
+    GLenum format = 0;
+    std::string tempfile = cachefile + ".tmp";
 
-    if(shadersLinked == GL_FALSE)
-	{
-		glGetProgramInfoLog( programObject, sizeof(str), NULL, str );
-		printError("Program object linking error", str);
-	}
-	glDeleteShader(vertexShader);   // After successful linking,
-	glDeleteShader(fragmentShader); // these are no longer needed
+    glGetProgramiv(pendingID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0) return;
+    unsigned char *binary = new unsigned char[length];
+    glGetProgramBinary(pendingID, length, &length, &format, binary);
 
-	programID = programObject; // Save this value in the class variable
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SHADER_CACHEMAGIC, sizeof(header.magic));
+    header.sourcehash = sourcehash;
+    header.format = format;
+    header.length = length;
+
+    int ok = GL_FALSE;
+    FILE *file = fopen(tempfile.c_str(), "wb");
+    if(file != NULL) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(binary, 1, length, file) == (size_t)length;
+        ok = (fclose(file) == 0) && ok;
+    }
+    if(ok) {
+        remove(cachefile.c_str()); // rename() doesn't replace existing files in Windows
+        ok = rename(tempfile.c_str(), cachefile.c_str()) == 0;
+    }
+    if(!ok) {
+        remove(tempfile.c_str());
+        printError("Shader cache error", "Could not write the program binary cache file");
+    }
+    delete[] binary;
 }
 
 
@@ -157,3 +811,131 @@ unsigned char* Shader::readShaderFile(const char *filename) {
 
     return buffer;
 }
+
+
+/*
+ * private
+ * readSource(filename) - read a shader file, with the files it includes
+ * in their places, and the defines added after the #version line.
+ * Returns a string allocated with new[], or NULL if a file is missing.
+ */
+unsigned char* Shader::readSource(const char *filename) {
+
+    std::string source;
+    size_t first = sourceFiles.size();
+    if(!expandSource(filename, source, first, 0)) return NULL;
+
+    // #version must come first, so the defines go right after it, or first of all if there is none
+    std::string defines;
+    for(size_t i = 0; i < constantNames.size(); i++) {
+        char value[16];
+        snprintf(value, sizeof(value), " %d\n", constantValues[i]);
+        defines += "#define " + constantNames[i] + value;
+    }
+    const char *names = defineList.c_str();
+    while(*names) {
+        size_t length = strcspn(names, " \t");
+        if(length > 0) defines += "#define " + std::string(names, length) + " 1\n";
+        names += length;
+        names += strspn(names, " \t");
+    }
+    if(!defines.empty()) {
+        size_t start = 0, line = 1;
+        int found = GL_FALSE;
+        while(start < source.size()) {
+            size_t end = source.find('\n', start);
+            if(end == std::string::npos) end = source.size();
+            if(directiveArgument(source.c_str() + start, "version")) {
+                start = end + 1;
+                found = GL_TRUE;
+                break;
+            }
+            start = end + 1;
+            line++;
+        }
+        if(!found) { // No #version line
+            start = 0;
+            line = 0;
+        }
+        if(start > source.size()) start = source.size(); // A #version line with no newline
+        char number[32];
+        snprintf(number, sizeof(number), "#line %d 0\n", (int)line + 1);
+        source.insert(start, defines + number); // Keep the line numbers of the file
+    }
+
+    unsigned char *buffer = new unsigned char[source.size() + 1];
+    memcpy(buffer, source.c_str(), source.size() + 1);
+    return buffer;
+}
+
+
+/*
+ * private
+ * expandSource(filename, source, first, depth) - add a shader file to a
+ * source string, replacing each #include "file" with that file. Included
+ * files are read from the folder of the file that includes them. #line
+ * directives keep the lines numbered as in each file, with the number of
+ * the file in sourceFiles (counted from first) as the GLSL source string
+ * number. Returns GL_FALSE if a file can't be read.
+ */
+int Shader::expandSource(const char *filename, std::string &source, size_t first, int depth) {
+
+    if(depth > SHADER_MAXINCLUDEDEPTH) {
+        printError("Shader include error", "Includes nested too deep (does a file include itself?)");
+        return GL_FALSE;
+    }
+    int filenumber = (int)(sourceFiles.size() - first);
+    sourceFiles.push_back(filename);
+    sourceTimes.push_back(fileTime(filename));
+    unsigned char *text = readShaderFile(filename);
+    if(text == NULL) return GL_FALSE;
+
+    std::string folder = filename;
+    size_t slash = folder.find_last_of("/\\");
+    folder = (slash == std::string::npos) ? "" : folder.substr(0, slash + 1);
+
+    const char *line = (const char*)text;
+    int linenumber = 1;
+    int ok = GL_TRUE;
+    char number[32];
+    while(*line && ok) {
+        size_t length = strcspn(line, "\n");
+        const char *argument = directiveArgument(line, "include");
+        if(argument == NULL) {
+            source.append(line, length);
+            source += '\n';
+        }
+        else {
+            const char *end = (*argument == '"') ? strchr(argument + 1, '"') : NULL;
+            if(end == NULL || end > line + length) {
+                printError("Shader include error", "Expected #include \"file\"");
+                ok = GL_FALSE;
+                break;
+            }
+            std::string include = folder + std::string(argument + 1, end - argument - 1);
+            snprintf(number, sizeof(number), "#line 1 %d\n", (int)(sourceFiles.size() - first));
+            source += number;
+            ok = expandSource(include.c_str(), source, first, depth + 1);
+            snprintf(number, sizeof(number), "#line %d %d\n", linenumber + 1, filenumber);
+            source += number;
+        }
+        line += length;
+        if(*line == '\n') line++;
+        linenumber++;
+    }
+    delete[] text;
+    return ok;
+}
+
+
+/*
+ * private
+ * printSources(first, last) - list which file has which number in the
+ * error messages from a shader, if it was made from more than one file.
+ */
+void Shader::printSources(size_t first, size_t last) {
+    if(last - first < 2) return;
+    for(size_t i = first; i < last; i++) {
+        fprintf(stderr, "  File %d: %s\n", (int)(i - first), sourceFiles[i].c_str());
+    }
+}
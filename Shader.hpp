@@ -2,7 +2,50 @@
 /* A class to load and compile GLSL shaders from files. */
 /* Usage: call createShader() to load and compile a program object,
  * or use the constructor with two file name arguments.
- * Call glUseProgram() with the public member programID as argument. */
+ * Call GLState::useProgram() with the public member programID as argument,
+ * or ShaderPipeline::use() for separable programs (see GLState.hpp). */
+/* Linked programs are cached on disk with glGetProgramBinary(), if the driver
+ * supports it, in a file next to the vertex shader named after both shader
+ * files. The cache is used only if the source text and the driver (vendor,
+ * renderer and version) are the same as when it was written, so edits and
+ * driver updates are picked up. If the driver rejects a cached binary, the
+ * program is compiled from source as usual, and the cache is rewritten.
+ * Call warmUp() at startup with all the programs you need, to compile them
+ * together (which lets the driver do it in parallel) and make the driver
+ * finish any compiling it otherwise leaves for the first draw call. */
+/* To compile without stopping the render loop, call compileAsync() and
+ * then update() once per frame. The driver compiles in the background
+ * (in parallel for several programs, with KHR_parallel_shader_compile),
+ * and programID keeps the previous program, or a fallback program, until
+ * the new one is ready. With setHotReload(), update() also recompiles the
+ * program when a shader file is saved. Whenever update() returns GL_TRUE,
+ * programID has changed, and uniform locations must be looked up again.
+ * A fallback Shader has to outlive the Shaders that borrow its program. */
+/* Uniforms can be set without looking them up: get an ID for each name once
+ * with uniformID(), and pass it to setFloat(), setMatrix4() and the like
+ * while the program is in use. The IDs are the same for all programs and
+ * stay valid when a program is reloaded. The active uniforms of a program
+ * are listed when it is linked, and the last value set for each is kept,
+ * so setting a uniform to the value it already has makes no OpenGL call
+ * (except in a program borrowed from a fallback, which two Shaders set).
+ * uploadsIssued and uploadsElided count the calls made and skipped.
+ * Uniform blocks named with bindUniformBlock() are set to their binding
+ * points when a program is linked, since GLSL 3.30 can't do that itself.
+ * If a block is given the size of its C++ struct, a program with a block
+ * of another size is reported as an error. */
+/* Shader files may include other files with #include "file", relative to
+ * the file with the #include. A list of names can be given as defines,
+ * to be #defined (as 1) right after the #version line of both shaders, so
+ * one source can be compiled into variants with #ifdef. Constants that
+ * C++ and GLSL share, like array sizes, can be given once to define(),
+ * for all programs. ShaderVariants keeps the variants of a pair of files
+ * (see ShaderVariants.hpp). Errors report lines as file:line, with files
+ * numbered in the order they were read, and the numbers are listed after
+ * the error. Included files are also watched for hot reloading. */
+/* Either file may be NULL, to make a separable program with only the
+ * other stage, for a program pipeline that mixes stages of different
+ * programs (see ShaderPipeline.hpp). The setters then work whether or not
+ * the program is in use. */
 /* Stefan Gustavson (stefan.gustavson@liu.se) 2014-03-27 */
 
 #ifndef SHADER_HPP // Avoid including this header twice
@@ -19,6 +62,8 @@
 #include <GLFW/glfw3.h>
 #include "Utilities.hpp" // For OpenGL extensions in Windows
 #include <cstdio>
+#include <string>
+#include <vector>
 
 class Shader {
 
@@ -37,11 +82,136 @@ Shader(const char *vertexshaderfile, const char *fragmentshaderfile);
 
 /*
  * createShader() - create, load, compile and link the GLSL shader objects.
+ * With one file NULL, the program is separable, with only the other stage.
  */
-void createShader(const char *vertexshaderfile, const char *fragmentshaderfile);
+void createShader(const char *vertexshaderfile, const char *fragmentshaderfile, const char *defines = NULL);
+
+/*
+ * warmUp() - create a list of programs, one from each pair of shader files,
+ * and make sure they are ready to draw with, so no draw call has to wait.
+ */
+static void warmUp(Shader *shaders, const char **vertexshaderfiles, const char **fragmentshaderfiles, int count);
+static void warmUp(Shader **shaders, const char **vertexshaderfiles, const char **fragmentshaderfiles,
+    const char **defines, int count); // For scattered programs, with defines (NULL for none)
+
+/*
+ * compileAsync() - start compiling a program without waiting for it.
+ * Until it is ready, programID is the previous program, or fallback's.
+ */
+void compileAsync(const char *vertexshaderfile, const char *fragmentshaderfile, const Shader *fallback = NULL,
+    const char *defines = NULL);
+
+/*
+ * update() - swap in a finished program, and check for edited files if
+ * hot reloading is on. Call once per frame. GL_TRUE if programID changed.
+ */
+int update();
+
+/*
+ * ready() - check if the last program asked for is compiled
+ */
+int ready();
+
+/*
+ * setHotReload() - turn recompiling on edits of the shader files on or off
+ */
+void setHotReload(int reload);
+
+/*
+ * bindUniformBlock() - make all programs created from now on use a
+ * binding point for the uniform block with a name (see UniformBuffer.hpp),
+ * and check that the block has a size in bytes, unless size is 0
+ */
+static void bindUniformBlock(const char *name, GLuint binding, size_t size = 0);
+
+/*
+ * define() - #define a name to a value in all shaders read from now on,
+ * before the defines of each program
+ */
+static void define(const char *name, int value);
+
+/*
+ * readSourceText() - read a shader file with its includes, as the
+ * compiler gets it, but without any defines
+ */
+static int readSourceText(const char *filename, std::string &source);
+
+/*
+ * uniformID() - get the ID for a uniform name, for the setters below
+ */
+static int uniformID(const char *name);
+
+/*
+ * Typed setters for uniforms of the program in use. Uniforms that are not
+ * active in the program are ignored. Arrays are set from their first
+ * element, as with glUniform*v(), and count is the number of elements.
+ */
+void setInt(int id, GLint value); // Also for samplers
+void setFloat(int id, GLfloat value);
+void setFloats(int id, const GLfloat *values, int count);
+void setVec3(int id, const GLfloat *value);
+void setVec4(int id, const GLfloat *value);
+void setMatrix4(int id, const GLfloat *M, int count = 1);
+
+/* Number of glUniform*() calls made and skipped by the setters, for all programs */
+static unsigned long uploadsIssued;
+static unsigned long uploadsElided;
 
 private:
 
+GLuint pendingID;       // Program being compiled, 0 when done
+GLuint fallbackID;      // Program of another Shader, used until ours is ready
+const Shader *fallback; // The Shader that fallbackID came from
+mutable int shadowStale; // A Shader that borrows our program has set uniforms in it
+GLuint vertexShader;    // Shaders being compiled for pendingID
+GLuint fragmentShader;
+std::string vertexFile; // Shader files
+std::string fragmentFile;
+std::string defineList; // Names to #define, separated by spaces
+std::vector<std::string> sourceFiles; // All files read, includes too, and their times when they were read
+std::vector<long long> sourceTimes;
+size_t fragmentSources; // Index of the first file of the fragment shader in sourceFiles
+int hotReload;
+int separable;          // Only one stage, for a program pipeline
+int parallelCompile;    // The driver can tell if it is done compiling
+std::string cachefile;  // Program binary cache file
+unsigned long long sourcehash; // Hash of the source text and the driver
+
+/* An active uniform of programID, with the last value set for it */
+struct Uniform {
+    GLint location;
+    GLenum type;        // As from glGetActiveUniform()
+    GLint size;         // Number of array elements, 1 if not an array
+    size_t offset;      // Start of the value in values
+    size_t bytes;       // Size of the whole value
+    size_t known;       // Bytes from the start that have been set (the initial value is unknown)
+};
+std::vector<Uniform> uniforms;  // Active uniforms
+std::vector<int> uniformSlots;  // Index in uniforms for each uniformID(), -1 if not active
+std::vector<unsigned char> values; // Shadow copy of all uniform values
+
+/*
+ * reflectUniforms() - list the active uniforms of programID
+ * changedUniform() - check a new value against the shadow copy, and store it
+ */
+void reflectUniforms();
+const Uniform *changedUniform(int id, const void *value, size_t bytes);
+
+/*
+ * startShader() - load a program from the cache, or start compiling it.
+ * finishShader() - check the compiling and linking, update the cache,
+ * and replace programID if the new program works.
+ */
+void startShader(const char *vertexshaderfile, const char *fragmentshaderfile, const char *defines);
+int finishShader();
+
+/*
+ * loadBinary() - try to create the program from the cache file
+ * saveBinary() - write the linked program to the cache file
+ */
+int loadBinary();
+void saveBinary();
+
 /*
  * Override the Win32 filelength() function with
  * a version that takes a Unix-style file handle as
@@ -55,6 +225,15 @@ long filelength(FILE *file);
  */
 unsigned char* readShaderFile(const char *filename);
 
+/*
+ * readSource() - read a shader file with its includes, and add the defines
+ * expandSource() - add a file to a source string, reading its includes in place
+ * printSources() - list the numbers of the files of a shader, for error messages
+ */
+unsigned char* readSource(const char *filename);
+int expandSource(const char *filename, std::string &source, size_t first, int depth);
+void printSources(size_t first, size_t last);
+
 void printError(const char *errtype, const char *errmsg);
 
 };
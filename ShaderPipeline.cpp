@@ -0,0 +1,123 @@
+#include "ShaderPipeline.hpp"
+#include "GLState.hpp"
+
+/* Constructor for a pipeline of two separable programs */
+ShaderPipeline::ShaderPipeline(Shader *vertexstage, Shader *fragmentstage) {
+    this->vertexStage = vertexstage;
+    this->fragmentStage = fragmentstage;
+    this->program = NULL;
+    glGenProgramPipelines(1, &(this->pipelineID));
+    this->attach();
+}
+
+/* Constructor for an ordinary program */
+ShaderPipeline::ShaderPipeline(Shader *program) {
+    this->pipelineID = 0;
+    this->vertexStage = NULL;
+    this->fragmentStage = NULL;
+    this->program = program;
+}
+
+/* Destructor */
+ShaderPipeline::~ShaderPipeline() {
+    if(this->pipelineID != 0) GLState::deleteProgramPipelines(1, &(this->pipelineID));
+    delete this->program;
+}
+
+
+/*
+ * use()
+ * Bind the pipeline, or use the program. A program in use would override
+ * the bound pipeline, so glUseProgram(0) comes first.
+ */
+void ShaderPipeline::use() {
+    if(this->pipelineID != 0) {
+        GLState::useProgram(0);
+        GLState::bindProgramPipeline(this->pipelineID);
+    }
+    else {
+        GLState::useProgram(this->program->programID);
+    }
+}
+
+
+/*
+ * attach()
+ * Set the stages of the pipeline to the programs of the stage Shaders,
+ * which change when they are recompiled.
+ */
+void ShaderPipeline::attach() {
+    if(this->pipelineID == 0) return;
+    glUseProgramStages(this->pipelineID, GL_VERTEX_SHADER_BIT, this->vertexStage->programID);
+    glUseProgramStages(this->pipelineID, GL_FRAGMENT_SHADER_BIT, this->fragmentStage->programID);
+}
+
+
+/*
+ * Setters. Each Shader ignores the uniforms it doesn't have.
+ */
+void ShaderPipeline::setInt(int id, GLint value) {
+    if(this->program) this->program->setInt(id, value);
+    else {
+        this->vertexStage->setInt(id, value);
+        this->fragmentStage->setInt(id, value);
+    }
+}
+
+void ShaderPipeline::setFloat(int id, GLfloat value) {
+    if(this->program) this->program->setFloat(id, value);
+    else {
+        this->vertexStage->setFloat(id, value);
+        this->fragmentStage->setFloat(id, value);
+    }
+}
+
+void ShaderPipeline::setFloats(int id, const GLfloat *values, int count) {
+    if(this->program) this->program->setFloats(id, values, count);
+    else {
+        this->vertexStage->setFloats(id, values, count);
+        this->fragmentStage->setFloats(id, values, count);
+    }
+}
+
+void ShaderPipeline::setVec3(int id, const GLfloat *value) {
+    if(this->program) this->program->setVec3(id, value);
+    else {
+        this->vertexStage->setVec3(id, value);
+        this->fragmentStage->setVec3(id, value);
+    }
+}
+
+void ShaderPipeline::setVec4(int id, const GLfloat *value) {
+    if(this->program) this->program->setVec4(id, value);
+    else {
+        this->vertexStage->setVec4(id, value);
+        this->fragmentStage->setVec4(id, value);
+    }
+}
+
+void ShaderPipeline::setMatrix4(int id, const GLfloat *M, int count) {
+    if(this->program) this->program->setMatrix4(id, M, count);
+    else {
+        this->vertexStage->setMatrix4(id, M, count);
+        this->fragmentStage->setMatrix4(id, M, count);
+    }
+}
+
+
+/*
+ * supported()
+ * Separable programs are core in OpenGL 4.1, and an extension before that.
+ */
+int ShaderPipeline::supported() {
+
+    GLint major = 0, minor = 0;
+
+#ifdef __WIN32__
+    if(!glGenProgramPipelines || !glUseProgramStages || !glBindProgramPipeline
+        || !glProgramUniform1i || !glProgramUniformMatrix4fv) return GL_FALSE;
+#endif
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major * 10 + minor >= 41 || Utilities::hasExtension("GL_ARB_separate_shader_objects");
+}
@@ -0,0 +1,59 @@
+/* ShaderPipeline.hpp */
+/* A class to draw with a vertex and a fragment stage taken from separate
+ * programs, so each stage is compiled and linked once, however many
+ * combinations it is used in. */
+/* Usage: make a pipeline from two separable programs (Shader objects made
+ * with only one file each), and call use() instead of glUseProgram().
+ * The setters set a uniform in whichever stage has it.
+ * If the driver lacks separable programs (OpenGL 4.1, or the extension
+ * ARB_separate_shader_objects, see supported()), make the pipeline from
+ * one ordinary program instead. It then works the same, so the rest of the
+ * code doesn't have to know which kind it got. ShaderVariants picks the
+ * kind, and keeps the stages and programs (see ShaderVariants.hpp).
+ * A pipeline does not delete its stages, which are shared, but it does
+ * delete a whole program given to it. Call attach() after a stage has a
+ * new programID, as after Shader::update() returned GL_TRUE. */
+
+#ifndef SHADERPIPELINE_HPP
+#define SHADERPIPELINE_HPP
+
+#include "Shader.hpp"
+
+class ShaderPipeline {
+
+public:
+
+GLuint pipelineID;      // The program pipeline object, 0 for a whole program
+Shader *vertexStage;    // Separable programs for each stage, or NULL
+Shader *fragmentStage;
+Shader *program;        // The whole program, or NULL
+
+/* Constructor for a pipeline of two separable programs */
+ShaderPipeline(Shader *vertexstage, Shader *fragmentstage);
+
+/* Constructor for an ordinary program, when there are no separable ones */
+ShaderPipeline(Shader *program);
+
+/* Destructor */
+~ShaderPipeline();
+
+// Draw with this pipeline from now on (instead of glUseProgram())
+void use();
+
+// Put the current programs of the stages in the pipeline
+void attach();
+
+// Set a uniform in the stages that have it (see the Shader setters)
+void setInt(int id, GLint value);
+void setFloat(int id, GLfloat value);
+void setFloats(int id, const GLfloat *values, int count);
+void setVec3(int id, const GLfloat *value);
+void setVec4(int id, const GLfloat *value);
+void setMatrix4(int id, const GLfloat *M, int count = 1);
+
+// GL_TRUE if the driver has separable programs and program pipelines
+static int supported();
+
+};
+
+#endif // SHADERPIPELINE_HPP
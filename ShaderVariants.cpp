@@ -0,0 +1,269 @@
+#include "ShaderVariants.hpp"
+
+#include <cctype> // For isalnum()
+
+/* Constructor */
+ShaderVariants::ShaderVariants(const char *vertexshaderfile, const char *fragmentshaderfile, const char **defines, int count) {
+    this->vertexFile = vertexshaderfile;
+    this->fragmentFile = fragmentshaderfile;
+    if(count > 32) {
+        fprintf(stderr, "ShaderVariants: only 32 defines can be switched, not %d.\n", count);
+        count = 32;
+    }
+    for(int i = 0; i < count; i++) {
+        this->defines.push_back(defines[i]);
+    }
+    this->vertexMask = 0;
+    this->fragmentMask = 0;
+    this->separable = -1;
+    this->hotReload = GL_FALSE;
+}
+
+/* Destructor */
+ShaderVariants::~ShaderVariants() {
+    std::map<unsigned int, ShaderPipeline*>::iterator i;
+    for(i = this->variants.begin(); i != this->variants.end(); i++) {
+        delete i->second; // Deletes its program, if it is a whole one
+    }
+    std::map<unsigned int, Shader*>::iterator j;
+    for(j = this->vertexStages.begin(); j != this->vertexStages.end(); j++) {
+        delete j->second;
+    }
+    for(j = this->fragmentStages.begin(); j != this->fragmentStages.end(); j++) {
+        delete j->second;
+    }
+}
+
+
+/*
+ * mentions(source, name)
+ * Check if a source has a name as a whole word, not as part of another one.
+ */
+static int mentions(const std::string &source, const std::string &name) {
+    size_t at = source.find(name);
+    while(at != std::string::npos) {
+        size_t end = at + name.size();
+        int before = (at > 0) && (isalnum((unsigned char)source[at - 1]) || source[at - 1] == '_');
+        int after = (end < source.size()) && (isalnum((unsigned char)source[end]) || source[end] == '_');
+        if(!before && !after) return GL_TRUE;
+        at = source.find(name, at + 1);
+    }
+    return GL_FALSE;
+}
+
+
+/*
+ * variant(unsigned int mask)
+ * Find the pipeline with the switches in mask, or compile what it needs now.
+ */
+ShaderPipeline *ShaderVariants::variant(unsigned int mask) {
+
+    mask = this->validMask(mask);
+    std::map<unsigned int, ShaderPipeline*>::iterator i = this->variants.find(mask);
+    if(i != this->variants.end()) return i->second;
+
+    this->warmUp(&mask, 1); // Compiles only what is missing
+    return this->variants[mask];
+}
+
+
+/*
+ * warmUp(const unsigned int *masks, int count)
+ * Make the variants in a list in one go, so the driver can compile them in
+ * parallel, and have them ready to draw with before the first frame.
+ * With separable programs, only stages that are not made yet are compiled.
+ */
+void ShaderVariants::warmUp(const unsigned int *masks, int count) {
+
+    std::vector<unsigned int> newmasks;
+    std::vector<Shader*> made;       // Programs to compile
+    std::vector<std::string> lists;  // Their defines
+    std::vector<const char*> vertexfiles, fragmentfiles;
+
+    if(this->separable < 0) this->separable = ShaderPipeline::supported();
+    if(this->separable) this->findStageMasks();
+
+    for(int i = 0; i < count; i++) {
+        unsigned int mask = this->validMask(masks[i]);
+        if(this->variants.find(mask) != this->variants.end()) continue; // Already made
+        int listed = GL_FALSE;
+        for(size_t j = 0; j < newmasks.size(); j++) {
+            if(newmasks[j] == mask) listed = GL_TRUE; // Twice in the list
+        }
+        if(listed) continue;
+        newmasks.push_back(mask);
+
+        if(this->separable) {
+            if(this->newStage(mask, GL_FALSE, made, lists)) {
+                vertexfiles.push_back(this->vertexFile.c_str());
+                fragmentfiles.push_back(NULL);
+            }
+            if(this->newStage(mask, GL_TRUE, made, lists)) {
+                vertexfiles.push_back(NULL);
+                fragmentfiles.push_back(this->fragmentFile.c_str());
+            }
+        }
+        else {
+            Shader *shader = new Shader();
+            shader->setHotReload(this->hotReload);
+            made.push_back(shader);
+            lists.push_back(this->defineList(mask));
+            vertexfiles.push_back(this->vertexFile.c_str());
+            fragmentfiles.push_back(this->fragmentFile.c_str());
+        }
+    }
+
+    if(!made.empty()) {
+        std::vector<const char*> definelists;
+        for(size_t i = 0; i < lists.size(); i++) {
+            definelists.push_back(lists[i].c_str());
+        }
+        Shader::warmUp(&made[0], &vertexfiles[0], &fragmentfiles[0], &definelists[0], (int)made.size());
+    }
+
+    for(size_t i = 0; i < newmasks.size(); i++) {
+        unsigned int mask = newmasks[i];
+        if(this->separable) {
+            this->variants[mask] = new ShaderPipeline(this->vertexStages[mask & this->vertexMask],
+                this->fragmentStages[mask & this->fragmentMask]);
+        }
+        else {
+            this->variants[mask] = new ShaderPipeline(made[i]);
+        }
+    }
+}
+
+
+/*
+ * update()
+ * Call update() for each program, and put the new programs of the
+ * stages in the pipelines.
+ */
+int ShaderVariants::update() {
+
+    int changed = GL_FALSE;
+    std::map<unsigned int, Shader*>::iterator j;
+    for(j = this->vertexStages.begin(); j != this->vertexStages.end(); j++) {
+        if(j->second->update()) changed = GL_TRUE;
+    }
+    for(j = this->fragmentStages.begin(); j != this->fragmentStages.end(); j++) {
+        if(j->second->update()) changed = GL_TRUE;
+    }
+
+    std::map<unsigned int, ShaderPipeline*>::iterator i;
+    for(i = this->variants.begin(); i != this->variants.end(); i++) {
+        if(i->second->program) {
+            if(i->second->program->update()) changed = GL_TRUE;
+        }
+        else if(changed) {
+            i->second->attach();
+        }
+    }
+    return changed;
+}
+
+void ShaderVariants::setHotReload(int reload) {
+    this->hotReload = reload;
+    std::map<unsigned int, Shader*>::iterator j;
+    for(j = this->vertexStages.begin(); j != this->vertexStages.end(); j++) {
+        j->second->setHotReload(reload);
+    }
+    for(j = this->fragmentStages.begin(); j != this->fragmentStages.end(); j++) {
+        j->second->setHotReload(reload);
+    }
+    std::map<unsigned int, ShaderPipeline*>::iterator i;
+    for(i = this->variants.begin(); i != this->variants.end(); i++) {
+        if(i->second->program) i->second->program->setHotReload(reload);
+    }
+}
+
+void ShaderVariants::setSeparable(int separable) {
+    if(!this->variants.empty()) {
+        fprintf(stderr, "ShaderVariants: setSeparable() after variants were made has no effect.\n");
+        return;
+    }
+    this->separable = separable ? -1 : GL_FALSE; // Only if supported
+}
+
+int ShaderVariants::numVariants() {
+    return (int)this->variants.size();
+}
+
+int ShaderVariants::numPrograms() {
+    if(this->separable > 0) return (int)(this->vertexStages.size() + this->fragmentStages.size());
+    return (int)this->variants.size();
+}
+
+
+/*
+ * private
+ * defineList(unsigned int mask)
+ * The names for the set bits of mask, separated by spaces.
+ */
+std::string ShaderVariants::defineList(unsigned int mask) {
+
+    std::string list;
+    for(size_t i = 0; i < this->defines.size(); i++) {
+        if(mask & (1u << i)) {
+            if(!list.empty()) list += " ";
+            list += this->defines[i];
+        }
+    }
+    return list;
+}
+
+
+/*
+ * private
+ * validMask(unsigned int mask)
+ * Bits without a name are cleared, so they don't make extra variants.
+ */
+unsigned int ShaderVariants::validMask(unsigned int mask) {
+    if(this->defines.size() < 32) mask &= (1u << this->defines.size()) - 1;
+    return mask;
+}
+
+
+/*
+ * private
+ * findStageMasks()
+ * Read the source of each stage, and find the switches it mentions.
+ * If a file can't be read, it gets all switches, and the compiler
+ * reports the error.
+ */
+void ShaderVariants::findStageMasks() {
+
+    if(!this->vertexStages.empty() || !this->fragmentStages.empty()) return; // Done before
+    std::string vertexsource, fragmentsource;
+    int vertexread = Shader::readSourceText(this->vertexFile.c_str(), vertexsource);
+    int fragmentread = Shader::readSourceText(this->fragmentFile.c_str(), fragmentsource);
+    this->vertexMask = 0;
+    this->fragmentMask = 0;
+    for(size_t i = 0; i < this->defines.size(); i++) {
+        if(!vertexread || mentions(vertexsource, this->defines[i])) this->vertexMask |= 1u << i;
+        if(!fragmentread || mentions(fragmentsource, this->defines[i])) this->fragmentMask |= 1u << i;
+    }
+}
+
+
+/*
+ * private
+ * newStage(unsigned int mask, int fragment, made, lists)
+ * Add an empty stage for the switches of mask that the stage mentions,
+ * and list it with its defines to be compiled, unless it is there already.
+ * Returns the new stage, or NULL.
+ */
+Shader *ShaderVariants::newStage(unsigned int mask, int fragment, std::vector<Shader*> &made,
+    std::vector<std::string> &lists) {
+
+    std::map<unsigned int, Shader*> &stages = fragment ? this->fragmentStages : this->vertexStages;
+    unsigned int stagemask = mask & (fragment ? this->fragmentMask : this->vertexMask);
+    if(stages.find(stagemask) != stages.end()) return NULL;
+
+    Shader *shader = new Shader();
+    shader->setHotReload(this->hotReload);
+    stages[stagemask] = shader;
+    made.push_back(shader);
+    lists.push_back(this->defineList(stagemask));
+    return shader;
+}
@@ -0,0 +1,83 @@
+/* ShaderVariants.hpp */
+/* A class to keep the variants of a shader program that one pair of shader
+ * files can be compiled into, with different sets of #define switches. */
+/* Usage: give the constructor the shader files and the names of the
+ * switches, one for each bit of a mask. variant(mask) returns the pipeline
+ * with the names of the set bits defined, and compiles it the first time
+ * it is asked for. The shaders can then leave out with #ifdef the work that
+ * a material doesn't need, instead of testing for it for every fragment.
+ * Each variant is compiled only once, and kept by its mask until the
+ * ShaderVariants object is destroyed. Call warmUp() with the masks you know
+ * you will use, to make them all at startup, and update() once per frame
+ * to swap in edited variants if hot reloading is on. */
+/* If the driver has separable programs, each stage is compiled on its own,
+ * with only the switches that its source (with includes) mentions. A vertex
+ * shader that doesn't test any switch is then compiled once and shared by
+ * all variants, and only the stages are cached on disk, not every pair.
+ * Without separable programs, or after setSeparable(GL_FALSE), each variant
+ * is one whole program. Which switches a stage mentions is found the first
+ * time a stage is made, so a switch added to a stage while hot reloading
+ * works only after a restart. */
+
+#ifndef SHADERVARIANTS_HPP
+#define SHADERVARIANTS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Shader.hpp"
+#include "ShaderPipeline.hpp"
+
+class ShaderVariants {
+
+public:
+
+/* Constructor. defines[i] is the name for bit i of a mask, at most 32 of them. */
+ShaderVariants(const char *vertexshaderfile, const char *fragmentshaderfile, const char **defines, int count);
+
+/* Destructor. Deletes all variants. */
+~ShaderVariants();
+
+// Get the pipeline for a mask of switches, compiling it if it is new
+ShaderPipeline *variant(unsigned int mask);
+
+// Make all the variants in a list that are not made yet, together (see Shader::warmUp())
+void warmUp(const unsigned int *masks, int count);
+
+// Swap in compiled and edited variants. Call once per frame. GL_TRUE if any program changed.
+int update();
+
+// Turn hot reloading on or off for all variants, made now or later
+void setHotReload(int reload);
+
+// Use separable programs if the driver has them (the default), or never. Call before making variants.
+void setSeparable(int separable);
+
+// Number of variants made so far, and the number of programs linked for them
+int numVariants();
+int numPrograms();
+
+private:
+
+// Internal "private" functions
+std::string defineList(unsigned int mask);  // The names for the bits in a mask
+unsigned int validMask(unsigned int mask);  // Clear the bits that have no name
+void findStageMasks();                      // Find the switches each stage mentions
+Shader *newStage(unsigned int mask, int fragment, std::vector<Shader*> &made,
+    std::vector<std::string> &lists);        // Find or add a stage, for warmUp()
+
+std::map<unsigned int, ShaderPipeline*> variants; // All variants made, by mask
+std::map<unsigned int, Shader*> vertexStages;     // Separable stages, by the switches they use
+std::map<unsigned int, Shader*> fragmentStages;
+std::string vertexFile;
+std::string fragmentFile;
+std::vector<std::string> defines;  // Name of each bit
+unsigned int vertexMask;           // Switches mentioned in each stage
+unsigned int fragmentMask;
+int separable;                     // -1 until checked at the first variant
+int hotReload;
+
+};
+
+#endif // SHADERVARIANTS_HPP
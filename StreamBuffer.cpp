@@ -0,0 +1,193 @@
+#include "StreamBuffer.hpp"
+#include "GLState.hpp"
+
+// From ARB_buffer_storage (OpenGL 4.4), which GL/glext.h is too old to have,
+// so glBufferStorage() is looked up at run time on all platforms
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+static BufferStorageProc bufferStorage = NULL;
+
+/* Constructor */
+StreamBuffer::StreamBuffer(GLenum target, size_t framesize) {
+    this->bufferID = 0;
+    this->persistent = GL_FALSE;
+    this->stalls = 0;
+    this->target = target;
+    this->mapping = NULL;
+    this->framesize = framesize;
+    this->offset = 0;
+    this->frame = 0;
+    for(int i = 0; i < STREAMBUFFER_FRAMES; i++) {
+        this->fences[i] = 0;
+    }
+}
+
+/* Destructor */
+StreamBuffer::~StreamBuffer() {
+}
+
+
+/*
+ * bufferStorageSupported() - Check for glBufferStorage(), and look it up.
+ */
+static int bufferStorageSupported() {
+    GLint major = 0, minor = 0;
+
+    bufferStorage = (BufferStorageProc)Utilities::getProcAddress("glBufferStorage");
+    if(!bufferStorage) return GL_FALSE;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major * 10 + minor >= 44 || Utilities::hasExtension("GL_ARB_buffer_storage");
+}
+
+
+/*
+ * beginFrame()
+ * Move to the next part of the buffer. A persistent buffer waits until
+ * the GPU is done reading what was written there STREAMBUFFER_FRAMES
+ * frames ago. Otherwise the buffer gets fresh storage.
+ */
+void StreamBuffer::beginFrame() {
+
+    if(this->bufferID == 0) {
+        this->persistent = bufferStorageSupported();
+        this->create();
+    }
+
+    // Everything is allocated anew each frame, so old buffers can go
+    // (OpenGL keeps them until the GPU is done with them)
+    if(!this->retired.empty()) {
+        GLState::deleteBuffers((GLsizei)this->retired.size(), &(this->retired[0]));
+        this->retired.clear();
+    }
+
+    this->offset = 0;
+    if(!this->persistent) {
+        GLState::bindBuffer(this->target, this->bufferID);
+        glBufferData(this->target, this->framesize, NULL, GL_STREAM_DRAW); // Orphan the old storage
+        return;
+    }
+
+    this->frame = (this->frame + 1) % STREAMBUFFER_FRAMES;
+    GLsync fence = this->fences[this->frame];
+    if(fence != 0) {
+        GLenum status = glClientWaitSync(fence, 0, 0); // Just check first
+        if(status == GL_TIMEOUT_EXPIRED) {
+            this->stalls++;
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // At most a second
+        }
+        glDeleteSync(fence);
+        this->fences[this->frame] = 0;
+    }
+}
+
+
+/*
+ * allocate(size_t size, size_t alignment, GLintptr *offset)
+ * Bump the free offset of this frame past an aligned range, and return
+ * a pointer to write the range. The buffer grows if the frame is full.
+ */
+void *StreamBuffer::allocate(size_t size, size_t alignment, GLintptr *offset) {
+
+    if(alignment < 1) alignment = 1;
+    size_t base = this->frame * this->framesize; // Where the part starts (always 0 if orphaned)
+    size_t start = (base + this->offset + alignment - 1) / alignment * alignment - base;
+    if(start + size > this->framesize) {
+        this->grow(this->framesize + size + alignment);
+        base = this->frame * this->framesize;
+        start = (base + alignment - 1) / alignment * alignment - base;
+    }
+    this->offset = start + size;
+
+    if(this->persistent) {
+        *offset = base + start;
+        return this->mapping + *offset;
+    }
+    *offset = start;
+    GLState::bindBuffer(this->target, this->bufferID);
+    this->mapping = (unsigned char*)glMapBufferRange(this->target, start, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    return this->mapping;
+}
+
+
+/*
+ * commit()
+ * Unmap the range written, if it is not persistent. Coherent persistent
+ * mappings need nothing: the GPU sees the writes at the next draw call.
+ */
+void StreamBuffer::commit() {
+
+    if(this->persistent || this->mapping == NULL) return;
+    GLState::bindBuffer(this->target, this->bufferID);
+    glUnmapBuffer(this->target);
+    this->mapping = NULL;
+}
+
+
+/*
+ * endFrame()
+ * Fence the part of a persistent buffer used this frame.
+ */
+void StreamBuffer::endFrame() {
+
+    if(this->bufferID == 0 || !this->persistent) return;
+    this->fences[this->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+/*
+ * private
+ * create()
+ * Make the buffer. A persistent one holds all parts, and stays mapped
+ * with coherent writes, so no flushing is needed.
+ */
+void StreamBuffer::create() {
+
+    glGenBuffers(1, &(this->bufferID));
+    GLState::bindBuffer(this->target, this->bufferID);
+    if(this->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(this->target, this->framesize * STREAMBUFFER_FRAMES, NULL, flags);
+        this->mapping = (unsigned char*)glMapBufferRange(this->target, 0, this->framesize * STREAMBUFFER_FRAMES, flags);
+        if(this->mapping == NULL) { // Should not happen, but orphaning works anyway
+            Utilities::printError("Stream buffer error", "Could not map the buffer, orphaning it instead");
+            GLState::deleteBuffers(1, &(this->bufferID));
+            this->persistent = GL_FALSE;
+            this->create();
+        }
+    }
+    else {
+        glBufferData(this->target, this->framesize, NULL, GL_STREAM_DRAW);
+    }
+}
+
+
+/*
+ * private
+ * grow(size_t size)
+ * Move on to a new, larger buffer. Ranges allocated earlier in this
+ * frame are still in the old buffer, so it is kept until the next frame.
+ * A persistent buffer stays mapped until it is deleted.
+ */
+void StreamBuffer::grow(size_t size) {
+
+    while(this->framesize < size) {
+        this->framesize *= 2;
+    }
+    fprintf(stderr, "Stream buffer grown to %d bytes per frame.\n", (int)this->framesize);
+
+    if(!this->persistent) this->commit(); // Can't be mapped when it is deleted
+    this->retired.push_back(this->bufferID);
+    this->create();
+    this->offset = 0;
+    for(int i = 0; i < STREAMBUFFER_FRAMES; i++) { // The new buffer is not in use
+        if(this->fences[i] != 0) glDeleteSync(this->fences[i]);
+        this->fences[i] = 0;
+    }
+}
@@ -0,0 +1,83 @@
+/* StreamBuffer.hpp */
+/* A buffer for data that is written anew every frame, like uniform
+ * blocks, instance data or debug lines, written by the CPU straight into
+ * memory the GPU reads from, without waiting for the GPU. */
+/* Usage: call beginFrame() at the start of each frame and endFrame() at
+ * the end. In between, allocate() reserves the next free range of the
+ * frame, aligned as asked, and returns a pointer to write the data to,
+ * and the offset of the range in the buffer, to bind or draw from. Call
+ * commit() when done writing, before the data is used. bufferID may
+ * change at any allocate(), so read it after each one.
+ * With ARB_buffer_storage (OpenGL 4.4), the buffer is mapped once, for
+ * good, and holds STREAMBUFFER_FRAMES frames in turn. The CPU writes one
+ * part while the GPU reads the others, and a fence for each part tells
+ * when it can be written again, so the CPU only waits if the GPU is more
+ * than that many frames behind. commit() then does nothing.
+ * Without it, each frame gets fresh storage by "orphaning" the buffer
+ * with glBufferData(), and each range is mapped and unmapped on its own,
+ * without synchronizing, since nothing reads the fresh storage yet.
+ * If a frame needs more room than there is, a larger buffer takes over. */
+
+#ifndef STREAMBUFFER_HPP
+#define STREAMBUFFER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+#include <cstddef> // For size_t
+#include <vector>
+
+#include "Utilities.hpp" // For GL extensions in Windows
+
+// Number of frames the persistent buffer holds, so the GPU can be this far behind
+#define STREAMBUFFER_FRAMES 3
+
+class StreamBuffer {
+
+public:
+
+GLuint bufferID;        // The buffer object
+int persistent;         // GL_TRUE if mapped for good, GL_FALSE if orphaned each frame
+unsigned long stalls;   // Number of times beginFrame() had to wait for the GPU
+
+/* Constructor. The buffer is made by the first beginFrame(). */
+StreamBuffer(GLenum target, size_t framesize = 64 << 10);
+
+/* Destructor */
+~StreamBuffer();
+
+// Move on to the next part of the buffer. Call at the start of each frame.
+void beginFrame();
+
+// Reserve size bytes for this frame, with an offset that is a multiple of alignment
+void *allocate(size_t size, size_t alignment, GLintptr *offset);
+
+// Finish writing to the range from the last allocate()
+void commit();
+
+// Mark the part of the buffer used this frame. Call at the end of each frame.
+void endFrame();
+
+private:
+
+// Internal "private" functions
+void create();              // Make the buffer, and map it if it is persistent
+void grow(size_t size);     // Make each part of the buffer hold at least size bytes
+
+GLenum target;
+std::vector<GLuint> retired; // Buffers replaced by grow(), deleted in the next frame
+unsigned char *mapping;     // The whole persistent buffer, or the range being written
+size_t framesize;           // Size of each part
+size_t offset;              // Next free byte in the current part
+int frame;                  // The current part
+GLsync fences[STREAMBUFFER_FRAMES]; // Signaled when the GPU is done with a part
+
+};
+
+#endif // STREAMBUFFER_HPP
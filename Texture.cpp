@@ -1,4 +1,5 @@
 #include "Texture.hpp"
+#include "GLState.hpp"
 
 /* Constructor */
 Texture::Texture() {
@@ -6,173 +7,516 @@ Texture::Texture() {
     height = 0;
     textureID = 0;
     type = 0;
+    internalFormat = 0;
+    residentLevel = 0;
+    pixelType = GL_UNSIGNED_BYTE;
     imageData = NULL;
+    decodedData = NULL;
     bpp = 0;
+    file.data = NULL;
+    file.size = 0;
+    file.handle = NULL;
 }
 
 /* Constructor to load and intialize the texture all at once */
-Texture::Texture(const char *filename) {
-    createTexture(filename);
+Texture::Texture(const char *filename, int flags) {
+    width = 0;
+    height = 0;
+    textureID = 0;
+    type = 0;
+    internalFormat = 0;
+    residentLevel = 0;
+    pixelType = GL_UNSIGNED_BYTE;
+    imageData = NULL;
+    decodedData = NULL;
+    bpp = 0;
+    file.data = NULL;
+    file.size = 0;
+    file.handle = NULL;
+    createTexture(filename, flags);
 }
 
 /* Destructor */
 Texture::~Texture() {
+    unloadTGA();
 }
 
 
 /*
- * loadUncompressedTGA(FILE *TGAfile)
- * Open and test the file to make sure it is a valid TGA file
+ * setFormat(GLuint bytesperpixel)
+ * Set bpp and the GL pixel formats for 3 or 4 bytes per pixel.
  */
-int Texture::loadUncompressedTGA(FILE *TGAfile) // Load an uncompressed TGA
-{												// (based on NeHe's TGA loading code)
-	GLubyte temp;
-	GLuint cswap;
-	TGA tga;			// TGA image data
-
-	if(fread(tga.header, sizeof(tga.header), 1, TGAfile) == 0)		// Read TGA header
+void Texture::setFormat(GLuint bytesperpixel)
+{
+	this->bpp = 8 * bytesperpixel;
+	if(bytesperpixel == 3)										// If the the image is 24 BPP
 	{
-		fprintf(stderr, "Could not read info header.\n");		// Display error
-		if(TGAfile != NULL)										// if file is still open
-		{
-			fclose(TGAfile);									// Close it
-		}
-		return GL_FALSE;										// Exit with failure
+		this->type = GL_BGR;							// Pixels are stored as BGR in the file
+		this->internalFormat = GL_RGB8;					// No need to waste a padding byte on the GPU
+		printf("Texture type is GL_RGB\n");
 	}
+	else												// Else it's 32 BPP
+	{
+		this->type = GL_BGRA;							// Pixels are stored as BGRA in the file
+		this->internalFormat = GL_RGBA8;
+		printf("Texture type is GL_RGBA\n");
+	}
+}
 
-	this->width  = tga.header[1] * 256 + tga.header[0];		// Determine the TGA Width	(highbyte*256+lowbyte)
-	this->height = tga.header[3] * 256 + tga.header[2];		// Determine the TGA Height	(highbyte*256+lowbyte)
-	this->bpp	= tga.header[4];							        // Determine the bits per pixel
-	tga.width		= this->width;							// Copy width into local structure
-	tga.height		= this->height;							// Copy height into local structure
-	tga.bpp			= this->bpp;								    // Copy BPP into local structure
+/*
+ * readTGAInfo(const GLubyte *header)
+ * Check the image information in the header and set
+ * width, height, bpp and the pixel formats for OpenGL.
+ */
+int Texture::readTGAInfo(const GLubyte *header)
+{
+	this->width  = header[TGA_WIDTH+1] * 256 + header[TGA_WIDTH];	// Determine the TGA Width	(highbyte*256+lowbyte)
+	this->height = header[TGA_HEIGHT+1] * 256 + header[TGA_HEIGHT];	// Determine the TGA Height	(highbyte*256+lowbyte)
+	this->bpp	= header[TGA_BPP];								// Determine the bits per pixel
 
 	if((this->width <= 0) || (this->height <= 0)
 		|| ((this->bpp != 24) && (this->bpp !=32)))		// Make sure all information is valid
 	{
 		fprintf(stderr, "Invalid texture information.\n");		// Display Error
-		if(TGAfile != NULL)										// Check if file is still open
-		{
-			fclose(TGAfile);										// If so, close it
-		}
 		return GL_FALSE;										// Return "failure"
 	}
 
-	if(bpp == 24)										// If the the image is 24 BPP
+	this->setFormat(this->bpp / 8);
+	return GL_TRUE;
+}
+
+/*
+ * loadUncompressedTGA(const GLubyte *header)
+ * Point imageData to the pixels in the mapped file. No copy is made,
+ * and the BGR(A) byte order is left as it is. OpenGL can read it directly.
+ */
+int Texture::loadUncompressedTGA(const GLubyte *header)
+{
+	size_t pixeloffset;
+	size_t imagesize;
+
+	if(!this->readTGAInfo(header))
 	{
-		this->type	= GL_RGB;								// Set image type to GL_RGB
-		printf("Texture type is GL_RGB\n");
+		return GL_FALSE;
 	}
-	else														// Else it's 32 BPP
+
+	pixeloffset = TGA_HEADERSIZE + header[TGA_IDLENGTH];	// Skip the optional image ID field
+	imagesize = (size_t)(this->bpp / 8) * this->width * this->height;
+	if(pixeloffset + imagesize > this->file.size)			// Make sure the file is not truncated
 	{
-		this->type	= GL_RGBA;								// Set image type to GL_RGBA
-		printf("Texture type is GL_RGBA\n");
+		fprintf(stderr, "Could not read image data.\n");
+		return GL_FALSE;
 	}
 
-	tga.bytesPerPixel	= (tga.bpp / 8);						// Compute the number of BYTES per pixel
-	tga.imageSize		= (tga.bytesPerPixel * tga.width * tga.height);	// Compute the total amount of memory needed
-	this->imageData = new GLubyte[tga.imageSize];				        // Allocate that much memory
+	this->imageData = this->file.data + pixeloffset;		// Use the pixels right where they are
+	return GL_TRUE;											// Return success
+}
 
-	if(this->imageData == NULL)										// If no space was allocated
+/*
+ * loadCompressedTGA(const GLubyte *header)
+ * Decode the RLE packets in the mapped file into decodedData,
+ * in the same BGR(A) order as an uncompressed file.
+ */
+int Texture::loadCompressedTGA(const GLubyte *header)
+{
+	size_t pixeloffset;
+	size_t numpixels;
+
+	if(!this->readTGAInfo(header))
 	{
-		fprintf(stderr, "Could not allocate memory for image.\n");		// Display Error
-		fclose(TGAfile);													// Close the file
-		return GL_FALSE;												// Return "failure"
+		return GL_FALSE;
 	}
 
-	if(fread(this->imageData, 1, tga.imageSize, TGAfile) != tga.imageSize)	// Attempt to read image data
+	pixeloffset = TGA_HEADERSIZE + header[TGA_IDLENGTH];	// Skip the optional image ID field
+	if(pixeloffset > this->file.size)
 	{
-		fprintf(stderr, "Could not read image data.\n");					// Display error
-		if(this->imageData != NULL)										// If image data was allocated
-		{
-			delete[] this->imageData;										// Deallocate that data
-		}
-		fclose(TGAfile);														// Close file
-		return GL_FALSE;													// Return "failure"
+		fprintf(stderr, "Could not read image data.\n");
+		return GL_FALSE;
 	}
 
-	// stegu 2013-11-19: Stupid, slow and outdated in-place XOR byte swapping code removed. Ugh.
-	// Swap the BGR(A) byte order in the TGA file to the standard RGB(A) byte order for OpenGL.
-	for(cswap = 0; cswap < (unsigned int)tga.imageSize; cswap += tga.bytesPerPixel)
+	numpixels = (size_t)this->width * this->height;
+	this->decodedData = new GLubyte[numpixels * (this->bpp / 8)];
+
+	if(decodeRLE(this->file.data + pixeloffset, this->file.size - pixeloffset,
+		this->decodedData, numpixels, this->bpp / 8) == 0)
 	{
-		temp = this->imageData[cswap];
-		this->imageData[cswap] = this->imageData[cswap+2];
-		this->imageData[cswap+2] = temp;
+		fprintf(stderr, "Could not decode RLE image data.\n");
+		return GL_FALSE;
 	}
 
-	fclose(TGAfile);			// Close file
-	return GL_TRUE;			// Return success
+	this->imageData = this->decodedData;
+	return GL_TRUE;
 }
 
 /*
- * loadTGA(char * filename)
- * Open and test the file to make sure it is a valid TGA file
+ * decodeRLE()
+ * Each packet starts with a byte where the high bit tells if it is a run
+ * (one pixel value repeated) or a raw packet (literal pixels), and the low
+ * 7 bits hold the pixel count minus one. Packets may cross scanlines.
+ * Raw packets are a single memcpy(). Runs are written by replicating the
+ * pixel into a block of 16 pixels and storing that block with wide copies,
+ * so there is no per-pixel branching in either case.
  */
-int Texture::loadTGA(const char *filename)
+size_t decodeRLE(const GLubyte *src, size_t srcsize, GLubyte *dst,
+                 size_t numpixels, unsigned int bytesperpixel)
 {
-	FILE * TGAfile;
-	TGAHeader tgaheader;
+	const GLubyte *srcstart = src;
+	const GLubyte *srcend = src + srcsize;
+	GLubyte *dstend = dst + numpixels * bytesperpixel;
+	GLubyte block[16*4]; // 16 copies of a run pixel, at most 4 bytes each
+	const size_t blocksize = 16 * bytesperpixel;
 
-	GLubyte uTGAcompare[12] = {0,0,2, 0,0,0,0,0,0,0,0,0}; // Uncompressed TGA Header
-	GLubyte cTGAcompare[12] = {0,0,10,0,0,0,0,0,0,0,0,0}; // RLE Compressed TGA Header
+	while(dst < dstend)
+	{
+		if(src >= srcend) return 0;					// Truncated data
+		size_t count = (*src & 0x7f) + 1;			// Number of pixels in this packet
+		size_t bytes = count * bytesperpixel;
+		if(bytes > (size_t)(dstend - dst)) return 0;	// Packet runs past the end of the image
 
-	TGAfile = fopen(filename, "rb");
+		if(*src++ & 0x80)							// Run-length packet
+		{
+			if((size_t)(srcend - src) < bytesperpixel) return 0;
+			memcpy(block, src, bytesperpixel);
+			src += bytesperpixel;
+			// Double the filled part of the block until it holds 16 pixels,
+			// or as many as this run needs if it is shorter than that
+			size_t needed = bytes < blocksize ? bytes : blocksize;
+			for(size_t filled = bytesperpixel; filled < needed; filled *= 2)
+			{
+				memcpy(block + filled, block, filled);
+			}
+			while(bytes >= blocksize)
+			{
+				memcpy(dst, block, blocksize);
+				dst += blocksize;
+				bytes -= blocksize;
+			}
+			memcpy(dst, block, bytes);
+			dst += bytes;
+		}
+		else										// Raw packet
+		{
+			if((size_t)(srcend - src) < bytes) return 0;
+			memcpy(dst, src, bytes);
+			src += bytes;
+			dst += bytes;
+		}
+	}
+	return src - srcstart;
+}
+
+/*
+ * convertTGA(int flags)
+ * OpenGL wants the bottom row first, which is the TGA default, but files
+ * can also be stored top row first. Premultiplied alpha is requested by
+ * the caller. Neither conversion can be done by the driver, so the pixels
+ * are copied to a writable buffer (unless they were decoded already)
+ * and converted in place.
+ */
+int Texture::convertTGA(int flags)
+{
+	size_t numpixels = (size_t)this->width * this->height;
+	size_t bytesperpixel = this->bpp / 8;
+	int toporigin = (this->file.data[TGA_DESCRIPTOR] & 0x20) != 0; // Bit 5 set means top row first
+	int premultiply = (flags & TEXTURE_PREMULTIPLY_ALPHA) && (this->bpp == 32);
+
+	if(!toporigin && !premultiply)							// Nothing to do, use the pixels as they are
+	{
+		return GL_TRUE;
+	}
+
+	if(this->decodedData == NULL)							// The pixels are still in the read-only mapping
+	{
+		this->decodedData = new GLubyte[numpixels * bytesperpixel];
+		memcpy(this->decodedData, this->imageData, numpixels * bytesperpixel);
+		this->imageData = this->decodedData;
+	}
+
+	if(toporigin)
+	{
+		PixelFormat::flipRows(this->decodedData, this->width * bytesperpixel, this->height);
+	}
+	if(premultiply)
+	{
+		PixelFormat::premultiplyAlpha(this->decodedData, numpixels);
+	}
+	return GL_TRUE;
+}
+
+/*
+ * loadTGA(char * filename, int flags)
+ * Map and test the file to make sure it is a valid TGA file
+ */
+int Texture::loadTGA(const char *filename, int flags)
+{
+	const GLubyte *header;
 
-	if(TGAfile == NULL) // If the file didn't open...
+	if(!Utilities::mapFile(filename, &this->file)) // If the file didn't open...
 	{
 		fprintf(stderr, "Could not open texture file.\n");	// Display an error message
 		return GL_FALSE;									// Exit function with "failure"
 	}
 
-	if(fread(&tgaheader, sizeof(TGAHeader), 1, TGAfile) == 0) // Attempt to read 12 byte file header
+	if(this->file.size < TGA_HEADERSIZE)					// Make sure there is a full 18 byte file header
 	{
-		fprintf(stderr, "Could not read file header.\n");	// If it fails, display an error message
-		if(TGAfile != NULL)									// Check to see if file is still open
-		{
-			fclose(TGAfile);									// If it is, close it
-		}
+		fprintf(stderr, "Could not read file header.\n");
+		unloadTGA();
 		return GL_FALSE;									// Exit with failure
 	}
+	header = this->file.data;
 
-	if(memcmp(uTGAcompare, &tgaheader, sizeof(tgaheader)) == 0)	// See if header matches the predefined header of
-	{															// an Uncompressed TGA image
-		this->loadUncompressedTGA(TGAfile);		                // If so, jump to Uncompressed TGA loading code
+	if(header[TGA_COLORMAPTYPE] != 0)						// Color mapped images are not supported
+	{
+		fprintf(stderr, "Unsupported image file format.\n");
+		unloadTGA();
+		return GL_FALSE;
 	}
-	else if(memcmp(cTGAcompare, &tgaheader, sizeof(tgaheader)) == 0) // See if header matches the predefined header of
-	{																 // an RLE compressed TGA image
-		fprintf(stderr, "RLE compressed TGA files are not supported.\n");
-		fclose(TGAfile);
-		return GL_FALSE;											// Exit with failure
+
+	if(header[TGA_IMAGETYPE] == 2)							// An uncompressed truecolor TGA image
+	{
+		if(!this->loadUncompressedTGA(header))
+		{
+			unloadTGA();
+			return GL_FALSE;
+		}
+	}
+	else if(header[TGA_IMAGETYPE] == 10)					// An RLE compressed truecolor TGA image
+	{
+		if(!this->loadCompressedTGA(header))
+		{
+			unloadTGA();
+			return GL_FALSE;
+		}
 	}
 	else															// If header matches neither type
 	{
 		fprintf(stderr, "Unsupported image file format.\n");		// Unknown file type, or unknown TGA version
-		fclose(TGAfile);
+		unloadTGA();
 		return GL_FALSE;											// Exit with failure
 	}
-	return GL_TRUE;													// All is well, return "success"
+	return this->convertTGA(flags);									// All is well, return "success"
 }
 
 /*
- * Load and activate a 2D texture from a TGA file
+ * unloadTGA()
+ * Release the mapped file and any decoded data. imageData is invalid after this.
  */
-void Texture::createTexture(const char *filename) {
+void Texture::unloadTGA()
+{
+	Utilities::unmapFile(&this->file);
+	if(this->decodedData)
+	{
+		delete[] this->decodedData;
+		this->decodedData = NULL;
+	}
+	this->imageData = NULL;
+}
+
+/*
+ * loadMipmaps(const char *filename, int flags, int compress, Mipmap::MipChain *chain)
+ * Get a CPU mip chain for the TGA file, block compressed if compress is set.
+ * If the cache file is up to date the TGA file is not even opened, otherwise
+ * the chain is generated and written to the cache for the next time.
+ * Compressed chains are made from the uncompressed chain, which has
+ * a cache of its own.
+ */
+int Texture::loadMipmaps(const char *filename, int flags, int compress, Mipmap::MipChain *chain)
+{
+	int filter = (flags & TEXTURE_MIPMAP_KAISER) ? Mipmap::FILTER_KAISER
+		: (flags & TEXTURE_MIPMAP_LANCZOS) ? Mipmap::FILTER_LANCZOS : Mipmap::FILTER_BOX;
+	int mipflags = (flags & TEXTURE_MIPMAP_GAMMA) ? Mipmap::GAMMA_CORRECT : 0;
+	int extraflags = flags & TEXTURE_PREMULTIPLY_ALPHA; // Changes level 0, so it is part of the cache key
+	const char *suffix = compress ? ".bc.ktx" : ".ktx";
+
+	if(Mipmap::readCache(chain, filename, suffix, filter, mipflags, extraflags))
+	{
+		this->width = chain->width[0];
+		this->height = chain->height[0];
+		this->setFormat(chain->channels);
+		if(compress) this->setCompressedFormat();
+		return GL_TRUE;
+	}
+
+	if(compress)
+	{
+		Mipmap::MipChain uncompressed;
+		if(!this->loadMipmaps(filename, flags, GL_FALSE, &uncompressed))
+		{
+			return GL_FALSE;
+		}
+		BlockCompress::compress(chain, &uncompressed);
+		Mipmap::release(&uncompressed);
+		this->setCompressedFormat();
+	}
+	else
+	{
+		if(!this->loadTGA(filename, flags))
+		{
+			return GL_FALSE;
+		}
+		Mipmap::generate(chain, this->imageData, this->width, this->height, this->bpp / 8, filter, mipflags);
+		unloadTGA();
+	}
+
+	if(!Mipmap::writeCache(chain, filename, suffix, filter, mipflags, extraflags))
+	{
+		fprintf(stderr, "Could not write mipmap cache file.\n"); // Not fatal, we have the mipmaps
+	}
+	return GL_TRUE;
+}
+
+/*
+ * setCompressedFormat()
+ * Switch internalFormat to BC1 for RGB or BC3 for RGBA, after setFormat().
+ */
+void Texture::setCompressedFormat()
+{
+	this->internalFormat = (this->bpp == 32) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		: GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+/*
+ * uploadMipmaps(const Mipmap::MipChain *chain)
+ * Allocate all levels of the bound texture, then fill them in.
+ * Compressed levels, and a single level, are allocated and filled in one step.
+ */
+void Texture::uploadMipmaps(const Mipmap::MipChain *chain)
+{
+	GLuint level;
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain->numlevels - 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, chain->rowalignment);
+	if(chain->blockbytes > 0)
+	{
+		for(level = 0; level < chain->numlevels; level++)
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, this->internalFormat,
+				chain->width[level], chain->height[level], 0,
+				chain->levelsize[level], chain->data + chain->offset[level]);
+		}
+		return;
+	}
+	if(chain->numlevels == 1)
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, this->internalFormat, chain->width[0], chain->height[0], 0,
+			this->type, this->pixelType, chain->data);
+		return;
+	}
+	for(level = 0; level < chain->numlevels; level++)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, this->internalFormat, chain->width[level], chain->height[level], 0,
+			this->type, this->pixelType, NULL);
+	}
+	for(level = 0; level < chain->numlevels; level++)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, chain->width[level], chain->height[level],
+			this->type, this->pixelType, chain->data + chain->offset[level]);
+	}
+}
+
+/*
+ * loadKTX(const char *filename, Mipmap::MipChain *chain, int *generatemipmaps)
+ * Map a KTX file and set the texture formats from its header.
+ */
+int Texture::loadKTX(const char *filename, Mipmap::MipChain *chain, int *generatemipmaps)
+{
+	Ktx::Format format;
+
+	if(!Ktx::read(filename, chain, &format, NULL, NULL, 0))
+	{
+		fprintf(stderr, "Could not load KTX file %s.\n", filename);
+		return GL_FALSE;
+	}
+	this->width = chain->width[0];
+	this->height = chain->height[0];
+	this->bpp = 8 * chain->channels * format.typesize;
+	this->type = format.format;
+	this->pixelType = format.type;
+	this->internalFormat = format.internalformat;
+	*generatemipmaps = format.generatemipmaps;
+	return GL_TRUE;
+}
+
+/*
+ * supportedFlags(int flags)
+ * Clear the flags that the OpenGL driver can't handle. This needs the GL
+ * context, so it is done before loading, which may be on another thread.
+ */
+int Texture::supportedFlags(int flags)
+{
+	if((flags & TEXTURE_COMPRESS) && !Utilities::hasExtension("GL_EXT_texture_compression_s3tc"))
+	{
+		flags &= ~TEXTURE_COMPRESS;
+	}
+	return flags;
+}
 
-    this->loadTGA(filename); // Private method, reads this->imageData from TGA file
+/*
+ * loadLevels(const char *filename, int flags, Mipmap::MipChain *chain, int *generatemipmaps)
+ * Get the image data from a TGA or KTX file as a mip chain, with all levels
+ * if they are made on the CPU or stored in the file. Otherwise the chain
+ * has only level 0, and generatemipmaps is set. Call Mipmap::release()
+ * and then unloadTGA() after uploading. The flags must come from
+ * supportedFlags(). No OpenGL calls are made, so this can run on any thread.
+ */
+int Texture::loadLevels(const char *filename, int flags, Mipmap::MipChain *chain, int *generatemipmaps)
+{
+	size_t namelength = strlen(filename);
+	int ktx = namelength > 4 && strcmp(filename + namelength - 4, ".ktx") == 0;
+	int compress = !ktx && (flags & TEXTURE_COMPRESS);
+
+	*generatemipmaps = GL_FALSE;
+	if(ktx)
+	{
+		return this->loadKTX(filename, chain, generatemipmaps);	// Maps the file into the chain
+	}
+	if(compress || (flags & TEXTURE_MIPMAP_FILTERS))
+	{
+		return this->loadMipmaps(filename, flags, compress, chain);	// From the cache, or made on the CPU
+	}
+	if(!this->loadTGA(filename, flags))								// Sets this->imageData from the TGA file
+	{
+		return GL_FALSE;
+	}
+	// Level 0 only, straight from the file mapping (or the decoded data)
+	memset(chain, 0, sizeof(Mipmap::MipChain));
+	Mipmap::setLayout(chain, this->width, this->height, this->bpp / 8, 0, 1);
+	chain->data = this->imageData;
+	*generatemipmaps = GL_TRUE;
+	return GL_TRUE;
+}
+
+/*
+ * Load and activate a 2D texture from a TGA or KTX file
+ */
+void Texture::createTexture(const char *filename, int flags) {
+
+    Mipmap::MipChain chain;
+    int generatemipmaps;
+
+    flags = supportedFlags(flags);
+    if(!this->loadLevels(filename, flags, &chain, &generatemipmaps)) { // Private method, fills in the mip chain
+        return;
+    }
 
-	glEnable(GL_TEXTURE_2D); // Required for glBuildMipmap() to work (!)
 	glGenTextures(1, &(this->textureID));     // Create The texture ID
-    glBindTexture ( GL_TEXTURE_2D , this->textureID );
+    GLState::bindTexture( GL_TEXTURE_2D , this->textureID );
     // Set parameters to determine how the texture is resized
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MIN_FILTER , GL_LINEAR_MIPMAP_LINEAR );
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_MAG_FILTER , GL_LINEAR );
     // Set parameters to determine how the texture wraps at edges
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_WRAP_S , GL_REPEAT );
     glTexParameteri ( GL_TEXTURE_2D , GL_TEXTURE_WRAP_T , GL_REPEAT );
-    // Read the texture data from file and upload it to the GPU
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, this->width, this->height, 0,
-		this->type, GL_UNSIGNED_BYTE, this->imageData);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	delete[] this->imageData; // Image data was copied to the GPU, so we can delete it
+    // TGA rows are tightly packed, and 24-bit rows need not be a multiple of 4 bytes
+    glPixelStorei ( GL_UNPACK_ALIGNMENT , 1 );
+    // Upload the levels we have straight from memory to the GPU.
+    // The driver reads the BGR(A) order natively, so no swizzling is needed.
+    this->uploadMipmaps(&chain);
+    if(generatemipmaps) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000); // The default
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    Mipmap::release(&chain);
+    unloadTGA(); // Image data was copied to the GPU, so we can release the file
+    glPixelStorei ( GL_UNPACK_ALIGNMENT , 4 ); // Restore the default
 }
@@ -2,8 +2,20 @@
 /* Class to manage an OpenGL texture, and load texture data from a TGA file. */
 /* Modified, stripped-down and cleaned-up version of TGA loader from NeHe tutorial 33. */
 /* Usage: Call createTexture() with a TGA file as argument to load a texture,
- * or use the constructor with a file name argument. Uncompressed RGB or RGBA only.
- * Call glBindTexture() with the public member textureID as argument. */
+ * or use the constructor with a file name argument. Uncompressed or RLE compressed
+ * RGB or RGBA only. Call GLState::bindTexture() with the public member textureID as argument. */
+/* Mipmaps are made by glGenerateMipmap(), unless one of the
+ * TEXTURE_MIPMAP_xxx filter flags is given. Then they are made on the CPU
+ * and cached on disk next to the TGA file (see Mipmap.hpp), so later loads
+ * just upload the cached levels. */
+/* With TEXTURE_COMPRESS, the mipmaps are also encoded to BC1 (RGB) or BC3 (RGBA)
+ * and cached, if the OpenGL driver supports EXT_texture_compression_s3tc. */
+/* A file name ending in ".ktx" is loaded as a KTX file (see Ktx.hpp), and
+ * all its levels are uploaded as they are. The flags are ignored then. */
+/* The TGA file is memory mapped, and the pixels are handed to OpenGL
+ * directly from the mapping in their native BGR(A) order.
+ * RLE compressed files are decoded into a separate buffer first, as are
+ * files that need conversions the driver can't do (see PixelFormat.hpp). */
 /* Stefan Gustavson (stefan.gustavson@liu.se 2014-02-28 */
 
 #ifndef TEXTURE_HPP
@@ -23,6 +35,21 @@
 #include <cstring> // For memcmp() - a remnant from the C code
 
 #include "Utilities.hpp" // For GL extensions (glGenerateMipmap) in Windows
+#include "PixelFormat.hpp" // For pixel conversions the driver can't do
+#include "Mipmap.hpp" // For mipmaps made on the CPU
+#include "BlockCompress.hpp" // For BC1/BC3 compression
+#include "Ktx.hpp" // For KTX files
+
+// Flags for createTexture(), combined with bitwise OR
+enum {
+	TEXTURE_PREMULTIPLY_ALPHA = 1,  // Multiply RGB by alpha before uploading (RGBA images only)
+	TEXTURE_MIPMAP_BOX        = 2,  // Make mipmaps on the CPU with a box filter
+	TEXTURE_MIPMAP_LANCZOS    = 4,  // Make mipmaps on the CPU with a Lanczos filter
+	TEXTURE_MIPMAP_KAISER     = 8,  // Make mipmaps on the CPU with a Kaiser filter
+	TEXTURE_MIPMAP_GAMMA      = 16, // Filter CPU mipmaps in linear light (treat the image as sRGB)
+	TEXTURE_COMPRESS          = 32, // Store as BC1/BC3 on the GPU, if supported (implies CPU mipmaps)
+	TEXTURE_MIPMAP_FILTERS    = TEXTURE_MIPMAP_BOX | TEXTURE_MIPMAP_LANCZOS | TEXTURE_MIPMAP_KAISER
+};
 
 
 class Texture {
@@ -32,12 +59,17 @@ public:
 GLuint	width;	    // Image width
 GLuint	height;	    // Image height
 GLuint	textureID;  // Texture ID for OpenGL
-GLuint	type;	    // Image type (3 bytes per pixel: GL_RGB, 4 bytes: GL_RGBA)
+GLuint	type;	    // Pixel format in the file (3 bytes per pixel: GL_BGR, 4 bytes: GL_BGRA)
+GLuint	internalFormat; // Texture format on the GPU (GL_RGB8, GL_RGBA8 or a compressed format)
+GLuint	residentLevel;  // Finest mip level uploaded so far (0 when all are, set by TextureStreamer)
 
 private:
 
-GLubyte	*imageData;	// Image data (3 or 4 bytes per pixel)
+const GLubyte *imageData; // Image data (3 or 4 bytes per pixel), points into the mapped file
+GLubyte *decodedData;     // Buffer for decompressed image data (RLE files only), or NULL
 GLuint	bpp;		// Image color depth in bits per pixel
+GLenum	pixelType;	// Type of each pixel component for uploads (GL_UNSIGNED_BYTE for TGA)
+Utilities::MappedFile file; // Memory mapping of the TGA file while it is being loaded
 
 public:
 
@@ -45,37 +77,55 @@ public:
 Texture();
 
 /* Constructor to load and intialize the texture all at once */
-Texture(const char *filename);
+Texture(const char *filename, int flags = 0);
 
 /* Destructor */
 ~Texture();
 
 // The external entry point for loading a texture from a TGA file
-void createTexture(const char *filename); // Load GL texture from file
+void createTexture(const char *filename, int flags = 0); // Load GL texture from file
 
 private:
 
 // Internal "private" funtions, called internally by createTexture()
-int loadUncompressedTGA(FILE *tgafile); // Load data from an uncompressed TGA file
-int loadTGA(const char *filename);		    // Open, check and load a TGA file
+void setFormat(GLuint bytesperpixel);           // Set bpp and the GL pixel formats
+int readTGAInfo(const GLubyte *header);         // Check and set width, height and pixel format
+int loadUncompressedTGA(const GLubyte *header); // Point imageData to the pixels of an uncompressed TGA
+int loadCompressedTGA(const GLubyte *header);   // Decode the pixels of an RLE compressed TGA
+int convertTGA(int flags);                  // Flip rows and premultiply alpha, if needed
+int loadTGA(const char *filename, int flags); // Map, check and load a TGA file
+void unloadTGA();                           // Release the file mapping and decoded data
+int loadMipmaps(const char *filename, int flags, int compress, Mipmap::MipChain *chain); // Get CPU mipmaps from cache or TGA
+void setCompressedFormat();                  // Set internalFormat to BC1 or BC3
+void uploadMipmaps(const Mipmap::MipChain *chain); // Upload all levels of a mip chain
+int loadKTX(const char *filename, Mipmap::MipChain *chain, int *generatemipmaps); // Map a KTX file
+int loadLevels(const char *filename, int flags, Mipmap::MipChain *chain, int *generatemipmaps); // Get a mip chain from any file
+static int supportedFlags(int flags);        // Drop flags the driver can't handle, before loadLevels()
+
+friend class TextureArray;    // Uses loadLevels() for each of its layers
+friend class TextureStreamer; // Uses loadLevels() on its worker thread
 
 };
 
-// Two convenient structs to read and interpret TGA file information
-typedef struct
-{
-	GLubyte Header[12];	// TGA File Header
-} TGAHeader;
-
-typedef struct
-{
-	GLubyte		header[6];								// First 6 useful bytes from the header
-	GLuint		bytesPerPixel;							// Holds number of bytes per pixel used in the TGA file
-	GLuint		imageSize;								// Data size in bytes
-	GLuint		type;
-	GLuint		height;									//Height of Image
-	GLuint		width;									//Width ofImage
-	GLuint		bpp;									// Bits Per Pixel
-} TGA;
+/*
+ * decodeRLE() - Decode TGA run-length encoded pixel data.
+ * Reads packets from src (at most srcsize bytes) until numpixels pixels of
+ * bytesperpixel bytes each have been written to dst. Returns the number of
+ * source bytes consumed, or 0 if the data is truncated or corrupt.
+ */
+size_t decodeRLE(const GLubyte *src, size_t srcsize, GLubyte *dst,
+                 size_t numpixels, unsigned int bytesperpixel);
+
+// Byte offsets of the fields we use in the 18-byte TGA file header
+enum {
+	TGA_IDLENGTH     = 0,  // Length of the image ID field following the header
+	TGA_COLORMAPTYPE = 1,  // 0 means no color map
+	TGA_IMAGETYPE    = 2,  // 2 is uncompressed truecolor, 10 is RLE truecolor
+	TGA_WIDTH        = 12, // 16 bits, little endian
+	TGA_HEIGHT       = 14, // 16 bits, little endian
+	TGA_BPP          = 16, // Bits per pixel
+	TGA_DESCRIPTOR   = 17, // Alpha bits and pixel origin
+	TGA_HEADERSIZE   = 18
+};
 
 #endif // TEXTURE_HPP
@@ -0,0 +1,131 @@
+#include "TextureArray.hpp"
+#include "GLState.hpp"
+
+/* Constructor */
+TextureArray::TextureArray() {
+    width = 0;
+    height = 0;
+    layers = 0;
+    textureID = 0;
+    internalFormat = 0;
+}
+
+/* Constructor to load and intialize the texture array all at once */
+TextureArray::TextureArray(const char **filenames, int numfiles, int flags) {
+    width = 0;
+    height = 0;
+    layers = 0;
+    textureID = 0;
+    internalFormat = 0;
+    createTextureArray(filenames, numfiles, flags);
+}
+
+/* Destructor */
+TextureArray::~TextureArray() {
+}
+
+
+/*
+ * uploadLayer(GLuint layer, const Texture *image, const Mipmap::MipChain *chain)
+ * Fill in all levels of one layer of the bound array texture. The storage
+ * for all layers is allocated together with layer 0, which comes first.
+ */
+void TextureArray::uploadLayer(GLuint layer, const Texture *image, const Mipmap::MipChain *chain)
+{
+	GLuint level;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, chain->rowalignment);
+	for(level = 0; level < chain->numlevels; level++)
+	{
+		GLuint w = chain->width[level], h = chain->height[level];
+		const GLubyte *data = chain->data + chain->offset[level];
+		if(chain->blockbytes > 0)
+		{
+			GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * chain->blockbytes;
+			if(layer == 0)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, this->internalFormat,
+					w, h, this->layers, 0, size * this->layers, NULL);
+			}
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+				this->internalFormat, size, data);
+		}
+		else
+		{
+			if(layer == 0)
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, this->internalFormat,
+					w, h, this->layers, 0, image->type, image->pixelType, NULL);
+			}
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+				image->type, image->pixelType, data);
+		}
+	}
+}
+
+/*
+ * Load and activate a 2D array texture from a list of TGA or KTX files.
+ * The files are loaded one at a time, and each one is released
+ * as soon as its layer is uploaded.
+ */
+void TextureArray::createTextureArray(const char **filenames, int numfiles, int flags) {
+
+    GLuint numlevels = 0;
+    int generatemipmaps = GL_FALSE;
+    int ok = GL_TRUE;
+
+    if(numfiles < 1 || numfiles > TEXTUREARRAY_MAXLAYERS) {
+        fprintf(stderr, "A texture array needs 1 to %d files, not %d.\n", TEXTUREARRAY_MAXLAYERS, numfiles);
+        return;
+    }
+    this->layers = numfiles;
+    flags = Texture::supportedFlags(flags);
+
+	glGenTextures(1, &(this->textureID));     // Create The texture ID
+    GLState::bindTexture( GL_TEXTURE_2D_ARRAY , this->textureID );
+    // Set parameters to determine how the texture is resized
+    glTexParameteri ( GL_TEXTURE_2D_ARRAY , GL_TEXTURE_MIN_FILTER , GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri ( GL_TEXTURE_2D_ARRAY , GL_TEXTURE_MAG_FILTER , GL_LINEAR );
+    // Set parameters to determine how the texture wraps at edges
+    glTexParameteri ( GL_TEXTURE_2D_ARRAY , GL_TEXTURE_WRAP_S , GL_REPEAT );
+    glTexParameteri ( GL_TEXTURE_2D_ARRAY , GL_TEXTURE_WRAP_T , GL_REPEAT );
+
+    for(int layer = 0; layer < numfiles && ok; layer++) {
+        Texture image; // Only used to load the file, it makes no texture of its own
+        Mipmap::MipChain chain;
+        int generate;
+        if(!image.loadLevels(filenames[layer], flags, &chain, &generate)) {
+            ok = GL_FALSE;
+            break;
+        }
+        if(layer == 0) {
+            this->width = image.width;
+            this->height = image.height;
+            this->internalFormat = image.internalFormat;
+            numlevels = chain.numlevels;
+            generatemipmaps = generate;
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, generatemipmaps ? 1000 : numlevels - 1);
+        }
+        else if(image.width != this->width || image.height != this->height
+            || image.internalFormat != this->internalFormat || chain.numlevels != numlevels) {
+            fprintf(stderr, "%s does not match the size and format of %s.\n", filenames[layer], filenames[0]);
+            ok = GL_FALSE;
+        }
+        if(ok) {
+            this->uploadLayer(layer, &image, &chain);
+        }
+        Mipmap::release(&chain);
+        image.unloadTGA(); // Image data was copied to the GPU, so we can release the file
+    }
+    glPixelStorei ( GL_UNPACK_ALIGNMENT , 4 ); // Restore the default
+
+    if(!ok) {
+        GLState::deleteTextures(1, &(this->textureID));
+        this->textureID = 0;
+        this->layers = 0;
+        return;
+    }
+    if(generatemipmaps) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+}
@@ -0,0 +1,50 @@
+/* TextureArray.hpp */
+/* Class to manage an OpenGL 2D array texture, made from several image files
+ * of the same size and format, one file per layer. */
+/* Usage: call createTextureArray() with a list of TGA or KTX files, or use
+ * the constructor with the same arguments. The flags are the same as for
+ * Texture (see Texture.hpp), and apply to all layers. Bind it with
+ * GLState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID), and sample it in
+ * a shader with a sampler2DArray and texture(tex, vec3(st, layer)), where
+ * layer is the index of the file in the list. One binding then serves all
+ * the objects that use any of the images, so they can all be drawn in
+ * a single instanced draw call with the layer as a per-instance value. */
+
+#ifndef TEXTUREARRAY_HPP
+#define TEXTUREARRAY_HPP
+
+#include "Texture.hpp" // For the file loading and the flags
+
+// Shaders must be able to index this many layers (the minimum of GL 3.3 is 256)
+#define TEXTUREARRAY_MAXLAYERS 256
+
+class TextureArray {
+
+public:
+
+GLuint	width;	    // Width of each layer
+GLuint	height;	    // Height of each layer
+GLuint	layers;	    // Number of layers, the same as the number of files
+GLuint	textureID;  // Texture ID for OpenGL, to bind to GL_TEXTURE_2D_ARRAY
+GLuint	internalFormat; // Texture format on the GPU, the same for all layers
+
+/* Constructor */
+TextureArray();
+
+/* Constructor to load and intialize the texture array all at once */
+TextureArray(const char **filenames, int numfiles, int flags = 0);
+
+/* Destructor */
+~TextureArray();
+
+// Load all files, one per layer. They must all have the same size and format.
+void createTextureArray(const char **filenames, int numfiles, int flags = 0);
+
+private:
+
+// Upload the levels of one layer (allocating the texture for layer 0)
+void uploadLayer(GLuint layer, const Texture *image, const Mipmap::MipChain *chain);
+
+};
+
+#endif // TEXTUREARRAY_HPP
@@ -0,0 +1,563 @@
+#include "TextureStreamer.hpp"
+#include "GLState.hpp"
+
+#include <string>
+#include <cmath> // For sqrtf()
+
+// Job states
+enum {
+	JOB_LOADING,   // The worker is reading the file
+	JOB_LOADED,    // The levels are ready, the texture is not allocated yet
+	JOB_UPLOADING, // Pieces of the levels are going through the buffers
+	JOB_FAILED     // The file could not be loaded
+};
+
+// Slot states
+enum {
+	SLOT_FREE,     // Ready for a new piece
+	SLOT_MAPPED,   // Mapped, waiting for the worker to copy a piece into it
+	SLOT_FILLED,   // Filled by the worker, waiting for update() to upload it
+	SLOT_BUSY      // Used by an upload, waiting for its fence
+};
+
+/* One texture being loaded */
+struct TextureStreamer::Job {
+	Texture *texture;       // The texture to fill in
+	Texture loader;         // Loads the file on the worker thread, makes no texture of its own
+	std::string filename;
+	int flags;
+	int state;
+	int progressive;        // Only the wanted levels are sent, and the job stays until forget()
+	int forgotten;          // forget() was called, delete the job when it is idle
+	Mipmap::MipChain chain; // All levels, or level 0 only if generatemipmaps is set
+	int generatemipmaps;
+	int level;              // Next level to send
+	GLuint row;             // Next row to send in that level (of pixels, or of 4x4 blocks if compressed)
+	int piecesleft;         // Pieces sent to the worker but not uploaded yet
+	int resident;           // Finest complete level on the GPU, numlevels if none
+	int allocated;          // Finest level with storage on the GPU, numlevels if none
+	int wanted;             // Finest level to send
+	int initial;            // Wanted level before the texture is seen
+	float pixels;           // Largest screen size reported this frame
+	int unseen;             // Number of frames without a reported screen size
+};
+
+/* One pixel buffer, holding one piece (a band of rows of one level) at a time */
+struct TextureStreamer::Slot {
+	GLuint buffer;          // The pixel buffer object
+	size_t capacity;        // Its size in bytes
+	GLsync fence;           // Signaled when the GPU is done reading the buffer
+	unsigned char *mapped;  // Mapping of the buffer while the worker fills it
+	int state;
+	Job *job;
+	GLuint level;
+	GLuint firstrow;
+	GLuint numrows;
+	size_t offset;          // Start of the piece in the chain data
+	size_t size;            // Size of the piece in bytes
+};
+
+
+/* Constructor */
+TextureStreamer::TextureStreamer(size_t budget) {
+	this->budget = budget;
+	this->stopping = GL_FALSE;
+	this->slots = new Slot[TEXTURESTREAMER_BUFFERS];
+	memset(this->slots, 0, TEXTURESTREAMER_BUFFERS * sizeof(Slot)); // The buffers are made by update()
+	this->worker = std::thread(&TextureStreamer::work, this);
+}
+
+/* Destructor */
+TextureStreamer::~TextureStreamer() {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = GL_TRUE;
+	}
+	this->wakeup.notify_one();
+	this->worker.join();
+	for(size_t i = 0; i < this->jobs.size(); i++) {
+		Mipmap::release(&this->jobs[i]->chain);
+		delete this->jobs[i];
+	}
+	delete[] this->slots;
+}
+
+void TextureStreamer::setBudget(size_t budget) {
+	this->budget = budget;
+}
+
+/*
+ * screenSize(const GLfloat *P, const GLfloat *MV, GLfloat radius, int viewportheight)
+ * Projected diameter of a bounding sphere, from its distance to the camera
+ * and the vertical scale of the perspective matrix P.
+ */
+float TextureStreamer::screenSize(const GLfloat *P, const GLfloat *MV, GLfloat radius, int viewportheight) {
+
+	float z = -MV[14]; // Distance of the center in front of the camera
+	float scale = sqrtf(MV[0]*MV[0] + MV[1]*MV[1] + MV[2]*MV[2]); // Any scaling in MV
+	float r = radius * scale;
+	if(z <= r) return 1.0e6f; // The camera is inside or right next to the sphere
+	return r * P[5] * viewportheight / z;
+}
+
+/*
+ * addJob(Texture *texture, const char *filename, int flags, int progressive)
+ * Queue a texture for loading. The texture ID is made right away.
+ */
+void TextureStreamer::addJob(Texture *texture, const char *filename, int flags, int progressive) {
+
+	Job *job = new Job;
+	job->texture = texture;
+	job->filename = filename;
+	job->flags = flags;
+	job->state = JOB_LOADING;
+	job->progressive = progressive;
+	job->forgotten = GL_FALSE;
+	memset(&job->chain, 0, sizeof(Mipmap::MipChain));
+	job->generatemipmaps = GL_FALSE;
+	job->level = 0;
+	job->row = 0;
+	job->piecesleft = 0;
+	job->resident = 0;
+	job->allocated = 0;
+	job->wanted = 0;
+	job->initial = 0;
+	job->pixels = 0.0f;
+	job->unseen = 0;
+	glGenTextures(1, &(texture->textureID));
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push_back(job);
+		this->loads.push_back(job);
+	}
+	this->wakeup.notify_one();
+}
+
+void TextureStreamer::load(Texture *texture, const char *filename, int flags) {
+	this->addJob(texture, filename, Texture::supportedFlags(flags), GL_FALSE); // Needs the GL context, so not on the worker
+}
+
+void TextureStreamer::loadProgressive(Texture *texture, const char *filename, int flags) {
+	flags = Texture::supportedFlags(flags);
+	if(!(flags & (TEXTURE_MIPMAP_FILTERS | TEXTURE_COMPRESS))) {
+		flags |= TEXTURE_MIPMAP_BOX; // We need all levels on the CPU
+	}
+	this->addJob(texture, filename, flags, GL_TRUE);
+}
+
+TextureStreamer::Job *TextureStreamer::findJob(const Texture *texture) {
+	for(size_t i = 0; i < this->jobs.size(); i++) {
+		if(this->jobs[i]->texture == texture && !this->jobs[i]->forgotten) return this->jobs[i];
+	}
+	return NULL;
+}
+
+void TextureStreamer::reportScreenSize(Texture *texture, float pixels) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Job *job = this->findJob(texture);
+	if(job && pixels > job->pixels) job->pixels = pixels;
+}
+
+/*
+ * forget(Texture *texture)
+ * Stop loading or streaming a texture. The texture is not touched after
+ * this, so it may be deleted right away. A job the worker hasn't started
+ * is deleted at once, otherwise update() deletes it when the worker is
+ * done with it.
+ */
+void TextureStreamer::forget(Texture *texture) {
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	Job *job = this->findJob(texture);
+	if(job == NULL) return;
+	job->forgotten = GL_TRUE;
+	for(size_t i = 0; i < this->loads.size(); i++) {
+		if(this->loads[i] == job) {
+			this->loads.erase(this->loads.begin() + i);
+			for(size_t j = 0; j < this->jobs.size(); j++) {
+				if(this->jobs[j] == job) this->jobs.erase(this->jobs.begin() + j);
+			}
+			delete job;
+			return;
+		}
+	}
+}
+
+int TextureStreamer::pending() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	int count = 0;
+	for(size_t i = 0; i < this->jobs.size(); i++) {
+		const Job *job = this->jobs[i];
+		if(job->forgotten || job->state == JOB_FAILED) continue;
+		if(job->state != JOB_UPLOADING || job->resident > job->wanted) count++;
+	}
+	return count;
+}
+
+/*
+ * startJob(Job *job)
+ * Copy the formats of a loaded file to its texture. No level is complete
+ * yet, so the base level is set to the smallest one, which comes first.
+ */
+void TextureStreamer::startJob(Job *job) {
+
+	Texture *texture = job->texture;
+	const Mipmap::MipChain *chain = &job->chain;
+	int numlevels = chain->numlevels;
+
+	texture->width = job->loader.width;
+	texture->height = job->loader.height;
+	texture->type = job->loader.type;
+	texture->internalFormat = job->loader.internalFormat;
+	texture->pixelType = job->loader.pixelType;
+	texture->bpp = job->loader.bpp;
+	texture->residentLevel = numlevels;
+
+	GLState::bindTexture(GL_TEXTURE_2D, texture->textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numlevels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, numlevels - 1);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+	job->level = numlevels - 1;
+	job->row = 0;
+	job->resident = numlevels;
+	job->allocated = numlevels;
+	job->initial = 0;
+	if(job->progressive) { // Start with the levels up to TEXTURESTREAMER_INITIALSIZE
+		job->initial = numlevels - 1;
+		while(job->initial > 0 && chain->width[job->initial - 1] <= TEXTURESTREAMER_INITIALSIZE
+			&& chain->height[job->initial - 1] <= TEXTURESTREAMER_INITIALSIZE) {
+			job->initial--;
+		}
+	}
+	job->wanted = job->initial;
+	job->state = JOB_UPLOADING;
+}
+
+/*
+ * allocateLevel(Job *job, int level, int empty)
+ * Give a level of the bound texture its storage, or free it if empty is set.
+ */
+void TextureStreamer::allocateLevel(Job *job, int level, int empty) {
+
+	const Texture *texture = job->texture;
+	const Mipmap::MipChain *chain = &job->chain;
+
+	GLuint w = empty ? 0 : chain->width[level];
+	GLuint h = empty ? 0 : chain->height[level];
+	if(chain->blockbytes > 0) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->internalFormat, w, h, 0,
+			((w + 3) / 4) * ((h + 3) / 4) * chain->blockbytes, NULL);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, level, texture->internalFormat, w, h, 0,
+			texture->type, texture->pixelType, NULL);
+	}
+}
+
+/*
+ * nextJob()
+ * Pick the job to send the next piece for. Coarser levels go first,
+ * across all textures, so every texture gets usable as soon as possible.
+ * A job waits at the end of each level until all its pieces are uploaded.
+ */
+TextureStreamer::Job *TextureStreamer::nextJob() {
+
+	Job *best = NULL;
+	for(size_t i = 0; i < this->jobs.size(); i++) {
+		Job *job = this->jobs[i];
+		if(job->state != JOB_UPLOADING || job->forgotten) continue;
+		if(job->level < 0) continue; // Has all levels
+		if(job->row == 0 && job->level < job->wanted) continue; // Has all it needs, a started level is finished
+		if(job->row == 0 && job->piecesleft > 0) continue; // Finishing the level above
+		if(best == NULL || job->level > best->level) best = job;
+	}
+	return best;
+}
+
+/*
+ * fillSlot(Slot *slot, size_t budget)
+ * Map a free buffer and queue the next piece of a job for the worker
+ * to copy into it. The piece is as many whole rows as fit in the
+ * budget, but at least one. Returns the size of the piece, 0 if there
+ * is nothing to send.
+ */
+size_t TextureStreamer::fillSlot(Slot *slot, size_t budget) {
+
+	Job *job = this->nextJob();
+	if(job == NULL) return 0;
+	const Mipmap::MipChain *chain = &job->chain;
+
+	GLuint level = job->level;
+	GLuint numrows = chain->blockbytes > 0 ? (chain->height[level] + 3) / 4 : chain->height[level];
+	size_t rowbytes = chain->levelsize[level] / numrows;
+	GLuint rows = budget / rowbytes < numrows ? (GLuint)(budget / rowbytes) : numrows;
+	if(rows < 1) rows = 1;
+	if(rows > numrows - job->row) rows = numrows - job->row;
+	size_t size = rows * rowbytes;
+
+	if(job->allocated > (int)level) { // First piece of a new level
+		GLState::bindTexture(GL_TEXTURE_2D, job->texture->textureID);
+		allocateLevel(job, level, GL_FALSE);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+		job->allocated = level;
+	}
+
+	if(slot->buffer == 0) glGenBuffers(1, &(slot->buffer));
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+	if(size > slot->capacity) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		slot->capacity = size;
+	}
+	// The fence has passed, so the buffer can be mapped without waiting
+	slot->mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if(slot->mapped == NULL) {
+		Utilities::printError("Texture streaming error", "Could not map a pixel buffer");
+		return 0;
+	}
+
+	slot->job = job;
+	slot->level = level;
+	slot->firstrow = job->row;
+	slot->numrows = rows;
+	slot->offset = chain->offset[level] + job->row * rowbytes;
+	slot->size = size;
+	slot->state = SLOT_MAPPED;
+	this->fills.push_back(slot);
+	job->piecesleft++;
+	job->row += rows;
+	if(job->row == numrows) {
+		job->level--;
+		job->row = 0;
+	}
+	return size;
+}
+
+/*
+ * submitSlot(Slot *slot)
+ * Upload a filled buffer to its texture, and fence it. When the last
+ * piece of a level is in, that level becomes the base level.
+ */
+void TextureStreamer::submitSlot(Slot *slot) {
+
+	Job *job = slot->job;
+	const Mipmap::MipChain *chain = &job->chain;
+	GLuint w = chain->width[slot->level];
+
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+	if(!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+		Utilities::printError("Texture streaming error", "Pixel buffer contents were lost");
+	}
+	slot->mapped = NULL;
+	slot->job = NULL;
+	job->piecesleft--;
+	if(job->forgotten) { // The texture may be gone, so drop the piece
+		GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		slot->state = SLOT_FREE;
+		return;
+	}
+
+	GLState::bindTexture(GL_TEXTURE_2D, job->texture->textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, chain->rowalignment);
+	if(chain->blockbytes > 0) {
+		GLuint y = 4 * slot->firstrow;
+		GLuint h = 4 * slot->numrows < chain->height[slot->level] - y ? 4 * slot->numrows : chain->height[slot->level] - y;
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, slot->level, 0, y, w, h,
+			job->texture->internalFormat, slot->size, (void*)0); // From offset 0 in the buffer
+	}
+	else {
+		glTexSubImage2D(GL_TEXTURE_2D, slot->level, 0, slot->firstrow, w, slot->numrows,
+			job->texture->type, job->texture->pixelType, (void*)0); // From offset 0 in the buffer
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // Restore the default
+	GLState::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->state = SLOT_BUSY;
+	if(job->piecesleft == 0 && job->row == 0) { // All of the level above job->level is in
+		job->resident = job->level + 1;
+		job->texture->residentLevel = job->resident;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job->resident);
+	}
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+ * setWantedLevel(Job *job)
+ * Pick the coarsest level that still has at least as many texels along
+ * its longer side as the largest size on screen reported this frame.
+ */
+void TextureStreamer::setWantedLevel(Job *job) {
+
+	const Mipmap::MipChain *chain = &job->chain;
+	if(job->pixels > 0.0f) {
+		int level = 0;
+		while(level + 1 < (int)chain->numlevels
+			&& (chain->width[level + 1] >= job->pixels || chain->height[level + 1] >= job->pixels)) {
+			level++;
+		}
+		job->wanted = level;
+		job->unseen = 0;
+	}
+	else if(++job->unseen >= TEXTURESTREAMER_UNSEENFRAMES) {
+		job->wanted = job->initial;
+	}
+	job->pixels = 0.0f;
+}
+
+/*
+ * dropLevels(Job *job)
+ * Free the finer levels of a progressive texture when it needs at least
+ * two levels less than it has. (One level of slack keeps a texture on the
+ * edge between two levels from going back and forth.)
+ */
+void TextureStreamer::dropLevels(Job *job) {
+
+	if(job->wanted <= job->resident + 1) return;
+	if(job->row > 0 || job->piecesleft > 0) return; // Wait for the level in progress
+	GLState::bindTexture(GL_TEXTURE_2D, job->texture->textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job->wanted);
+	for(int level = job->allocated; level < job->wanted; level++) {
+		allocateLevel(job, level, GL_TRUE);
+	}
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	job->resident = job->wanted;
+	job->allocated = job->wanted;
+	job->level = job->wanted - 1;
+	job->texture->residentLevel = job->resident;
+}
+
+/*
+ * finishJob(Job *job)
+ * Make the mipmaps if the file had none, and release the file.
+ */
+void TextureStreamer::finishJob(Job *job) {
+
+	if(job->generatemipmaps && !job->forgotten) {
+		GLState::bindTexture(GL_TEXTURE_2D, job->texture->textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000); // The default
+		glGenerateMipmap(GL_TEXTURE_2D);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
+	}
+	Mipmap::release(&job->chain);
+	job->loader.unloadTGA();
+}
+
+/*
+ * update()
+ * Upload the pieces the worker has copied, recycle the buffers the GPU is
+ * done with, update the levels wanted by progressive textures, and hand
+ * free buffers to the worker for the next pieces. The worker loads the
+ * next files in the background meanwhile.
+ */
+void TextureStreamer::update() {
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	size_t sent = 0;
+	int i;
+
+	for(i = 0; i < TEXTURESTREAMER_BUFFERS; i++) {
+		Slot *slot = &this->slots[i];
+		if(slot->state == SLOT_FILLED) {
+			this->submitSlot(slot);
+		}
+		else if(slot->state == SLOT_BUSY) {
+			GLenum status = glClientWaitSync(slot->fence, 0, 0); // Just check, don't wait
+			if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+				glDeleteSync(slot->fence);
+				slot->fence = 0;
+				slot->state = SLOT_FREE;
+			}
+		}
+	}
+
+	for(size_t j = 0; j < this->jobs.size(); ) {
+		Job *job = this->jobs[j];
+		int done = GL_FALSE;
+		if(job->state == JOB_LOADING) {
+			j++;
+			continue;
+		}
+		if(job->state == JOB_FAILED) { // The loader has printed an error, and the texture stays empty
+			done = GL_TRUE;
+		}
+		else if(job->forgotten) {
+			done = job->piecesleft == 0;
+		}
+		else {
+			if(job->state == JOB_LOADED) {
+				this->startJob(job);
+			}
+			if(job->progressive) {
+				this->setWantedLevel(job);
+				this->dropLevels(job);
+			}
+			else {
+				done = job->resident == 0 && job->piecesleft == 0;
+			}
+		}
+		if(done) {
+			this->finishJob(job);
+			this->jobs.erase(this->jobs.begin() + j);
+			delete job;
+		}
+		else {
+			j++;
+		}
+	}
+
+	for(i = 0; i < TEXTURESTREAMER_BUFFERS; i++) {
+		Slot *slot = &this->slots[i];
+		if(slot->state != SLOT_FREE) continue;
+		size_t left = (size_t)-1;
+		if(this->budget > 0) {
+			if(sent >= this->budget) break;
+			left = this->budget - sent;
+		}
+		size_t size = this->fillSlot(slot, left);
+		if(size == 0) break;
+		sent += size;
+	}
+	if(sent > 0) {
+		this->wakeup.notify_one();
+	}
+}
+
+/*
+ * work()
+ * The worker thread. Filling buffers comes first, so that uploads keep
+ * going while the next files are loaded.
+ */
+void TextureStreamer::work() {
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while(true) {
+		while(!this->stopping && this->fills.empty() && this->loads.empty()) {
+			this->wakeup.wait(lock);
+		}
+		if(this->stopping) return;
+		if(!this->fills.empty()) {
+			Slot *slot = this->fills.front();
+			this->fills.pop_front();
+			lock.unlock();
+			memcpy(slot->mapped, slot->job->chain.data + slot->offset, slot->size);
+			lock.lock();
+			slot->state = SLOT_FILLED;
+		}
+		else {
+			Job *job = this->loads.front();
+			this->loads.pop_front();
+			lock.unlock();
+			int ok = job->loader.loadLevels(job->filename.c_str(), job->flags, &job->chain, &job->generatemipmaps);
+			lock.lock();
+			job->state = ok ? JOB_LOADED : JOB_FAILED;
+		}
+	}
+}
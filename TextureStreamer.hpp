@@ -0,0 +1,115 @@
+/* TextureStreamer.hpp */
+/* Class to load textures in the background while rendering goes on. */
+/* Usage: call load() with a Texture and a TGA or KTX file name. The texture
+ * gets its textureID right away, and can be bound and drawn with before it
+ * is loaded (it is incomplete, and reads as black until then). Call update()
+ * once per frame to move the loading along.
+ * The file is read, decoded and mipmapped on a worker thread. The pixels
+ * are then copied by the worker into pixel buffer objects (PBOs) that are
+ * mapped for it, and update() uploads them to the texture from there. The
+ * buffers are reused only when a fence says the GPU is done with them, so
+ * no call waits for the driver to copy pixels.
+ * At most the byte budget set by setBudget() is handed to the worker per
+ * frame, so a large texture is spread over several frames. At least one
+ * row is always sent, to make progress with any budget.
+ * Levels are sent smallest first, and GL_TEXTURE_BASE_LEVEL follows the
+ * finest level that is complete, so a texture is usable (if blurry) as
+ * soon as its smallest levels are in, which is almost at once.
+ * Textures loaded with loadProgressive() only get the levels they need.
+ * Call reportScreenSize() every frame for each object that uses such a
+ * texture, with its size on screen from screenSize(). Finer levels are
+ * then streamed in as the object comes closer, and dropped from the GPU
+ * when it moves away or is not drawn for a while, to bound the memory use.
+ * The Texture objects must stay alive until pending() reports them done,
+ * or for progressive textures, until forget() is called for them.
+ * Like Texture, this class leaves its OpenGL objects to be deleted with
+ * the context, so it can be destroyed after the window is closed. */
+
+#ifndef TEXTURESTREAMER_HPP
+#define TEXTURESTREAMER_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "Texture.hpp" // For the file loading and the flags
+
+// Number of pixel buffers, so one can be filled while another is in use
+#define TEXTURESTREAMER_BUFFERS 2
+
+// Progressive textures start with the levels up to this size, until they are seen
+#define TEXTURESTREAMER_INITIALSIZE 64
+
+// Progressive textures that are not seen for this many frames drop to the initial size
+#define TEXTURESTREAMER_UNSEENFRAMES 120
+
+class TextureStreamer {
+
+public:
+
+/* Constructor. The budget is in bytes per frame, 0 for no limit. */
+TextureStreamer(size_t budget = 4 << 20);
+
+/* Destructor. Stops the worker thread, and drops textures still loading. */
+~TextureStreamer();
+
+// Start loading a texture. flags are the same as for Texture::createTexture().
+void load(Texture *texture, const char *filename, int flags = 0);
+
+// Start loading a texture that only gets the mip levels it needs on screen.
+// Mipmaps are made on the CPU (with a box filter if no filter flag is given).
+void loadProgressive(Texture *texture, const char *filename, int flags = 0);
+
+// Report the size in pixels of an object with a progressive texture this frame
+void reportScreenSize(Texture *texture, float pixels);
+
+// Stop loading or streaming a texture, and release its file. The texture
+// keeps the levels it has, and may be deleted as soon as this returns.
+void forget(Texture *texture);
+
+// Submit finished uploads and start new ones. Call once per frame.
+void update();
+
+// Number of textures that are not completely uploaded yet
+// (progressive textures count until they have the levels they need)
+int pending();
+
+// Set the number of bytes to upload per frame, 0 for no limit
+void setBudget(size_t budget);
+
+// Projected diameter in pixels of a sphere with the given radius, centered at
+// the origin of the modelview matrix MV, in a viewport of the given height
+static float screenSize(const GLfloat *P, const GLfloat *MV, GLfloat radius, int viewportheight);
+
+private:
+
+struct Job;
+struct Slot;
+
+// Internal "private" funtions, called internally by update()
+void addJob(Texture *texture, const char *filename, int flags, int progressive); // Queue a file for the worker
+Job *findJob(const Texture *texture);       // The job for a texture, or NULL
+void startJob(Job *job);                    // Set up the texture for the levels to come
+void allocateLevel(Job *job, int level, int empty); // Make or free the storage of a level
+Job *nextJob();                             // The job that should send the next piece
+size_t fillSlot(Slot *slot, size_t budget); // Map a buffer for the next piece of a job
+void submitSlot(Slot *slot);                // Upload a filled buffer to the texture
+void setWantedLevel(Job *job);              // Pick the finest level a progressive texture needs
+void dropLevels(Job *job);                  // Free levels a progressive texture no longer needs
+void finishJob(Job *job);                   // Set up mipmaps and release the file
+void work();                                // The worker thread
+
+std::deque<Job*> jobs;     // All textures that are loading or streaming
+std::deque<Job*> loads;    // Jobs waiting for the worker to load the file
+std::deque<Slot*> fills;   // Buffers waiting for the worker to fill them
+Slot *slots;               // TEXTURESTREAMER_BUFFERS pixel buffers
+size_t budget;
+int stopping;
+std::mutex mutex;          // Guards the queues and the job and slot states
+std::condition_variable wakeup; // Tells the worker there is something to do
+std::thread worker;
+
+};
+
+#endif // TEXTURESTREAMER_HPP
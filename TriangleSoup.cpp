@@ -1,4 +1,5 @@
 #include "TriangleSoup.hpp"
+#include "GLState.hpp"
 
 /* Constructor: initialize a TriangleSoup object to an empty object */
 TriangleSoup::TriangleSoup() {
@@ -21,17 +22,17 @@ TriangleSoup::~TriangleSoup() {
 void TriangleSoup::clean() {
 
 	if(glIsVertexArray(vao)) {
-		glDeleteVertexArrays(1, &vao);
+		GLState::deleteVertexArrays(1, &vao);
 	}
 	vao = 0;
 
 	if(glIsBuffer(vertexbuffer)) {
-		glDeleteBuffers(1, &vertexbuffer);
+		GLState::deleteBuffers(1, &vertexbuffer);
 	}
 	vertexbuffer = 0;
 
 	if(glIsBuffer(indexbuffer)) {
-		glDeleteBuffers(1, &indexbuffer);
+		GLState::deleteBuffers(1, &indexbuffer);
 	}
 	indexbuffer = 0;
 
@@ -82,14 +83,14 @@ void TriangleSoup::createTriangle() {
 
 	// Generate one vertex array object (VAO) and bind it
 	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 
 	// Generate two buffer IDs
 	glGenBuffers(1, &vertexbuffer);
 	glGenBuffers(1, &indexbuffer);
 
  	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
  	// Present our vertex coordinates to OpenGL
 	glBufferData(GL_ARRAY_BUFFER,
 		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
@@ -112,7 +113,7 @@ void TriangleSoup::createTriangle() {
 		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
 
  	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
  	// Present our vertex indices to OpenGL
  	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
@@ -120,9 +121,9 @@ void TriangleSoup::createTriangle() {
 	// Deactivate (unbind) the VAO and the buffers again.
 	// Do NOT unbind the index buffer while the VAO is still bound.
 	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 
@@ -210,14 +211,14 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
 
 	// Generate one vertex array object (VAO) and bind it
 	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 
 	// Generate two buffer IDs
 	glGenBuffers(1, &vertexbuffer);
 	glGenBuffers(1, &indexbuffer);
 
  	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
  	// Present our vertex coordinates to OpenGL
 	glBufferData(GL_ARRAY_BUFFER,
 		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
@@ -240,7 +241,7 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
 		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
 
  	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
  	// Present our vertex indices to OpenGL
  	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
@@ -248,9 +249,9 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
 	// Deactivate (unbind) the VAO and the buffers again.
 	// Do NOT unbind the index buffer while the VAO is still bound.
 	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 
@@ -365,14 +366,14 @@ void TriangleSoup::createSphere(float radius, int segments) {
 
 	// Generate one vertex array object (VAO) and bind it
 	glGenVertexArrays(1, &(vao));
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 
 	// Generate two buffer IDs
 	glGenBuffers(1, &vertexbuffer);
 	glGenBuffers(1, &indexbuffer);
 
  	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
  	// Present our vertex coordinates to OpenGL
 	glBufferData(GL_ARRAY_BUFFER,
 		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
@@ -395,7 +396,7 @@ void TriangleSoup::createSphere(float radius, int segments) {
 		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
 
  	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
  	// Present our vertex indices to OpenGL
  	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
@@ -404,9 +405,9 @@ void TriangleSoup::createSphere(float radius, int segments) {
 	// Note that the order of these operations matter:
 	// do NOT unbind the buffers while the VAO is still bound.
 	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 }
 
@@ -579,14 +580,14 @@ void TriangleSoup::readOBJ(const char* filename) {
 
 	// Generate one vertex array object (VAO) and bind it
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 
 	// Generate two buffer IDs
 	glGenBuffers(1, &vertexbuffer);
 	glGenBuffers(1, &indexbuffer);
 
  	// Activate the vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
  	// Present our vertex coordinates to OpenGL
 	glBufferData(GL_ARRAY_BUFFER,
 		8*nverts * sizeof(GLfloat), vertexarray, GL_STATIC_DRAW);
@@ -610,7 +611,7 @@ void TriangleSoup::readOBJ(const char* filename) {
 		8*sizeof(GLfloat), (void*)(6*sizeof(GLfloat))); // texcoords
 
  	// Activate the index buffer
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
  	// Present our vertex indices to OpenGL
  	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 	 	3*ntris*sizeof(GLuint), indexarray, GL_STATIC_DRAW);
@@ -618,9 +619,9 @@ void TriangleSoup::readOBJ(const char* filename) {
 	// Deactivate (unbind) the VAO and the buffers again.
 	// Do NOT unbind the buffers while the VAO is still bound.
 	// The index buffer is an essential part of the VAO state.
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
- 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+ 	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	return;
 }
@@ -672,13 +673,58 @@ void TriangleSoup::printInfo() {
      printf("zmax: %8.2f\n", zmax);
 }
 
+/* Radius of a bounding sphere centered at the origin of the object */
+float TriangleSoup::radius() {
+     int i;
+     float x, y, z, r2, r2max = 0.0f;
+
+     for(i=0; i<nverts; i++) {
+         x = vertexarray[8*i];
+         y = vertexarray[8*i+1];
+         z = vertexarray[8*i+2];
+         r2 = x*x + y*y + z*z;
+         if(r2>r2max) r2max = r2;
+     }
+     return sqrtf(r2max);
+}
+
+/* Number of triangles in the index array */
+int TriangleSoup::numTriangles() {
+     return ntris;
+}
+
 /* Render the geometry in a TriangleSoup object */
 void TriangleSoup::render() {
 
-	glBindVertexArray(vao);
+	GLState::bindVertexArray(vao);
 	glDrawElements(GL_TRIANGLES, 3 * ntris, GL_UNSIGNED_INT, (void*)0);
 	// (mode, vertex count, type, element array buffer offset)
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
+
+}
+
+/* Render several instances of the geometry in a TriangleSoup object */
+void TriangleSoup::renderInstanced(int instances) {
+
+	GLState::bindVertexArray(vao);
+	glDrawElementsInstanced(GL_TRIANGLES, 3 * ntris, GL_UNSIGNED_INT, (void*)0, instances);
+	// (mode, vertex count, type, element array buffer offset, number of instances)
+	GLState::bindVertexArray(0);
+
+}
+
+/* Bind the vertex array of a TriangleSoup object, for draw() */
+void TriangleSoup::bind() {
+
+	GLState::bindVertexArray(vao);
+
+}
+
+/* Draw one or more instances, with the vertex array bound by bind() */
+void TriangleSoup::draw(int instances) {
+
+	if(instances == 1) glDrawElements(GL_TRIANGLES, 3 * ntris, GL_UNSIGNED_INT, (void*)0);
+	else glDrawElementsInstanced(GL_TRIANGLES, 3 * ntris, GL_UNSIGNED_INT, (void*)0, instances);
 
 }
 
@@ -7,7 +7,8 @@
  * The method loadOBJ() loads geometry from an OBJ file.
  * Only the mesh is loaded. Material information is ignored.
  * Only triangles are supported. OBJ files with quads are rejected.
- * Call render() to draw the mesh in OpenGL. */
+ * Call render() to draw the mesh in OpenGL, or renderInstanced()
+ * to draw many copies of it at once. */
 /* Author: Stefan Gustavson 2013-2014 (stefan.gustavson@liu.se)
  * This code is in the public domain.
  */
@@ -79,9 +80,25 @@ void print();
 /* Print information about a triangleSoup object (stats and extents) */
 void printInfo();
 
+/* Distance from the origin to the vertex farthest from it, for a bounding sphere */
+float radius();
+
+/* Number of triangles in the mesh, as drawn */
+int numTriangles();
+
 /* Render the geometry in a triangleSoup object */
 void render();
 
+/* Render several copies of the geometry in one draw call.
+ * The shader tells them apart by gl_InstanceID. */
+void renderInstanced(int instances);
+
+/* Bind the vertex array, and draw with it already bound, for callers
+ * that sort their draw calls by mesh to bind each one only once
+ * (see RenderQueue.hpp). draw() leaves the vertex array bound. */
+void bind();
+void draw(int instances = 1);
+
 private:
 
 void printError(const char *errtype, const char *errmsg);
@@ -0,0 +1,52 @@
+#include "UniformBuffer.hpp"
+#include "GLState.hpp"
+
+#include <cstring> // For memcpy()
+
+/* Constructor */
+UniformBuffer::UniformBuffer(size_t framesize) : stream(GL_UNIFORM_BUFFER, framesize) {
+    this->alignment = 0;
+}
+
+/* Destructor */
+UniformBuffer::~UniformBuffer() {
+}
+
+
+/*
+ * beginFrame()
+ * Move to the next part of the buffer.
+ */
+void UniformBuffer::beginFrame() {
+
+    if(this->alignment == 0) {
+        GLint align = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        this->alignment = align > 0 ? align : 256; // The largest alignment in practice
+    }
+    this->stream.beginFrame();
+}
+
+
+/*
+ * bind(GLuint binding, const void *block, size_t size)
+ * Copy a block to the next aligned range in the current part of the
+ * buffer, and bind that range to a uniform block binding point.
+ */
+void UniformBuffer::bind(GLuint binding, const void *block, size_t size) {
+
+    GLintptr start;
+    void *data = this->stream.allocate(size, this->alignment, &start);
+    memcpy(data, block, size);
+    this->stream.commit();
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, this->stream.bufferID, start, size);
+}
+
+
+/*
+ * endFrame()
+ * Mark the part of the buffer used this frame.
+ */
+void UniformBuffer::endFrame() {
+    this->stream.endFrame();
+}
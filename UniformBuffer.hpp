@@ -0,0 +1,104 @@
+/* UniformBuffer.hpp */
+/* Uniform blocks shared by the shaders, and a ring buffer to feed them. */
+/* Usage: the structs below have the std140 layout of the uniform blocks
+ * with the same names in the shaders, and static_asserts make sure they
+ * stay that way. Call Shader::bindUniformBlock() for each block name,
+ * binding point and struct size before the programs are created, and
+ * Shader::define() for UNIFORMBLOCK_MAXINSTANCES, the size of the array
+ * in the "Instances" block.
+ * Call beginFrame() on a UniformBuffer at the start of each frame and
+ * endFrame() at the end. In between, bind() copies a block to the next
+ * free part of the buffer and binds that range to a binding point, so each
+ * draw call needs a single glBindBufferRange() instead of one glUniform*()
+ * call per variable. The per-frame block is bound once per frame, and is
+ * then seen by all programs.
+ * The blocks are written to a StreamBuffer, which takes care of not
+ * writing over data the GPU has yet to read (see StreamBuffer.hpp). */
+
+#ifndef UNIFORMBUFFER_HPP
+#define UNIFORMBUFFER_HPP
+
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#endif
+
+#ifdef __linux__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
+#include <GLFW/glfw3.h>
+#include <cstddef> // For offsetof()
+#include "StreamBuffer.hpp"
+
+// Binding points of the uniform blocks
+#define UNIFORMBLOCK_FRAME 0    // "Frame", the same for all draw calls in a frame
+#define UNIFORMBLOCK_OBJECT 1   // "Object" or "Instances", set for each draw call
+
+// Size of the instance array in the "Instances" block
+#define UNIFORMBLOCK_MAXINSTANCES 16
+
+/* layout(std140) uniform Frame */
+struct FrameBlock {
+    GLfloat P[16];      // mat4 P, the projection
+    GLfloat R[16];      // mat4 R, the rotation of the view
+    GLfloat time;       // float time, in seconds
+    GLfloat padding[3]; // A block is a whole number of vec4s
+};
+static_assert(offsetof(FrameBlock, P) == 0, "FrameBlock.P must be at std140 offset 0");
+static_assert(offsetof(FrameBlock, R) == 64, "FrameBlock.R must be at std140 offset 64");
+static_assert(offsetof(FrameBlock, time) == 128, "FrameBlock.time must be at std140 offset 128");
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock must have the std140 size 144");
+
+/* layout(std140) uniform Object */
+struct ObjectBlock {
+    GLfloat MV[16];     // mat4 MV, the modelview matrix
+    GLfloat PMV[16];    // mat4 PMV, P*MV, so the vertex shader needs no matrix product
+};
+static_assert(offsetof(ObjectBlock, MV) == 0, "ObjectBlock.MV must be at std140 offset 0");
+static_assert(offsetof(ObjectBlock, PMV) == 64, "ObjectBlock.PMV must be at std140 offset 64");
+static_assert(sizeof(ObjectBlock) == 128, "ObjectBlock must have the std140 size 128");
+
+/* struct Instance in the "Instances" block */
+struct InstanceBlock {
+    GLfloat MV[16];     // mat4 MV
+    GLfloat PMV[16];    // mat4 PMV
+    GLfloat layer;      // float layer, in an array texture
+    GLfloat padding[3]; // An array element is a whole number of vec4s
+};
+static_assert(offsetof(InstanceBlock, PMV) == 64, "InstanceBlock.PMV must be at std140 offset 64");
+static_assert(offsetof(InstanceBlock, layer) == 128, "InstanceBlock.layer must be at std140 offset 128");
+static_assert(sizeof(InstanceBlock) == 144, "InstanceBlock must have the std140 array stride 144");
+
+/* layout(std140) uniform Instances */
+struct InstancesBlock {
+    InstanceBlock instances[UNIFORMBLOCK_MAXINSTANCES];
+};
+
+class UniformBuffer {
+
+public:
+
+StreamBuffer stream;    // Where the blocks go
+
+/* Constructor. The buffer is made by the first beginFrame(). */
+UniformBuffer(size_t framesize = 64 << 10);
+
+/* Destructor */
+~UniformBuffer();
+
+// Move on to the next part of the buffer. Call at the start of each frame.
+void beginFrame();
+
+// Copy a block to the buffer, and bind it to a binding point for the next draw calls
+void bind(GLuint binding, const void *block, size_t size);
+
+// Mark the part of the buffer used this frame. Call at the end of each frame.
+void endFrame();
+
+private:
+
+size_t alignment;           // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, or 0 until asked
+
+};
+
+#endif // UNIFORMBUFFER_HPP
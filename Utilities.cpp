@@ -16,6 +16,19 @@
  */
 
 #include "Utilities.hpp"
+#include "Headless.hpp"
+
+#include <cstring> // For strcmp()
+#include <cstdlib> // For realpath() and _fullpath()
+
+#ifdef __WIN32__
+#include <windows.h> // For CreateFileMapping() and MapViewOfFile()
+#else
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h> // For fstat()
+#include <fcntl.h>    // For open()
+#include <unistd.h>   // For close()
+#endif
 
 #ifdef __WIN32__
 /* Global function pointers for everything we need beyond OpenGL 1.1 */
@@ -37,6 +50,9 @@ PFNGLUNIFORM1FPROC                glUniform1f          = NULL;
 PFNGLUNIFORM3FPROC                glUniform3f          = NULL;
 PFNGLUNIFORM1FVPROC               glUniform1fv         = NULL;
 PFNGLUNIFORM1IPROC                glUniform1i          = NULL;
+PFNGLUNIFORM3FVPROC               glUniform3fv         = NULL;
+PFNGLUNIFORM4FVPROC               glUniform4fv         = NULL;
+PFNGLGETACTIVEUNIFORMPROC         glGetActiveUniform   = NULL;
 PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv   = NULL;
 PFNGLGENBUFFERSPROC               glGenBuffers         = NULL;
 PFNGLISBUFFERPROC                 glIsBuffer           = NULL;
@@ -51,6 +67,52 @@ PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray  = NULL;
 PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer      = NULL;
 PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray = NULL;
 PFNGLGENERATEMIPMAPPROC           glGenerateMipmap           = NULL;
+PFNGLGETSTRINGIPROC               glGetStringi               = NULL;
+PFNGLCOMPRESSEDTEXIMAGE2DPROC     glCompressedTexImage2D     = NULL;
+PFNGLTEXIMAGE3DPROC               glTexImage3D               = NULL;
+PFNGLTEXSUBIMAGE3DPROC            glTexSubImage3D            = NULL;
+PFNGLCOMPRESSEDTEXIMAGE3DPROC     glCompressedTexImage3D     = NULL;
+PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC  glCompressedTexSubImage3D  = NULL;
+PFNGLACTIVETEXTUREPROC            glActiveTexture            = NULL;
+PFNGLDRAWELEMENTSINSTANCEDPROC    glDrawElementsInstanced    = NULL;
+PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC  glCompressedTexSubImage2D  = NULL;
+PFNGLMAPBUFFERRANGEPROC           glMapBufferRange           = NULL;
+PFNGLUNMAPBUFFERPROC              glUnmapBuffer              = NULL;
+PFNGLFENCESYNCPROC                glFenceSync                = NULL;
+PFNGLCLIENTWAITSYNCPROC           glClientWaitSync           = NULL;
+PFNGLDELETESYNCPROC               glDeleteSync               = NULL;
+PFNGLBUFFERSUBDATAPROC            glBufferSubData            = NULL;
+PFNGLBINDBUFFERRANGEPROC          glBindBufferRange          = NULL;
+PFNGLGETUNIFORMBLOCKINDEXPROC     glGetUniformBlockIndex     = NULL;
+PFNGLUNIFORMBLOCKBINDINGPROC      glUniformBlockBinding      = NULL;
+PFNGLGETACTIVEUNIFORMBLOCKIVPROC  glGetActiveUniformBlockiv  = NULL;
+PFNGLGENQUERIESPROC               glGenQueries               = NULL;
+PFNGLDELETEQUERIESPROC            glDeleteQueries            = NULL;
+PFNGLQUERYCOUNTERPROC             glQueryCounter             = NULL;
+PFNGLGETQUERYOBJECTUI64VPROC      glGetQueryObjectui64v      = NULL;
+PFNGLGETINTEGER64VPROC            glGetInteger64v            = NULL;
+PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers          = NULL;
+PFNGLDELETEFRAMEBUFFERSPROC       glDeleteFramebuffers       = NULL;
+PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer          = NULL;
+PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer  = NULL;
+PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus   = NULL;
+PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers         = NULL;
+PFNGLDELETERENDERBUFFERSPROC      glDeleteRenderbuffers      = NULL;
+PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer         = NULL;
+PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage      = NULL;
+PFNGLGETPROGRAMBINARYPROC         glGetProgramBinary         = NULL;
+PFNGLPROGRAMBINARYPROC            glProgramBinary            = NULL;
+PFNGLPROGRAMPARAMETERIPROC        glProgramParameteri        = NULL;
+PFNGLGENPROGRAMPIPELINESPROC      glGenProgramPipelines      = NULL;
+PFNGLDELETEPROGRAMPIPELINESPROC   glDeleteProgramPipelines   = NULL;
+PFNGLBINDPROGRAMPIPELINEPROC      glBindProgramPipeline      = NULL;
+PFNGLUSEPROGRAMSTAGESPROC         glUseProgramStages         = NULL;
+PFNGLPROGRAMUNIFORM1IPROC         glProgramUniform1i         = NULL;
+PFNGLPROGRAMUNIFORM1FPROC         glProgramUniform1f         = NULL;
+PFNGLPROGRAMUNIFORM1FVPROC        glProgramUniform1fv        = NULL;
+PFNGLPROGRAMUNIFORM3FVPROC        glProgramUniform3fv        = NULL;
+PFNGLPROGRAMUNIFORM4FVPROC        glProgramUniform4fv        = NULL;
+PFNGLPROGRAMUNIFORMMATRIX4FVPROC  glProgramUniformMatrix4fv  = NULL;
 #endif
 
 
@@ -90,13 +152,17 @@ void Utilities::loadExtensions() {
     glUniform3f          = (PFNGLUNIFORM3FPROC)glfwGetProcAddress("glUniform3f");
     glUniform1fv         = (PFNGLUNIFORM1FVPROC)glfwGetProcAddress("glUniform1fv");
     glUniform1i          = (PFNGLUNIFORM1IPROC)glfwGetProcAddress("glUniform1i");
+    glUniform3fv         = (PFNGLUNIFORM3FVPROC)glfwGetProcAddress("glUniform3fv");
+    glUniform4fv         = (PFNGLUNIFORM4FVPROC)glfwGetProcAddress("glUniform4fv");
+    glGetActiveUniform   = (PFNGLGETACTIVEUNIFORMPROC)glfwGetProcAddress("glGetActiveUniform");
 	glUniformMatrix4fv   = (PFNGLUNIFORMMATRIX4FVPROC)glfwGetProcAddress("glUniformMatrix4fv");
 
     if( !glCreateProgram || !glDeleteProgram || !glUseProgram ||
         !glCreateShader || !glDeleteShader || !glShaderSource || !glCompileShader ||
         !glGetShaderiv || !glGetShaderInfoLog || !glAttachShader || !glLinkProgram ||
         !glGetProgramiv || !glGetProgramInfoLog || !glGetUniformLocation ||
-        !glUniform1f || !glUniform3f || !glUniform1fv || !glUniform1i || !glUniformMatrix4fv )
+        !glUniform1f || !glUniform3f || !glUniform1fv || !glUniform1i || !glUniformMatrix4fv ||
+        !glUniform3fv || !glUniform4fv || !glGetActiveUniform )
     {
         printError("GL init error", "One or more required OpenGL shader-related functions were not found");
         return;
@@ -130,10 +196,138 @@ void Utilities::loadExtensions() {
 	   		printError("GL init error", "The required OpenGL function glGenerateMipmap() was not found");
             return;
         }
+
+	glGetStringi           = (PFNGLGETSTRINGIPROC)glfwGetProcAddress("glGetStringi");
+	glCompressedTexImage2D = (PFNGLCOMPRESSEDTEXIMAGE2DPROC)glfwGetProcAddress("glCompressedTexImage2D");
+	glTexImage3D           = (PFNGLTEXIMAGE3DPROC)glfwGetProcAddress("glTexImage3D");
+	glTexSubImage3D        = (PFNGLTEXSUBIMAGE3DPROC)glfwGetProcAddress("glTexSubImage3D");
+	glCompressedTexImage3D = (PFNGLCOMPRESSEDTEXIMAGE3DPROC)glfwGetProcAddress("glCompressedTexImage3D");
+	glCompressedTexSubImage3D = (PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC)glfwGetProcAddress("glCompressedTexSubImage3D");
+	glActiveTexture        = (PFNGLACTIVETEXTUREPROC)glfwGetProcAddress("glActiveTexture");
+	if( !glGetStringi || !glCompressedTexImage2D || !glTexImage3D || !glTexSubImage3D
+		|| !glCompressedTexImage3D || !glCompressedTexSubImage3D || !glActiveTexture )
+    	{
+	   		printError("GL init error", "One or more required OpenGL texture functions were not found");
+            return;
+        }
+
+	glDrawElementsInstanced = (PFNGLDRAWELEMENTSINSTANCEDPROC)glfwGetProcAddress("glDrawElementsInstanced");
+	if( !glDrawElementsInstanced )
+    	{
+	   		printError("GL init error", "The required OpenGL function glDrawElementsInstanced() was not found");
+            return;
+        }
+
+	glCompressedTexSubImage2D = (PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC)glfwGetProcAddress("glCompressedTexSubImage2D");
+	glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+	glUnmapBuffer    = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+	glFenceSync      = (PFNGLFENCESYNCPROC)glfwGetProcAddress("glFenceSync");
+	glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)glfwGetProcAddress("glClientWaitSync");
+	glDeleteSync     = (PFNGLDELETESYNCPROC)glfwGetProcAddress("glDeleteSync");
+	if( !glCompressedTexSubImage2D || !glMapBufferRange || !glUnmapBuffer
+		|| !glFenceSync || !glClientWaitSync || !glDeleteSync )
+    	{
+	   		printError("GL init error", "One or more required OpenGL buffer streaming functions were not found");
+            return;
+        }
+
+	glBufferSubData        = (PFNGLBUFFERSUBDATAPROC)glfwGetProcAddress("glBufferSubData");
+	glBindBufferRange      = (PFNGLBINDBUFFERRANGEPROC)glfwGetProcAddress("glBindBufferRange");
+	glGetUniformBlockIndex = (PFNGLGETUNIFORMBLOCKINDEXPROC)glfwGetProcAddress("glGetUniformBlockIndex");
+	glUniformBlockBinding  = (PFNGLUNIFORMBLOCKBINDINGPROC)glfwGetProcAddress("glUniformBlockBinding");
+	glGetActiveUniformBlockiv = (PFNGLGETACTIVEUNIFORMBLOCKIVPROC)glfwGetProcAddress("glGetActiveUniformBlockiv");
+	if( !glBufferSubData || !glBindBufferRange || !glGetUniformBlockIndex || !glUniformBlockBinding
+	    || !glGetActiveUniformBlockiv )
+    	{
+	   		printError("GL init error", "One or more required OpenGL uniform buffer functions were not found");
+            return;
+        }
+
+	glGenQueries          = (PFNGLGENQUERIESPROC)glfwGetProcAddress("glGenQueries");
+	glDeleteQueries       = (PFNGLDELETEQUERIESPROC)glfwGetProcAddress("glDeleteQueries");
+	glQueryCounter        = (PFNGLQUERYCOUNTERPROC)glfwGetProcAddress("glQueryCounter");
+	glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)glfwGetProcAddress("glGetQueryObjectui64v");
+	glGetInteger64v       = (PFNGLGETINTEGER64VPROC)glfwGetProcAddress("glGetInteger64v");
+	if( !glGenQueries || !glDeleteQueries || !glQueryCounter || !glGetQueryObjectui64v || !glGetInteger64v )
+    	{
+	   		printError("GL init error", "One or more required OpenGL timer query functions were not found");
+            return;
+        }
+
+	glGenFramebuffers         = (PFNGLGENFRAMEBUFFERSPROC)glfwGetProcAddress("glGenFramebuffers");
+	glDeleteFramebuffers      = (PFNGLDELETEFRAMEBUFFERSPROC)glfwGetProcAddress("glDeleteFramebuffers");
+	glBindFramebuffer         = (PFNGLBINDFRAMEBUFFERPROC)glfwGetProcAddress("glBindFramebuffer");
+	glFramebufferRenderbuffer = (PFNGLFRAMEBUFFERRENDERBUFFERPROC)glfwGetProcAddress("glFramebufferRenderbuffer");
+	glCheckFramebufferStatus  = (PFNGLCHECKFRAMEBUFFERSTATUSPROC)glfwGetProcAddress("glCheckFramebufferStatus");
+	glGenRenderbuffers        = (PFNGLGENRENDERBUFFERSPROC)glfwGetProcAddress("glGenRenderbuffers");
+	glDeleteRenderbuffers     = (PFNGLDELETERENDERBUFFERSPROC)glfwGetProcAddress("glDeleteRenderbuffers");
+	glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)glfwGetProcAddress("glBindRenderbuffer");
+	glRenderbufferStorage     = (PFNGLRENDERBUFFERSTORAGEPROC)glfwGetProcAddress("glRenderbufferStorage");
+	if( !glGenFramebuffers || !glDeleteFramebuffers || !glBindFramebuffer || !glFramebufferRenderbuffer
+		|| !glCheckFramebufferStatus || !glGenRenderbuffers || !glDeleteRenderbuffers
+		|| !glBindRenderbuffer || !glRenderbufferStorage )
+    	{
+	   		printError("GL init error", "One or more required OpenGL framebuffer functions were not found");
+            return;
+        }
+
+	// Program binaries are optional (OpenGL 4.1), so they may be missing
+	glGetProgramBinary  = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+	glProgramBinary     = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+	glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+
+	// Separable programs are optional too (OpenGL 4.1)
+	glGenProgramPipelines     = (PFNGLGENPROGRAMPIPELINESPROC)glfwGetProcAddress("glGenProgramPipelines");
+	glDeleteProgramPipelines  = (PFNGLDELETEPROGRAMPIPELINESPROC)glfwGetProcAddress("glDeleteProgramPipelines");
+	glBindProgramPipeline     = (PFNGLBINDPROGRAMPIPELINEPROC)glfwGetProcAddress("glBindProgramPipeline");
+	glUseProgramStages        = (PFNGLUSEPROGRAMSTAGESPROC)glfwGetProcAddress("glUseProgramStages");
+	glProgramUniform1i        = (PFNGLPROGRAMUNIFORM1IPROC)glfwGetProcAddress("glProgramUniform1i");
+	glProgramUniform1f        = (PFNGLPROGRAMUNIFORM1FPROC)glfwGetProcAddress("glProgramUniform1f");
+	glProgramUniform1fv       = (PFNGLPROGRAMUNIFORM1FVPROC)glfwGetProcAddress("glProgramUniform1fv");
+	glProgramUniform3fv       = (PFNGLPROGRAMUNIFORM3FVPROC)glfwGetProcAddress("glProgramUniform3fv");
+	glProgramUniform4fv       = (PFNGLPROGRAMUNIFORM4FVPROC)glfwGetProcAddress("glProgramUniform4fv");
+	glProgramUniformMatrix4fv = (PFNGLPROGRAMUNIFORMMATRIX4FVPROC)glfwGetProcAddress("glProgramUniformMatrix4fv");
 #endif
 }
 
 
+/*
+ * hasExtension() - Check if the current OpenGL context supports an extension.
+ * In a core profile context, the extensions have to be listed one by one.
+ */
+int Utilities::hasExtension(const char *name) {
+
+    GLint numextensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numextensions);
+    for(GLint i = 0; i < numextensions; i++) {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if(extension && strcmp(extension, name) == 0) {
+            return GL_TRUE;
+        }
+    }
+    return GL_FALSE;
+}
+
+
+/*
+ * getTime() - Seconds from GLFW, or from the headless context.
+ */
+double Utilities::getTime() {
+    if(Headless::isActive()) return Headless::getTime();
+    return glfwGetTime();
+}
+
+
+/*
+ * getProcAddress() - Look up an OpenGL function through GLFW, or through
+ * EGL for a headless context.
+ */
+GLFWglproc Utilities::getProcAddress(const char *name) {
+    if(Headless::isActive()) return (GLFWglproc)Headless::getProcAddress(name);
+    return glfwGetProcAddress(name);
+}
+
+
 /*
  * displayFPS() - Calculate, display and return frame rate statistics.
  * Called every frame, but statistics are updated only once per second.
@@ -154,7 +348,7 @@ double Utilities::displayFPS(GLFWwindow *window) {
     double t;
 
     // Get current time
-    t = glfwGetTime();  // Gets number of seconds since glfwInit()
+    t = getTime();  // Gets number of seconds since glfwInit()
     // If one second has passed, or if this is the very first frame
     if( (t-t0) > 1.0 || frames == 0 )
     {
@@ -169,3 +363,105 @@ double Utilities::displayFPS(GLFWwindow *window) {
     frames ++;
     return fps;
 }
+
+
+/*
+ * mapFile() - Map an entire file read-only into memory.
+ * The pages are loaded by the OS on demand, so no copy of the file
+ * contents is made in our own memory, and the data pointer can be
+ * handed directly to OpenGL for uploading.
+ */
+int Utilities::mapFile(const char *filename, MappedFile *file) {
+
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+
+#ifdef __WIN32__
+    HANDLE hfile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hfile == INVALID_HANDLE_VALUE) {
+        return GL_FALSE;
+    }
+    LARGE_INTEGER filesize;
+    if(!GetFileSizeEx(hfile, &filesize) || filesize.QuadPart == 0) {
+        CloseHandle(hfile);
+        return GL_FALSE;
+    }
+    HANDLE hmapping = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hfile); // The mapping keeps its own reference to the file
+    if(hmapping == NULL) {
+        return GL_FALSE;
+    }
+    void *view = MapViewOfFile(hmapping, FILE_MAP_READ, 0, 0, 0);
+    if(view == NULL) {
+        CloseHandle(hmapping);
+        return GL_FALSE;
+    }
+    file->data = (const unsigned char*)view;
+    file->size = (size_t)filesize.QuadPart;
+    file->handle = hmapping;
+#else
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return GL_FALSE;
+    }
+    struct stat filestat;
+    if(fstat(fd, &filestat) != 0 || filestat.st_size == 0) {
+        close(fd);
+        return GL_FALSE;
+    }
+    void *view = mmap(NULL, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid after the file is closed
+    if(view == MAP_FAILED) {
+        return GL_FALSE;
+    }
+    // We read the whole file front to back, so ask for aggressive read-ahead
+    madvise(view, filestat.st_size, MADV_SEQUENTIAL);
+    file->data = (const unsigned char*)view;
+    file->size = (size_t)filestat.st_size;
+#endif
+    return GL_TRUE;
+}
+
+
+/*
+ * canonicalPath() - The absolute path of a file, for comparing file names.
+ */
+int Utilities::canonicalPath(const char *filename, char *path, size_t size) {
+
+    if(size == 0) return GL_FALSE;
+#ifdef __WIN32__
+    if(_fullpath(path, filename, size) != NULL) {
+        return GL_TRUE; // Windows names are not case sensitive, but we don't fold them
+    }
+#else
+    char *resolved = realpath(filename, NULL); // Fails if the file does not exist
+    if(resolved != NULL && strlen(resolved) < size) {
+        strcpy(path, resolved);
+        free(resolved);
+        return GL_TRUE;
+    }
+    free(resolved);
+#endif
+    strncpy(path, filename, size - 1);
+    path[size - 1] = '\0';
+    return GL_FALSE;
+}
+
+/*
+ * unmapFile() - Release a mapping created by mapFile().
+ */
+void Utilities::unmapFile(MappedFile *file) {
+
+    if(file->data == NULL) return;
+#ifdef __WIN32__
+    UnmapViewOfFile((void*)file->data);
+    CloseHandle((HANDLE)file->handle);
+#else
+    munmap((void*)file->data, file->size);
+#endif
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+}
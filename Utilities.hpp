@@ -15,13 +15,18 @@
 #define GLFW_INCLUDE_GLCOREARB
 #endif
 
-#ifdef __LINUX__
+// __linux__, as in the other headers (compilers define no __LINUX__).
+// hasExtension() needs glGetStringi() from glext.h.
+#ifdef __linux__
 #define GL_GLEXT_PROTOTYPES
 #endif
 
 #include <GLFW/glfw3.h>
 
 #include <cstdio>  // For console messages
+#include <cstddef> // For size_t
+#include <thread>  // For parallelRows()
+#include <vector>
 
 #ifdef __WIN32__
 // Windows installations usually lack an up-to-date OpenGL extension header,
@@ -49,6 +54,9 @@ extern PFNGLUNIFORM1FPROC                glUniform1f;
 extern PFNGLUNIFORM3FPROC                glUniform3f;
 extern PFNGLUNIFORM1FVPROC               glUniform1fv;
 extern PFNGLUNIFORM1IPROC                glUniform1i;
+extern PFNGLUNIFORM3FVPROC               glUniform3fv;
+extern PFNGLUNIFORM4FVPROC               glUniform4fv;
+extern PFNGLGETACTIVEUNIFORMPROC         glGetActiveUniform;
 extern PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv;
 extern PFNGLGENBUFFERSPROC               glGenBuffers;
 extern PFNGLISBUFFERPROC                 glIsBuffer;
@@ -63,10 +71,67 @@ extern PFNGLENABLEVERTEXATTRIBARRAYPROC  glEnableVertexAttribArray;
 extern PFNGLVERTEXATTRIBPOINTERPROC      glVertexAttribPointer;
 extern PFNGLDISABLEVERTEXATTRIBARRAYPROC glDisableVertexAttribArray;
 extern PFNGLGENERATEMIPMAPPROC           glGenerateMipmap;
+extern PFNGLGETSTRINGIPROC               glGetStringi;
+extern PFNGLCOMPRESSEDTEXIMAGE2DPROC     glCompressedTexImage2D;
+extern PFNGLTEXIMAGE3DPROC               glTexImage3D;
+extern PFNGLTEXSUBIMAGE3DPROC            glTexSubImage3D;
+extern PFNGLCOMPRESSEDTEXIMAGE3DPROC     glCompressedTexImage3D;
+extern PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC  glCompressedTexSubImage3D;
+extern PFNGLACTIVETEXTUREPROC            glActiveTexture;
+extern PFNGLDRAWELEMENTSINSTANCEDPROC    glDrawElementsInstanced;
+extern PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC  glCompressedTexSubImage2D;
+extern PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+extern PFNGLFENCESYNCPROC                glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+extern PFNGLDELETESYNCPROC               glDeleteSync;
+extern PFNGLBUFFERSUBDATAPROC            glBufferSubData;
+extern PFNGLBINDBUFFERRANGEPROC          glBindBufferRange;
+extern PFNGLGETUNIFORMBLOCKINDEXPROC     glGetUniformBlockIndex;
+extern PFNGLUNIFORMBLOCKBINDINGPROC      glUniformBlockBinding;
+extern PFNGLGETACTIVEUNIFORMBLOCKIVPROC  glGetActiveUniformBlockiv;
+extern PFNGLGENQUERIESPROC               glGenQueries;
+extern PFNGLDELETEQUERIESPROC            glDeleteQueries;
+extern PFNGLQUERYCOUNTERPROC             glQueryCounter;
+extern PFNGLGETQUERYOBJECTUI64VPROC      glGetQueryObjectui64v;
+extern PFNGLGETINTEGER64VPROC            glGetInteger64v;
+extern PFNGLGENFRAMEBUFFERSPROC          glGenFramebuffers;
+extern PFNGLDELETEFRAMEBUFFERSPROC       glDeleteFramebuffers;
+extern PFNGLBINDFRAMEBUFFERPROC          glBindFramebuffer;
+extern PFNGLFRAMEBUFFERRENDERBUFFERPROC  glFramebufferRenderbuffer;
+extern PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
+extern PFNGLGENRENDERBUFFERSPROC         glGenRenderbuffers;
+extern PFNGLDELETERENDERBUFFERSPROC      glDeleteRenderbuffers;
+extern PFNGLBINDRENDERBUFFERPROC         glBindRenderbuffer;
+extern PFNGLRENDERBUFFERSTORAGEPROC      glRenderbufferStorage;
+extern PFNGLGETPROGRAMBINARYPROC         glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC            glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC        glProgramParameteri;
+extern PFNGLGENPROGRAMPIPELINESPROC      glGenProgramPipelines;
+extern PFNGLDELETEPROGRAMPIPELINESPROC   glDeleteProgramPipelines;
+extern PFNGLBINDPROGRAMPIPELINEPROC      glBindProgramPipeline;
+extern PFNGLUSEPROGRAMSTAGESPROC         glUseProgramStages;
+extern PFNGLPROGRAMUNIFORM1IPROC         glProgramUniform1i;
+extern PFNGLPROGRAMUNIFORM1FPROC         glProgramUniform1f;
+extern PFNGLPROGRAMUNIFORM1FVPROC        glProgramUniform1fv;
+extern PFNGLPROGRAMUNIFORM3FVPROC        glProgramUniform3fv;
+extern PFNGLPROGRAMUNIFORM4FVPROC        glProgramUniform4fv;
+extern PFNGLPROGRAMUNIFORMMATRIX4FVPROC  glProgramUniformMatrix4fv;
 
 #endif
 
 namespace Utilities {
+
+/*
+ * A read-only memory mapping of an entire file, as created by mapFile().
+ * The file contents are available as data[0] to data[size-1].
+ */
+struct MappedFile {
+    const unsigned char *data;
+    size_t size;
+    void *handle; // Platform specific (Windows file mapping object)
+};
+
 /*
  * printError() - Signal an error.
  * Simple printf() to console for portability.
@@ -80,6 +145,24 @@ void printError(const char *errtype, const char *errmsg);
  */
 void loadExtensions();
 
+/*
+ * hasExtension() - Check if the current OpenGL context supports
+ * an extension, like "GL_EXT_texture_compression_s3tc".
+ */
+int hasExtension(const char *name);
+
+/*
+ * getTime() - Seconds since the OpenGL context was made, like glfwGetTime(),
+ * which it calls, unless the context is headless (see Headless.hpp).
+ */
+double getTime();
+
+/*
+ * getProcAddress() - Look up an OpenGL function in the current context,
+ * like glfwGetProcAddress(), for both GLFW and headless contexts.
+ */
+GLFWglproc getProcAddress(const char *name);
+
 /*
  * displayFPS() - Calculate, display and return frame rate statistics.
  * Called every frame, but statistics are updated only once per second.
@@ -91,6 +174,56 @@ void loadExtensions();
  */
 double displayFPS(GLFWwindow *window);
 
+/*
+ * mapFile() - Map an entire file read-only into memory.
+ * Returns GL_TRUE on success, GL_FALSE if the file could not be
+ * opened or mapped. The mapping must be released with unmapFile().
+ */
+int mapFile(const char *filename, MappedFile *file);
+
+/*
+ * unmapFile() - Release a mapping created by mapFile().
+ * Calling it on an unmapped (zeroed) MappedFile is harmless.
+ */
+void unmapFile(MappedFile *file);
+
+/*
+ * canonicalPath() - Write the absolute path of a file, with no "." or ".."
+ * parts or symbolic links, to path, so the same file always gets the same
+ * name. Returns GL_FALSE and copies the name as it is if that fails.
+ */
+int canonicalPath(const char *filename, char *path, size_t size);
+
+/*
+ * parallelRows() - Run func(firstrow, endrow) over bands of rows, on
+ * several threads if there is enough work. rowcost is a rough measure of
+ * the work per row (like pixels times filter taps). Returns when all rows
+ * are done. The calling thread does the first band itself.
+ */
+template <class Func>
+void parallelRows(unsigned int numrows, size_t rowcost, Func func) {
+
+    const size_t mincost = 65536; // Don't start a thread for less work than this
+    unsigned int numthreads = std::thread::hardware_concurrency();
+    if(numrows == 0) return;
+    if(numthreads == 0) numthreads = 1;
+    size_t maxthreads = numrows * rowcost / mincost;
+    if(maxthreads < numthreads) numthreads = maxthreads > 0 ? (unsigned int)maxthreads : 1;
+    if(numthreads > numrows) numthreads = numrows;
+
+    std::vector<std::thread> workers;
+    unsigned int band = (numrows + numthreads - 1) / numthreads;
+    for(unsigned int i = 1; i < numthreads; i++) {
+        unsigned int first = i * band;
+        unsigned int end = first + band < numrows ? first + band : numrows;
+        if(first < end) workers.push_back(std::thread(func, first, end));
+    }
+    func(0u, band < numrows ? band : numrows);
+    for(size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
 }
 
 #endif // UTILITIES_HPP
@@ -0,0 +1,35 @@
+// Phong shading, included by fragment.glsl and planetfragment.glsl.
+// Define SPECULAR to add highlights, otherwise only the diffuse light is computed.
+
+// vec3 L is the light direction
+// vec3 V is the view direction - (0,0,1) in view space
+// vec3 N is the normal
+// vec3 Ref is the computed reflection direction
+// float n is the "shininess" parameter
+// vec3 kd is the diffuse surface reflection color
+// vec3 Id is the diffuse illumination color
+// vec3 ks is the specular surface reflection color
+// vec3 Is is the specular illumination color
+// (The ambient term Ia*ka is left out, since ka is black for all our materials.)
+
+//This assumes that N and L are normalized
+vec3 phong(vec3 N, vec3 L, vec3 kd) {
+
+    vec3 Id = vec3(1.0, 1.0, 1.0);
+    float dotNL = max(dot(N,L), 0.0); //If negative, set to zero
+    vec3 shadedcolor = Id*kd *dotNL;
+
+#ifdef SPECULAR
+    vec3 V = vec3(0.0, 0.0, 1.0);
+    vec3 Is = vec3(0.5, 0.5, 0.5);
+    vec3 ks = vec3(1.0, 1.0, 1.0);
+    float n = 10.0;
+
+    vec3 Ref = 2.0 * dot(N,L)*N -L; //Could have also used the function reflect()
+    float dotRV = max(dot(Ref,V), 0.0);
+    if(dotNL == 0.0) dotRV = 0.0;
+    shadedcolor += Is*ks *pow(dotRV, n);
+#endif
+
+    return shadedcolor;
+}
@@ -0,0 +1,29 @@
+# version 330 core
+out vec4 finalcolor ;
+
+in vec3 interpolatedNormal;
+in vec2 st;
+in vec3 lightDirection;
+flat in float layer;
+
+// Switches set by ShaderVariants: TEXTURED, SPECULAR (see phong.glsl)
+#include "phong.glsl"
+
+#ifdef TEXTURED
+uniform sampler2DArray tex; // All planet textures, one layer each
+#endif
+
+void main () {
+
+    vec3 L = normalize(lightDirection);
+    vec3 N = normalize(interpolatedNormal);
+
+#ifdef TEXTURED
+    vec3 kd = vec3(texture(tex, vec3(st, layer)));
+#else
+    vec3 kd = vec3(0.8, 0.8, 0.8);
+#endif
+
+    // The same Phong shading as in fragment.glsl
+    finalcolor = vec4 (phong(N, L, kd), 1.0);
+}
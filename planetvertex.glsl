@@ -0,0 +1,42 @@
+# version 330 core
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoord;
+
+out vec3 interpolatedNormal;
+out vec2 st;
+out vec3 lightDirection;
+flat out float layer;
+
+// The same for all objects in a frame (FrameBlock in UniformBuffer.hpp)
+layout(std140) uniform Frame {
+    mat4 P;
+    mat4 R;
+    float time;
+};
+
+// One modelview matrix and one texture array layer per instance
+// (InstancesBlock in UniformBuffer.hpp). UNIFORMBLOCK_MAXINSTANCES is
+// #defined by the program, with Shader::define().
+struct Instance {
+    mat4 MV;
+    mat4 PMV; // P * MV, made on the CPU
+    float layer;
+};
+layout(std140) uniform Instances {
+    Instance instances[UNIFORMBLOCK_MAXINSTANCES];
+};
+
+void main () {
+
+    mat4 MV = instances[gl_InstanceID].MV;
+
+    vec3 transformedNormal = mat3(MV) * Normal;
+    interpolatedNormal = normalize(transformedNormal);
+
+    lightDirection = mat3(R) * vec3(1.0, 0.8, 1.0);
+
+    gl_Position = instances[gl_InstanceID].PMV * vec4(Position, 1.0);
+    st = TexCoord;
+    layer = instances[gl_InstanceID].layer;
+}
@@ -13,8 +13,18 @@ out vec3 lightDirection;
 
 //out vec3 interpolatedColor;
 
-uniform float time;
-uniform mat4 R, MV, P;
+// The same for all objects in a frame (FrameBlock in UniformBuffer.hpp)
+layout(std140) uniform Frame {
+    mat4 P;
+    mat4 R;
+    float time;
+};
+
+// Set for each object (ObjectBlock in UniformBuffer.hpp)
+layout(std140) uniform Object {
+    mat4 MV;
+    mat4 PMV; // P * MV, made on the CPU
+};
 
 void main () {
 
@@ -30,7 +40,7 @@ void main () {
 
     lightDirection = mat3(R) * vec3(1.0, 0.8, 1.0);
 
-    gl_Position = P * MV * vec4(Position, 1.0);
+    gl_Position = PMV * vec4(Position, 1.0);
     //interpolatedNormal = Normal;
     st = TexCoord;
 